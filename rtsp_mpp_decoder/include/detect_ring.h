@@ -0,0 +1,41 @@
+#ifndef DETECT_RING_H
+#define DETECT_RING_H
+
+#include <string>
+#include <stdint.h>
+
+#include "detect_ring_format.h"
+#include "rknn_type.h"
+
+/**
+ * 检测结果共享内存环形缓冲区写端
+ * 只允许一个线程(编码线程)调用 publish, 写入不加锁也不等待读端
+ */
+class DetectRingWriter {
+public:
+    DetectRingWriter() = default;
+    ~DetectRingWriter();
+
+    DetectRingWriter(const DetectRingWriter&) = delete;
+    DetectRingWriter& operator=(const DetectRingWriter&) = delete;
+
+    // path 为 /dev/shm 下的文件, 已存在时先删除(旧读端继续持有旧映射)
+    int initialize(const DetectRingConfig& config);
+    void publish(const code_frame_t& frame);
+    void close();
+
+    uint64_t published() const { return m_index; }
+
+private:
+    std::string m_path;
+    uint8_t *m_map = nullptr;
+    size_t m_map_size = 0;
+    detect_ring_header_t *m_header = nullptr;
+    detect_ring_slot_t *m_slots = nullptr;
+    uint32_t m_slot_count = 0;
+    uint32_t m_stream_id = 0;
+    uint64_t m_index = 0;
+    uint64_t m_truncated = 0;   // 目标数超过 DETECT_RING_MAX_OBJECTS 被截断的帧数
+};
+
+#endif
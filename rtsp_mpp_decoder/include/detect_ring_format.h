@@ -0,0 +1,69 @@
+#ifndef DETECT_RING_FORMAT_H
+#define DETECT_RING_FORMAT_H
+
+#include <stdint.h>
+
+/*
+ * 检测结果共享内存环形缓冲区的内存布局, 写端(本程序)与 C 读端库共用
+ *
+ * [header 128字节][slot 0][slot 1]...[slot N-1]
+ *
+ * 单写多读, 写端从不等待读端. 每个 slot 带一个 seqlock 版本号:
+ * 写入第 i 条记录时先置 version = 2*i+1(写入中), 写完置 2*i+2.
+ * 读端拷贝前后版本号一致且等于 2*i+2 才算读到完整记录,
+ * 否则说明记录已被覆盖(读端落后超过 slot_count 条), 计入丢失.
+ */
+
+#define DETECT_RING_MAGIC           0x474e5244u  /* "DRNG" */
+#define DETECT_RING_VERSION         1
+#define DETECT_RING_MAX_OBJECTS     32
+#define DETECT_RING_HEADER_SIZE     128
+
+/* record.flags */
+#define DETECT_RING_FLAG_INFERRED   0x1  /* 本帧经过推理 */
+#define DETECT_RING_FLAG_REUSED     0x2  /* 本帧未推理(按间隔/画面静止跳过), objects 沿用最近一次推理结果 */
+/* 两者都未置位: 推理线程全忙直通编码, 无检测结果 */
+
+typedef struct {
+    int16_t left;
+    int16_t top;
+    int16_t right;
+    int16_t bottom;
+    int16_t cls_id;
+    int16_t track_id;       /* -1: 无 */
+    float score;
+} detect_ring_object_t;
+
+typedef struct {
+    uint32_t stream_id;
+    uint32_t count;         /* objects 中有效个数 */
+    uint64_t frame_seq;
+    int64_t pts;            /* 源码流 pts(ms) */
+    int64_t timestamp_us;   /* 写入时间, CLOCK_MONOTONIC */
+    uint16_t width;         /* 坐标对应的图像尺寸 */
+    uint16_t height;
+    uint32_t flags;
+    detect_ring_object_t objects[DETECT_RING_MAX_OBJECTS];
+} detect_ring_record_t;
+
+typedef struct {
+    uint64_t version;       /* seqlock 版本号 */
+    uint64_t reserved;
+    detect_ring_record_t record;
+} __attribute__((aligned(64))) detect_ring_slot_t;
+
+typedef struct {
+    uint32_t magic;         /* 初始化完成后最后写入 */
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t slot_size;
+    uint32_t slot_count;
+    uint32_t max_objects;
+    int32_t writer_pid;
+    uint32_t reserved0;
+    uint8_t pad0[32];
+    uint64_t write_index __attribute__((aligned(64)));  /* 已发布的记录数, 单独一个 cache line */
+    uint8_t pad1[56];
+} detect_ring_header_t;
+
+#endif
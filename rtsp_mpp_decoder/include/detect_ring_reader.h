@@ -0,0 +1,50 @@
+#ifndef DETECT_RING_READER_H
+#define DETECT_RING_READER_H
+
+/*
+ * 检测结果共享内存环形缓冲区 C 读端库
+ *
+ *   detect_ring_reader_t *r = detect_ring_open("/dev/shm/rknn_detect");
+ *   detect_ring_record_t rec;
+ *   while (running) {
+ *       if (detect_ring_read(r, &rec) == 1) { ... } else { usleep(5000); }
+ *   }
+ *   detect_ring_close(r);
+ *
+ * 读端只读映射, 不修改共享内存, 任意多个读端互不影响, 也不会阻塞写端.
+ * 读端落后超过 slot_count 条时被覆盖的记录计入 detect_ring_lost().
+ */
+
+#include <stdint.h>
+#include "detect_ring_format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct detect_ring_reader detect_ring_reader_t;
+
+/* 打开并映射, 从当前最新位置开始读; 失败返回 NULL */
+detect_ring_reader_t *detect_ring_open(const char *path);
+void detect_ring_close(detect_ring_reader_t *reader);
+
+/* 读取下一条记录: 1 读到, 0 暂无新记录, -1 共享内存无效 */
+int detect_ring_read(detect_ring_reader_t *reader, detect_ring_record_t *record);
+
+/* 跳过积压, 下次从最新记录开始读 */
+void detect_ring_seek_latest(detect_ring_reader_t *reader);
+
+/* 因落后被覆盖而丢失的记录数 */
+uint64_t detect_ring_lost(const detect_ring_reader_t *reader);
+
+/* 拷贝期间被写端覆盖而丢弃的次数(已计入 lost) */
+uint64_t detect_ring_torn(const detect_ring_reader_t *reader);
+
+/* 写端已发布的记录总数 */
+uint64_t detect_ring_published(const detect_ring_reader_t *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
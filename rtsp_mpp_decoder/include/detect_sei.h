@@ -0,0 +1,30 @@
+#ifndef DETECT_SEI_H
+#define DETECT_SEI_H
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "rknn_type.h"
+#include "nal_parser.h"
+
+// 检测结果 SEI(user_data_unregistered, payloadType 5)
+// 负载(大端): version(1) count(1) frame_seq(4) width(2) height(2),
+// 每个目标12字节: cls_id(1) score(1, 0~255) track_id(2, 0xffff 表示无) left top right bottom(各2)
+#define DETECT_SEI_VERSION      1
+#define DETECT_SEI_MAX_OBJECTS  255
+
+struct detect_sei_t {
+    uint64_t frame_seq = 0;
+    int width = 0;
+    int height = 0;
+    std::vector<frame_detect_t> detects;
+};
+
+// 生成带起始码的 SEI NAL(含防竞争字节)
+void detect_sei_build(eNalCodec codec, const detect_sei_t& sei, std::vector<uint8_t>& out);
+
+// 解析一个 SEI NAL(不含起始码), 不是检测结果 SEI 时返回 false
+bool detect_sei_parse(eNalCodec codec, const uint8_t *nal, size_t size, detect_sei_t& sei);
+
+#endif
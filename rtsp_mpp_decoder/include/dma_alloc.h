@@ -29,6 +29,8 @@
 int dma_sync_device_to_cpu(int fd);
 int dma_sync_cpu_to_device(int fd);
 
+int dma_heap_open(const char *path);
+int dma_heap_alloc(int heap_fd, size_t size, int *fd, void **va);
 int dma_buf_alloc(const char *path, size_t size, int *fd, void **va);
 void dma_buf_free(size_t size, int *fd, void *va);
 
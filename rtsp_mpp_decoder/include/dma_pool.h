@@ -0,0 +1,115 @@
+#ifndef DMA_POOL_H
+#define DMA_POOL_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+// 池中的一块DMA缓冲, size 为所属尺寸档的容量
+struct dma_block_t {
+    int fd = -1;
+    void *va = nullptr;
+    size_t size = 0;
+    bool cached = false;    // 实际分配自带CPU缓存的 dma_heap, CPU访问需做缓存维护(memfd 后端为 false)
+};
+
+// 按使用方统计
+struct dma_owner_stats_t {
+    size_t in_use_bytes = 0;
+    size_t peak_bytes = 0;
+    int in_use_blocks = 0;
+    uint64_t allocs = 0;    // 新分配次数
+    uint64_t reuses = 0;    // 从池中复用次数
+};
+
+// 进程级DMA缓冲池
+// 按尺寸档(每个2的幂区间分8档)缓存释放的缓冲, 需要时才向堆申请, 空闲缓冲超过上限或
+// 超时由 trim 归还. 每个堆只打开一次; 堆设备不存在时(或 force_memfd)使用 memfd 后端,
+// 便于在没有 /dev/dma_heap 的主机上验证池逻辑.
+class DmaPool {
+public:
+    static DmaPool& getInstance() {
+        static DmaPool instance;
+        return instance;
+    }
+
+    // max_free_bytes: 空闲缓冲总量上限, 超过时立即归还
+    void configure(size_t max_free_bytes, bool force_memfd);
+
+    // dma_data_t 默认使用的堆, 启动时设置一次
+    void set_default_heap(const std::string& heap_path) { m_default_heap = heap_path; }
+    const std::string& default_heap() const { return m_default_heap; }
+    // 按堆名判断是否带CPU缓存; 实际分配到的缓冲以 dma_block_t::cached 为准
+    static bool is_cached_heap(const std::string& heap_path) {
+        return heap_path.find("uncached") == std::string::npos;
+    }
+
+    // 取一块不小于 size 的缓冲
+    int acquire(const char *heap_path, size_t size, const char *owner, dma_block_t *block);
+    // 归还缓冲到池中
+    void release(const char *heap_path, dma_block_t *block, const char *owner);
+
+    // 归还空闲超过 idle_ms 的缓冲, idle_ms 为0时归还全部空闲缓冲
+    void trim(int idle_ms);
+
+    void dump_stats();
+
+    // 已向堆申请的总字节数(含池中空闲)
+    size_t get_total_bytes() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_total_bytes;
+    }
+
+    // 池中空闲缓冲总字节数
+    size_t get_free_bytes() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_free_bytes;
+    }
+
+    // 指定使用方的统计, 没有记录时全为0
+    dma_owner_stats_t get_owner_stats(const char *owner) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_owners.find(owner);
+        return it != m_owners.end() ? it->second : dma_owner_stats_t();
+    }
+
+    static size_t size_class(size_t size);
+
+    DmaPool(const DmaPool&) = delete;
+    DmaPool& operator=(const DmaPool&) = delete;
+
+private:
+    DmaPool() = default;
+    ~DmaPool();
+
+    struct free_block_t {
+        dma_block_t block;
+        int64_t idle_since_ms;
+    };
+
+    struct heap_t {
+        int heap_fd = -1;
+        bool use_memfd = false;
+        std::map<size_t, std::vector<free_block_t>> free_lists;
+    };
+
+    heap_t& get_heap(const char *heap_path);
+    int alloc_block(heap_t& heap, size_t size, dma_block_t *block);
+    void free_block(dma_block_t *block);
+    void trim_locked(int idle_ms, size_t target_free_bytes);
+
+private:
+    std::mutex m_mutex;
+    std::map<std::string, heap_t> m_heaps;
+    std::map<std::string, dma_owner_stats_t> m_owners;
+    size_t m_free_bytes = 0;
+    size_t m_total_bytes = 0;   // 已向堆申请的总量(含空闲)
+    size_t m_max_free_bytes = 64 * 1024 * 1024;
+    bool m_force_memfd = false;
+    std::string m_default_heap = "/dev/dma_heap/cma";
+};
+
+#endif
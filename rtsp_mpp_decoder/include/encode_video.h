@@ -4,6 +4,11 @@
 #include <functional>
 #include <string>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <condition_variable>
 
 #pragma once
 
@@ -50,6 +55,8 @@ struct FrameInfo {
 struct StreamInfo {
     short StreamType;   //eStreamType
     uint32_t gop;       //
+    int profile;        //profile_idc, 0: 默认
+    int level;          //level_idc, 0: 默认
 };
 
 typedef struct InputInfo{
@@ -59,6 +66,23 @@ typedef struct InputInfo{
     short format;           //eFormatType
     uint8_t data[256];      //head数据
     uint32_t size;          //数据大小
+    int buf_num = 4;        //编码输入/输出缓冲环大小
+    short stream_type = H264;   //eStreamType
+    int rc_mode = MPP_ENC_RC_MODE_VBR;  //MppEncRcMode
+    int bps = 0;            //目标码率, 0: 按分辨率和帧率估算
+    int qp_init = -1;       //初始qp, -1: 编码器自动, FIXQP模式下为固定qp
+    int qp_min = 10;        //最小qp
+    int qp_max = 51;        //最大qp
+    int gop = 0;            //关键帧间隔, 0: 2秒
+    int profile = 0;        //0: h264 high / h265 main
+    int level = 0;          //0: h264 40 / h265 编码器默认
+    bool low_latency = false;   //低延迟模式: 按slice切分输出, 每个slice编码完立即回调
+    int slice_rows = 4;     //低延迟模式下每个slice包含的宏块/CTU行数
+    bool roi_enable = false;    //按检测框做ROI编码
+    int roi_max_regions = 8;    //每帧最多ROI区域数(含背景区域)
+    int roi_obj_qp = -6;        //目标区域相对qp
+    int roi_bg_qp = 4;          //背景相对qp, 0: 不调整背景
+    bool idr_each_header = true;    //每个IDR前重复SPS/PPS, 便于新观众按需IDR起播
 } InputInfo ;
 
 //编码格式
@@ -71,16 +95,57 @@ struct MppEncInfo {
     int32_t header_size;
     int32_t mdinfo_size;
     int32_t bps;
+    int32_t qp_init;
+    int32_t qp_min;
+    int32_t qp_max;
     MppCodingType code_type;
     MppFrameFormat frame_format;
 
     MppEncRcMode rc_mode;
+    bool low_latency;
+    int32_t slice_rows;
+    bool roi_enable;
+    int32_t roi_max_regions;
+    int32_t roi_obj_qp;
+    int32_t roi_bg_qp;
     MppEncSeiMode sei_mode;
     MppEncHeaderMode header_mode;
 };
 
 using PacketCallback = std::function<void(uint8_t*, uint32_t, uint64_t, void*)>;
 
+//ROI区域(像素坐标)
+struct EncRoiRect {
+    int x;
+    int y;
+    int w;
+    int h;
+};
+
+//外部DMA缓冲编码完成后的归还回调
+using BufferReleaseCallback = std::function<void()>;
+
+//编码缓冲槽状态
+enum eEncBufState
+{
+    ENC_BUF_IDLE = 0x00,        //空闲, 可写入
+    ENC_BUF_ENCODING = 0x01,    //已送入编码器, 等待输出
+};
+
+//编码缓冲槽: 一帧输入缓冲 + 一个输出码流缓冲
+struct EncBufSlot {
+    MppBuffer frame_buf = nullptr;      //内部输入缓冲
+    MppBuffer pkt_buf = nullptr;        //输出码流缓冲
+    MppBuffer ext_buf = nullptr;        //外部导入的DMA缓冲(零拷贝)
+    BufferReleaseCallback release;      //外部缓冲归还回调
+    eEncBufState state = ENC_BUF_IDLE;
+    int64_t put_time_us = 0;            //送入编码器的时间, 用于统计编码延迟
+    uint64_t tag = 0;                   //调用方的帧标识, 输出时由匹配到的槽取回
+    uint64_t put_seq = 0;               //送入序号, 作为 MPP 帧 pts 带到输出包(含每个slice), 用于匹配槽
+    MppEncROICfg roi_cfg = {0, nullptr};    //本帧ROI配置, 编码完成前必须保持有效
+    std::vector<MppEncROIRegion> roi_regions;
+};
+
 
 class RKEncodeVideo
 {
@@ -95,12 +160,58 @@ public:
      * @return  0: sucess ** **/
     int Initencoder(InputInfo& encoderinfo, int srcindex, PacketCallback  callback, void* userdata);
 
+    /** * @brief  获取编码流类型
+     * @return  eStreamType ** **/
+    short GetStreamType() const { return m_stream_info.StreamType; }
+
+    /** * @brief  请求下一帧编码为IDR(线程安全, 多次请求合并为一次)
+     * @return  ** **/
+    void RequestIDR();
+
+    /** * @brief  跳过若干帧的时间戳(解码前丢帧时调用, 保持输出时间轴与源一致)
+     * @param   count  跳过的帧数
+     * @return  ** **/
+    void SkipFrames(int count) { m_frame_index += count; }
+
+    /** * @brief  运行中修改目标码率(与 WriteData 在同一线程调用), 码率未变化时不做任何事
+     * @param   bps  目标码率
+     * @return  是否生效 ** **/
+    bool SetBitrate(int bps);
+
+    /** * @brief  编码器输入/输出缓冲占用的字节数
+     * @return  ** **/
+    size_t GetBufferBytes() const {
+        return m_slots.size() * ((size_t)m_enc_info.frame_size * 2 + m_enc_info.header_size);
+    }
+
     /** * @brief  推入图片数据
      * @param   data  图片数据
      * @param   size  图片大小
      * @return  0: sucess ** **/
     int WriteData(const uint8_t *data, int size);
 
+    /** * @brief  推入图片数据及本帧ROI区域
+     * @param   data  图片数据
+     * @param   size  图片大小
+     * @param   rois  ROI区域, roi_enable 关闭时忽略
+     * @param   tag   帧标识(如 frame_seq), 输出回调中用 GetOutputTag() 取回
+     * @return  0: sucess ** **/
+    int WriteData(const uint8_t *data, int size, const std::vector<EncRoiRect>& rois, uint64_t tag = 0);
+
+    /** * @brief  推入DMA缓冲(零拷贝), 编码完成前调用方不得改写该缓冲
+     * @param   fd  dma-buf 文件描述符, 内容为与 WriteData 相同布局的图片
+     * @param   size  图片大小
+     * @param   rois  ROI区域, roi_enable 关闭时忽略
+     * @param   release  编码完成(或送入失败)后的归还回调, 可为空, 在编码线程或调用线程中执行
+     * @param   tag   帧标识, 同 WriteData
+     * @return  0: sucess, 2: 导入失败(调用方可改用 WriteData 拷贝) ** **/
+    int WriteDmaData(int fd, int size, const std::vector<EncRoiRect>& rois, BufferReleaseCallback release,
+                     uint64_t tag = 0);
+
+    /** * @brief  当前输出包对应输入帧的 tag, 只在输出回调中调用
+     * @return  ** **/
+    uint64_t GetOutputTag() const { return m_output_tag; }
+
       /** * @brief  结束编码
      * @param   
      * @return  ** **/  
@@ -116,6 +227,10 @@ private:
      * @return ** **/
     bool SetMppEncCfg(void);
 
+    /** * @brief  按码率控制模式设置码率上下限
+     * @return  ** **/
+    void SetupRcBitrate();
+
     /** * @brief  初始化Mpp资源
      * @return ** **/
     void InitMppEnc();
@@ -157,6 +272,36 @@ private:
      * @return  ** **/
     int GetHeaderSize(MppFrameFormat frame_format, uint32_t width, uint32_t height);
 
+    /** * @brief  获取编码块大小(h264宏块16 / h265 CTU 64)
+     * @return ** **/
+    int GetCtuSize();
+
+    /** * @brief  按编码块对齐生成缓冲槽的ROI配置
+     * @param   index  槽序号
+     * @param   rois  ROI区域
+     * @return ** **/
+    void SetupSlotRoi(int index, const std::vector<EncRoiRect>& rois);
+
+    /** * @brief  获取空闲缓冲槽, 缓冲环满时等待编码输出
+     * @return  槽序号, -1: 超时或已停止 ** **/
+    int AcquireSlot();
+
+    /** * @brief  将缓冲槽送入编码器
+     * @param   index  槽序号
+     * @param   buffer  输入帧缓冲
+     * @return  0: sucess ** **/
+    int PutSlot(int index, MppBuffer buffer);
+
+    /** * @brief  归还缓冲槽(编码完成或送入失败)
+     * @param   index  槽序号
+     * @return ** **/
+    void ReleaseSlot(int index);
+
+    /** * @brief  按输出包找到对应的在途槽: 帧模式比较输出缓冲, 低延迟模式比较 pts 中的送入序号
+     * @param   packet  输出包
+     * @return  在 m_inflight 中的位置, -1: 未找到 ** **/
+    int FindInflight(MppPacket packet);
+
     /** * @brief  释放资源
      * @return ** **/
     void Release();
@@ -164,23 +309,35 @@ private:
       /** * @brief  封装为其他格式
      * @param   data   编码后的数据
      * @param   size   数据大小 
+     * @param   eoi    是否为一帧的最后一个slice, 同一帧的slice使用相同的pts
      * @return  ** **/
-    void Packaging(uint8_t* data,uint32_t size);
+    void Packaging(uint8_t* data,uint32_t size, bool eoi);
+
+    /** * @brief  统计编码延迟(送入 -> 首个slice / 整帧输出)
+     * @param   put_time_us   送入时间
+     * @param   eoi   是否整帧输出完毕
+     * @return  ** **/
+    void UpdateLatency(int64_t put_time_us, bool eoi);
 
 private:
     MppCtx m_mppctx = nullptr;
     MppApi* m_mppapi = nullptr;
     MppEncCfg m_mppcfg = nullptr;
     MppBufferGroup m_grpbuffer = nullptr;
-    MppBuffer m_frame_buf = nullptr;
-    MppBuffer m_pkt_buf = nullptr;
-    MppFrame m_frame = nullptr;
+
+    std::vector<EncBufSlot> m_slots;    //编码缓冲环
+    std::deque<int> m_inflight;         //已送入编码器的槽(按送入顺序)
+    uint64_t m_put_seq = 0;             //最近一次送入的序号
+    std::mutex m_slot_mutex;
+    std::condition_variable m_slot_cv;
+    int m_next_slot = 0;                //下一个尝试的槽
 
     FrameInfo m_frame_info;     //frame 信息
     StreamInfo m_stream_info;   //视频流信息
     MppEncInfo m_enc_info;      //编码格式数据
+    int m_failed_bps = 0;       //设置失败的码率, 不再重试
 
-    bool m_is_running = false;  //是否编码
+    std::atomic<bool> m_is_running{false};  //是否编码
     bool m_is_init = false;
     std::thread m_recv_thread;  //接收编码结果线程
 
@@ -188,8 +345,17 @@ private:
 
     void* m_userdata = nullptr;
 
-    int m_put_num = 0;              //接收到的编码帧数量
-    int m_encode_num = 0;           //完成编码帧数量
+    std::atomic<int> m_put_num{0};      //接收到的编码帧数量
+    std::atomic<int> m_encode_num{0};   //完成编码帧数量
     int m_srcindex = 0;            //视频流编号
-    int m_frame_index=0;        //帧序号
+    std::atomic<int> m_frame_index{0}; //帧序号
+    uint64_t m_output_tag = 0;      //当前输出包的 tag, 只在接收线程中读写
+
+    bool m_first_slice = true;      //下一个包是否为一帧的首个slice
+    int64_t m_first_slice_us = 0;   //首个slice延迟累计
+    int64_t m_full_frame_us = 0;    //整帧延迟累计
+    int m_latency_frames = 0;       //延迟统计帧数
+
+    std::atomic<bool> m_idr_request{false};     //待处理的IDR请求
+    std::atomic<int64_t> m_idr_request_us{0};   //首个未完成IDR请求的时间
 };
\ No newline at end of file
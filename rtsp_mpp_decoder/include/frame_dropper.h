@@ -0,0 +1,51 @@
+#ifndef FRAME_DROPPER_H
+#define FRAME_DROPPER_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include "rknn_type.h"
+#include "nal_parser.h"
+
+// 丢帧统计(按原因)
+struct drop_stats_t {
+    uint64_t total = 0;         // 送入的压缩帧
+    uint64_t non_ref = 0;       // 非参考帧/最高时域层
+    uint64_t key_only = 0;      // 只解码关键帧时丢弃的帧
+    uint64_t wait_key = 0;      // 恢复前等待关键帧时丢弃的帧
+};
+
+// 解码前过载丢帧
+// 解码回调上报每帧是否因推理线程全忙走直通路径, 用其滑动平均作为负载,
+// 过载时在送入MPP前按NAL头丢弃可丢弃的帧, 避免解码后再丢.
+class FrameDropper {
+public:
+    explicit FrameDropper(const OverloadConfig& config) : m_config(config) {}
+
+    // 解码回调中上报一帧的负载情况
+    void report_load(bool busy);
+
+    // 判断一个压缩帧是否在送入解码器前丢弃(拉流线程调用)
+    bool should_drop(eNalCodec codec, const uint8_t *data, size_t size);
+
+    drop_stats_t get_stats() const;
+    eDropMode get_level() const { return (eDropMode)m_active_level; }
+
+private:
+    int target_level() const;
+
+private:
+    OverloadConfig m_config;
+    std::atomic<float> m_load{0.0f};
+    std::atomic<int> m_load_level{DROP_OFF};
+    int m_active_level = DROP_OFF;
+    bool m_waiting_key = false;
+    int m_max_temporal_id = 0;
+
+    std::atomic<uint64_t> m_total{0};
+    std::atomic<uint64_t> m_non_ref{0};
+    std::atomic<uint64_t> m_key_only{0};
+    std::atomic<uint64_t> m_wait_key{0};
+};
+
+#endif
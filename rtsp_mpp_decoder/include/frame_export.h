@@ -0,0 +1,91 @@
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+#include "frame_export_proto.h"
+#include "dma_pool.h"
+#include "rknn_type.h"
+
+struct frame_export_stats_t {
+    uint64_t exported = 0;      // 导出的帧
+    uint64_t delivered = 0;     // 发给客户端的帧(每个客户端计一次)
+    uint64_t dropped = 0;       // 因客户端租约满或发送缓冲满丢弃(每个客户端计一次)
+    uint64_t no_buffer = 0;     // 没有空闲导出缓冲而整帧丢弃
+    uint64_t leased = 0;        // 当前被客户端租用的帧数(各客户端之和)
+};
+
+/**
+ * 解码帧导出服务: 解码帧拷贝到DMA池缓冲后, 通过 Unix 套接字把 dma-buf fd 发给本机其他进程
+ * publish 只在解码回调线程调用, 发送均为非阻塞, 慢客户端只会被丢帧
+ */
+class FrameExporter {
+public:
+    FrameExporter() = default;
+    ~FrameExporter();
+
+    FrameExporter(const FrameExporter&) = delete;
+    FrameExporter& operator=(const FrameExporter&) = delete;
+
+    int initialize(const FrameExportConfig& config);
+    void release();
+
+    bool has_consumers() const { return m_consumer_count.load() > 0; }
+    int consumer_count() const { return m_consumer_count.load(); }
+
+    // 导出一帧 NV12, 没有客户端时直接返回
+    void publish(const void *data, int width, int height, int hor_stride, int ver_stride,
+                 uint64_t frame_seq, int64_t pts);
+
+    frame_export_stats_t get_stats();
+
+private:
+    struct export_buffer_t {
+        dma_block_t block;
+        uint32_t generation = 0;
+        int refs = 0;               // 持有租约的客户端数(发布期间写端也持有一次)
+    };
+
+    struct consumer_t {
+        int fd = -1;
+        std::vector<uint32_t> sent_generation;  // 已发送的缓冲 generation, 0: 未发送
+        std::vector<uint8_t> leased;            // 是否持有该缓冲的租约
+        int leases = 0;
+        uint64_t delivered = 0;
+        uint64_t dropped = 0;
+    };
+
+    void io_func();
+    void accept_consumer();
+    void handle_consumer(consumer_t& consumer);
+    void drop_consumer_locked(consumer_t& consumer);
+    int pick_buffer_locked(size_t size);
+    bool send_buffer(consumer_t& consumer, int id);
+
+private:
+    FrameExportConfig m_config;
+    std::atomic<bool> m_is_running{false};
+    std::atomic<int> m_consumer_count{0};
+
+    int m_listen_fd = -1;
+    int m_wake_fd[2] = {-1, -1};
+    std::thread m_io_thread;
+
+    int m_desc_fd = -1;             // 描述符表 memfd
+    size_t m_desc_map_size = 0;
+    frame_export_header_t *m_header = nullptr;
+    frame_export_desc_t *m_descs = nullptr;
+
+    std::mutex m_mutex;             // 保护缓冲和客户端状态
+    std::vector<export_buffer_t> m_buffers;
+    std::vector<consumer_t> m_consumers;
+    int m_next_buffer = 0;
+    frame_export_stats_t m_stats;
+};
+
+#endif
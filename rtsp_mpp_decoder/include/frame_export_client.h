@@ -0,0 +1,52 @@
+#ifndef FRAME_EXPORT_CLIENT_H
+#define FRAME_EXPORT_CLIENT_H
+
+/*
+ * 解码帧导出 C 客户端库
+ *
+ *   frame_export_client_t *c = frame_export_connect("/tmp/rknn_frames.sock");
+ *   frame_export_frame_t frame;
+ *   while (frame_export_next(c, &frame, 1000) >= 0) {
+ *       ... 读取 frame.data(NV12, frame.desc.hor_stride x frame.desc.ver_stride) 或把 frame.fd 交给 RGA/NPU ...
+ *       frame_export_release(c, &frame);
+ *   }
+ *   frame_export_close(c);
+ *
+ * 持有的帧数达到服务端的租约上限后, 新帧会被服务端丢弃, 所以用完要尽快 release.
+ * fd 由库持有, 需要在 release 之后继续使用时自行 dup.
+ */
+
+#include <stdint.h>
+#include "frame_export_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct frame_export_client frame_export_client_t;
+
+typedef struct {
+    uint32_t buffer_id;
+    int fd;                     /* dma-buf(或 memfd) */
+    const void *data;           /* 只读映射 */
+    frame_export_desc_t desc;
+} frame_export_frame_t;
+
+/* 连接并完成握手, 失败返回 NULL */
+frame_export_client_t *frame_export_connect(const char *socket_path);
+void frame_export_close(frame_export_client_t *client);
+
+/* 等待下一帧: 1 收到, 0 超时, -1 连接断开; timeout_ms < 0 一直等待 */
+int frame_export_next(frame_export_client_t *client, frame_export_frame_t *frame, int timeout_ms);
+
+/* 归还租约 */
+int frame_export_release(frame_export_client_t *client, const frame_export_frame_t *frame);
+
+/* 套接字 fd, 用于接入调用方自己的 poll/epoll 循环 */
+int frame_export_socket(const frame_export_client_t *client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
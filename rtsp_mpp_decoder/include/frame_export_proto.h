@@ -0,0 +1,65 @@
+#ifndef FRAME_EXPORT_PROTO_H
+#define FRAME_EXPORT_PROTO_H
+
+#include <stdint.h>
+
+/*
+ * 解码帧导出协议(Unix SOCK_SEQPACKET), 服务端(本程序)与 C 客户端库共用
+ *
+ * 连接后服务端先发 HELLO, 附带描述符表的只读 memfd. 描述符表:
+ *   [header 64字节][desc 0][desc 1]...[desc max_buffers-1]
+ * 每个导出缓冲对应一个描述符, 缓冲被任何消费者租用期间服务端不会改写该缓冲和描述符,
+ * 所以客户端收到 FRAME 后直接读 desc[buffer_id] 即可, 无需加锁.
+ *
+ * 缓冲首次发给某个客户端(或重新分配, generation 变化)时先发 BUFFER, 附带 dma-buf fd;
+ * 之后每帧只发 FRAME. 客户端用完后发 RELEASE 归还租约, 断开连接时全部租约自动归还.
+ * 客户端持有的租约达到上限或套接字发送缓冲满时, 服务端对该客户端丢帧, 不影响其他客户端和主流程.
+ */
+
+#define FRAME_EXPORT_MAGIC          0x58455246u  /* "FREX" */
+#define FRAME_EXPORT_VERSION        1
+#define FRAME_EXPORT_HEADER_SIZE    64
+
+/* NV12 fourcc */
+#define FRAME_EXPORT_FMT_NV12       0x3231564eu
+
+enum {
+    FRAME_EXPORT_MSG_HELLO = 1,     /* s->c, fd: 描述符表 memfd, buffer_id 字段为 max_buffers */
+    FRAME_EXPORT_MSG_BUFFER,        /* s->c, fd: dma-buf */
+    FRAME_EXPORT_MSG_FRAME,         /* s->c, 新帧就绪 */
+    FRAME_EXPORT_MSG_RELEASE,       /* c->s, 归还租约 */
+};
+
+typedef struct {
+    uint32_t type;
+    uint32_t buffer_id;
+    uint32_t generation;
+    uint32_t reserved;
+    uint64_t frame_seq;
+    uint64_t size;          /* BUFFER: 缓冲容量, HELLO: 描述符表大小 */
+} frame_export_msg_t;
+
+typedef struct {
+    uint32_t generation;    /* 缓冲重新分配时递增 */
+    uint32_t format;        /* FRAME_EXPORT_FMT_* */
+    uint32_t width;
+    uint32_t height;
+    uint32_t hor_stride;
+    uint32_t ver_stride;
+    uint64_t size;          /* 帧数据字节数 */
+    uint64_t frame_seq;     /* 与检测结果的 frame_seq 一致 */
+    int64_t pts;            /* 源码流 pts(ms) */
+    int64_t timestamp_us;   /* 导出时间, CLOCK_MONOTONIC */
+    uint8_t reserved[8];
+} frame_export_desc_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t max_buffers;
+    uint32_t desc_size;
+    uint64_t last_frame_seq;    /* 最近导出的帧 */
+    uint8_t reserved[40];
+} frame_export_header_t;
+
+#endif
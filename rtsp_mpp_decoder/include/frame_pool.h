@@ -0,0 +1,75 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+// 帧缓冲使用的页类型
+enum eFramePageMode {
+    FRAME_PAGE_AUTO = 0,    // 先尝试显式大页, 失败用透明大页
+    FRAME_PAGE_HUGETLB,     // 只用显式大页(hugetlbfs 预留), 失败退回普通页
+    FRAME_PAGE_THP,         // 透明大页(madvise)
+    FRAME_PAGE_NORMAL,      // 普通页
+};
+
+// CPU侧帧缓冲池(code_frame_t 使用)
+// 缓冲按2MB对齐分配并预先触页, 释放后留在池中复用, 避免每帧约3MB的 malloc/free
+// 反复缺页以及小页带来的TLB压力.
+class FramePool {
+public:
+    static FramePool& getInstance() {
+        static FramePool instance;
+        return instance;
+    }
+
+    // max_free_frames: 每个尺寸保留的空闲缓冲数
+    void configure(eFramePageMode mode, int max_free_frames);
+
+    // 取一块不小于 size 的缓冲, capacity 返回实际容量(归还时使用)
+    uint8_t *acquire(size_t size, size_t *capacity);
+    void release(uint8_t *buf, size_t capacity);
+
+    // 输出缺页/TLB缺失统计(相对上次调用的增量)
+    void report();
+
+    // 已映射的总字节数(含池中空闲)
+    size_t get_total_bytes() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_total_bytes;
+    }
+    // 归还全部空闲缓冲, max_free_frames 为之后保留的空闲缓冲数
+    void trim(int max_free_frames);
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+private:
+    FramePool();
+    ~FramePool();
+
+    uint8_t *map_buffer(size_t capacity, int *page_kind);
+    void open_tlb_counter();
+
+private:
+    std::mutex m_mutex;
+    std::map<size_t, std::vector<uint8_t *>> m_free_lists;
+    eFramePageMode m_mode = FRAME_PAGE_AUTO;
+    int m_max_free_frames = 8;
+
+    size_t m_total_bytes = 0;
+    uint64_t m_allocs = 0;
+    uint64_t m_reuses = 0;
+    uint64_t m_hugetlb = 0;     // 显式大页缓冲数
+    uint64_t m_thp = 0;         // 透明大页缓冲数
+    uint64_t m_normal = 0;      // 普通页缓冲数
+
+    int m_tlb_fd = -1;          // dTLB 读缺失计数(perf_event), 不可用时为 -1
+    uint64_t m_last_tlb = 0;
+    long m_last_minflt = 0;
+    long m_last_majflt = 0;
+};
+
+#endif
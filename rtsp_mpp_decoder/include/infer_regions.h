@@ -0,0 +1,65 @@
+#ifndef INFER_REGIONS_H
+#define INFER_REGIONS_H
+
+#include <mutex>
+#include <vector>
+
+#include "rknn_type.h"
+#include "postprocess.h"
+
+// 一次 NPU 推理的输入: 源帧内的一块区域, 缩放填充到模型输入
+struct infer_view_t {
+    int id = 0;         // 视图在当前规划中的序号
+    int x = 0;          // 源帧坐标, 按2对齐(YUV420SP 裁剪要求)
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    letterbox_t letter_box;
+};
+
+// 推理视图规划
+// 高分辨率画面整帧缩到模型输入后远处小目标会丢失, 可以额外对重叠平铺块/指定区域做推理,
+// 每个视图有独立的推理间隔. 各视图结果映射回帧坐标后做跨视图去重; 本帧未推理的视图沿用
+// 最近一次的结果. 所有推理实例共用一个规划器.
+class InferRegionPlanner {
+public:
+    static InferRegionPlanner& getInstance() {
+        static InferRegionPlanner instance;
+        return instance;
+    }
+
+    void configure(const InferRegionsConfig& config);
+
+    // 选出本帧要推理的视图, 可能为空(全部沿用上次结果)
+    void plan(int width, int height, uint64_t frame_seq, int infer_stride, std::vector<infer_view_t>& views);
+
+    // results[i] 为 views[i] 的结果(已是帧坐标), 合并后写入 out
+    void merge(uint64_t frame_seq, int width, int height, const std::vector<infer_view_t>& views,
+               const std::vector<object_detect_result_list>& results, float nms_thresh,
+               object_detect_result_list *out);
+
+    InferRegionPlanner(const InferRegionPlanner&) = delete;
+    InferRegionPlanner& operator=(const InferRegionPlanner&) = delete;
+
+private:
+    InferRegionPlanner() = default;
+
+    struct view_state_t {
+        infer_view_t view;
+        int stride = 1;
+        uint64_t result_seq = 0;
+        bool has_result = false;
+        std::vector<object_detect_result> results;
+    };
+
+    void layout(int width, int height);
+
+private:
+    std::mutex m_mutex;
+    InferRegionsConfig m_config;
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<view_state_t> m_views;
+};
+
+#endif
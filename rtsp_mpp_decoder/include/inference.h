@@ -1,33 +1,74 @@
 #ifndef INFERENCE_H
 #define INFERENCE_H
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <functional>
+#include <vector>
 
 #include "label_render.h"
 #include "rknn_api.h"
 #include "rknn_type.h"
 #include "dma_alloc.h"
 #include "postprocess.h"
+#include "infer_regions.h"
 
 // 编码回调函数类型
 using EncodeCallback = std::function<void(std::shared_ptr<code_frame_t>)>;
 
+// 每个推理实例内部的流水线: 前处理(RGA letterbox) -> NPU -> 后处理/叠加/输出
+// 三个阶段各一个线程, 帧N+1前处理、帧N推理、帧N-1后处理同时进行
+#define INFERENCE_PIPELINE_MAX_DEPTH 4
+
+enum eInferStage {
+    INFER_STAGE_PRE = 0,
+    INFER_STAGE_NPU,
+    INFER_STAGE_POST,
+    INFER_STAGE_NUM     // 槽位空闲
+};
+
+// 流水线中的一帧, state 为下一个要处理它的阶段
+// 一帧可能包含多个推理视图(整帧/平铺块/区域), 每个视图一份模型输入和一组输出
+struct infer_slot_t {
+    int state = INFER_STAGE_NUM;
+    bool failed = false;
+    dma_data_t src_frame;           // 源帧, 后处理在其上叠加并拷出
+    std::shared_ptr<const RuntimeConfig> rt; // 整帧使用同一份配置快照
+    std::vector<infer_view_t> views;                        // 本帧推理的视图
+    std::vector<std::unique_ptr<dma_data_t>> view_inputs;   // 模型输入, 前处理写/NPU读
+    std::vector<im_rect> view_input_rects;                  // 各模型输入上次写入的图像区域, 区域外已是底色
+    std::vector<std::vector<rknn_output>> view_outputs;     // 指向 output_bufs 中本视图的部分, 后处理读
+    std::vector<std::vector<uint8_t>> output_bufs;          // 按推理批次预分配, 第 r 批的输出 j 为 [r * n_output + j], NPU写
+};
+
 class Inference {
 public:
     ~Inference() {
         release();
     }
     int initialize(const char *model_path, bool info);
+    // 使用已读入内存的模型, 多个实例共享同一份数据并发初始化
+    int initialize(const std::vector<unsigned char>& model_data, bool info);
+    static bool read_model(const char *model_path, std::vector<unsigned char>& model_data);
+
+    // 用全零输入跑 runs 次, 接收实时帧前消除首次推理的额外耗时
+    int warmup(int runs);
+
+    // 流水线深度(同时在处理中的帧数), 需在 initialize 之前设置
+    void set_pipeline_depth(int depth);
     
-    // 获取源帧缓冲区的引用（用于外部直接复制）
-    dma_data_t& get_src_frame() { return src_frame; }
+    // 获取下一个空闲槽位的源帧缓冲区（用于外部直接复制）
+    dma_data_t& get_src_frame() { return m_slots[m_fill_idx].src_frame; }
     
-    // 触发推理（数据已经复制到 src_frame）
+    // 触发推理（数据已经复制到 src_frame）, 帧按触发顺序输出
     void trigger_inference(uint64_t frame_seq);
     
     void release();
-    bool is_busy() { return m_is_busy.load(); }
+    // 模型类别数, initialize 之后有效
+    int get_num_classes() const { return m_model_desc.num_classes; }
+
+    // 没有空闲槽位时为忙
+    bool is_busy() { return m_free_slots.load() == 0; }
     
     void set_encode_callback(EncodeCallback callback) {
         m_encode_callback = callback;
@@ -38,35 +79,55 @@ public:
     Inference& operator=(const Inference&) = delete;
 
 private:
-    void inference_model();
+    void stage_loop(int stage);
+    void preprocess(infer_slot_t& slot);
+    void run_npu(infer_slot_t& slot);
+    void postprocess(infer_slot_t& slot);
+    int ensure_view_inputs(infer_slot_t& slot, size_t count);
+    void ensure_view_outputs(infer_slot_t& slot, size_t count);
+    void report_cpu_access(bool cached);
+    void report_pipeline();
 
 private:
     bool m_is_init = false;
     bool m_is_running = false;
-    std::atomic<bool> m_is_busy{false};  // 这个原子变量保证了访问顺序
 
-    std::thread m_inferenceThread;
+    std::thread m_stage_threads[INFER_STAGE_NUM];
 
-    dma_data_t resize_img;
-    dma_data_t input_img;
-    dma_data_t rgba_data;
-    dma_data_t src_frame; // 源帧缓冲区（对外暴露）
+    // 槽位按环形顺序依次经过各阶段, 输出顺序与触发顺序一致
+    infer_slot_t m_slots[INFERENCE_PIPELINE_MAX_DEPTH];
+    int m_depth = 3;
+    int m_fill_idx = 0;                 // 只由调用 trigger_inference 的线程访问
+    std::atomic<int> m_free_slots{0};   // 这个原子变量保证了槽位的访问顺序
 
-    rga_buffer_t src;
-    rga_buffer_t dst;
-    rga_buffer_t resize;
-    rga_buffer_t rgba;
+    dma_data_t rgba_data;  // 后处理独占
 
     rknn_app_context_t app_ctx;
-
-    uint64_t m_current_frame_seq = 0;
-    bool m_has_frame = false;
+    model_desc_t m_model_desc;          // 模型输出描述, 初始化后只读
+    int m_batch = 1;                    // 模型的批大小, 大于1时多个视图合并为一次推理
+    int m_input_size = 0;               // 单个视图的模型输入字节数
+    std::vector<uint8_t> m_batch_input; // NPU 阶段独占, 拼接一批视图的输入
+    std::vector<object_detect_result_list> m_view_results; // 后处理独占
+    class_filter_t m_class_filter;      // 后处理独占, 运行时配置快照变化时重新换算
+    std::shared_ptr<const RuntimeConfig> m_filter_rt; // 持有快照, 避免释放后地址被新快照复用
     
-    std::mutex m_signal_mutex; // 只保护信号变量
-    std::condition_variable m_frame_cv;
+    std::mutex m_stage_mutex; // 保护槽位状态
+    std::condition_variable m_stage_cv;
     
     // 编码回调
     EncodeCallback m_encode_callback;
+
+    // CPU 访问 DMA 缓冲的耗时统计
+    int m_access_frames = 0;
+    uint64_t m_copy_bytes = 0;
+    int64_t m_copy_us = 0;
+    int64_t m_blend_us = 0;
+
+    // 各阶段占用率统计
+    std::atomic<int64_t> m_stage_busy_us[INFER_STAGE_NUM] = {};
+    int m_pipeline_frames = 0;
+    int64_t m_pipeline_begin_us = 0;
+    int64_t m_post_us = 0;              // 检测框解码耗时, 后处理独占
 };
 
 #endif
@@ -39,7 +39,7 @@ public:
     YUVLabelRenderer(const YUVLabelRenderer&) = delete;
     YUVLabelRenderer& operator=(const YUVLabelRenderer&) = delete;
 
-    bool initialize(char* labels[OBJ_CLASS_NUM], const Config& config = Config());
+    bool initialize(char* labels[OBJ_CLASS_MAX], const Config& config = Config());
     bool updateConfig(const Config& new_config);
     bool setFontSize(int size);
     bool setFontPath(const std::string& path);
@@ -57,6 +57,10 @@ public:
                       int class_id, float confidence, int box_x, int box_y,
                       bool is_nv21 = false);
     
+    // CPU 画检测框边线, 用于不经过推理线程 RGA 叠加的帧
+    void drawBox(uint8_t* yuv420sp, int frame_width, int frame_height,
+                 int x1, int y1, int x2, int y2, bool is_nv21 = false);
+    
     void drawFPS(uint8_t* yuv420sp, int frame_width, int frame_height, 
                 int x, int y, bool is_nv21 = false);
     
@@ -80,8 +84,8 @@ private:
 
     std::atomic<bool> initialized_;
     Config config_;
-    char* labels_[OBJ_CLASS_NUM];
-    TextImageRGBA label_images_[OBJ_CLASS_NUM];
+    char* labels_[OBJ_CLASS_MAX];
+    TextImageRGBA label_images_[OBJ_CLASS_MAX];
     FT_Library ft_library_;
     FT_Face ft_face_;
     
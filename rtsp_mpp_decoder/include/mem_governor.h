@@ -0,0 +1,82 @@
+#ifndef MEM_GOVERNOR_H
+#define MEM_GOVERNOR_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+#include "rknn_type.h"
+
+// 内存压力等级
+enum eMemPressure {
+    MEM_PRESSURE_NORMAL = 0,
+    MEM_PRESSURE_HIGH,      // 收缩缓冲池, 降低队列深度, 拒绝新增输出
+    MEM_PRESSURE_CRITICAL,  // 释放全部空闲缓冲, 队列降到最小
+};
+
+// 进程级内存预算
+// 各组件注册用量查询和压力回调, 后台线程周期性汇总用量并结合系统 MemAvailable
+// 计算压力等级, 等级变化时通知各组件; 新增输出前用 admit 做准入检查.
+class MemoryGovernor {
+public:
+    using UsageProbe = std::function<size_t()>;
+    using PressureHandler = std::function<void(eMemPressure)>;
+
+    static MemoryGovernor& getInstance() {
+        static MemoryGovernor instance;
+        return instance;
+    }
+
+    void configure(const MemoryConfig& config);
+
+    // probe 可为空(只接收压力通知), handler 可为空(只参与统计)
+    void register_component(const std::string& name, UsageProbe probe, PressureHandler handler = nullptr);
+    void unregister_component(const std::string& name);
+
+    // 新增 bytes 后是否仍在预算内, 压力非 NORMAL 时一律拒绝
+    bool admit(const std::string& name, size_t bytes);
+
+    eMemPressure get_pressure() const { return (eMemPressure)m_pressure.load(); }
+
+    void start();
+    void stop();
+
+    // 输出按组件的内存分布
+    void dump();
+
+    MemoryGovernor(const MemoryGovernor&) = delete;
+    MemoryGovernor& operator=(const MemoryGovernor&) = delete;
+
+private:
+    MemoryGovernor() = default;
+    ~MemoryGovernor() {
+        stop();
+    }
+
+    struct component_t {
+        std::string name;
+        UsageProbe probe;
+        PressureHandler handler;
+    };
+
+    void poll_func();
+    size_t total_usage_locked();
+    eMemPressure calc_pressure(size_t used, size_t available);
+
+private:
+    MemoryConfig m_config;
+    std::mutex m_mutex;
+    std::vector<component_t> m_components;
+    std::atomic<int> m_pressure{MEM_PRESSURE_NORMAL};
+
+    std::thread m_thread;
+    std::mutex m_thread_mutex;
+    std::condition_variable m_thread_cv;
+    bool m_running = false;
+};
+
+#endif
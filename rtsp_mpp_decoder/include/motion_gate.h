@@ -0,0 +1,62 @@
+#ifndef MOTION_GATE_H
+#define MOTION_GATE_H
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+#include "rknn_type.h"
+
+enum eGateResult {
+    GATE_INFER = 0,     // 画面有变化(或到达最大跳过帧数), 需要推理
+    GATE_STATIC,        // 画面静止, 沿用上次结果
+    GATE_DUPLICATE      // 与上一帧完全相同(画面冻结)
+};
+
+// 门控统计
+struct motion_gate_stats_t {
+    uint64_t analysed = 0;      // 经过门控的帧
+    uint64_t skipped_static = 0;
+    uint64_t skipped_duplicate = 0;
+    uint64_t forced = 0;        // 到达最大跳过帧数强制推理
+    double avg_cost_us = 0;     // 每帧门控平均耗时
+};
+
+// 推理前的运动/重复帧门控
+// Y 平面按 1/4 x 1/4 抽样(水平4像素取平均, 每4行取一行), 与上一次推理的帧按块比较 SAD,
+// 变化块足够多才送推理; 抽样行整行做哈希, 与上一帧相同视为重复帧. 只在解码回调线程调用.
+class MotionGate {
+public:
+    explicit MotionGate(const MotionGateConfig& config);
+
+    // 只做判断, 返回 GATE_INFER 时不更新参考帧
+    eGateResult check(const uint8_t *y_plane, int width, int height, int stride);
+    // 上一次 check 返回 GATE_INFER 的帧确实送入推理后调用, 以该帧作为新的参考帧;
+    // 推理线程全忙未送入时不调用, 下一帧仍与旧参考帧比较
+    void commit_reference();
+
+    motion_gate_stats_t get_stats() const;
+
+private:
+    void decimate(const uint8_t *y_plane, int width, int height, int stride);
+    int count_changed_blocks() const;
+
+private:
+    MotionGateConfig m_config;
+    int m_width = 0;        // 抽样图尺寸
+    int m_height = 0;
+    std::vector<uint8_t> m_current;
+    std::vector<uint8_t> m_reference;   // 上一次推理的帧
+    uint64_t m_hash = 0;
+    uint64_t m_last_hash = 0;
+    bool m_has_reference = false;
+    int m_skipped = 0;
+
+    std::atomic<uint64_t> m_analysed{0};
+    std::atomic<uint64_t> m_static{0};
+    std::atomic<uint64_t> m_duplicate{0};
+    std::atomic<uint64_t> m_forced{0};
+    std::atomic<int64_t> m_cost_us{0};
+};
+
+#endif
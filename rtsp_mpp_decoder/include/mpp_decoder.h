@@ -40,9 +40,21 @@ public:
     ~MppDecoder();
     int Init(MppCodingType video_type, int fps, void* userdata);
     int SetCallback(MppDecoderFrameCallback callback);
-    int Decode(uint8_t* pkt_data, int pkt_size, int pkt_eos);
+    int Decode(uint8_t* pkt_data, int pkt_size, int pkt_eos, int64_t pts = 0);
+    // 当前回调中输出帧的 pts(mpp_frame_get_pts, 按输出顺序), 仅在解码回调内有效
+    int64_t GetFramePts() const { return frame_pts; }
     int Reset();
+    /**
+     * 设置帧缓冲数量, buffer_count 为0时按码流等级的DPB大小加 extra_buffers 自动计算,
+     * extra_buffers 为下游(解码回调拷贝)及MPP输出队列占用的帧数
+     */
+    int SetBufferConfig(int buffer_count, int extra_buffers);
+    // 帧缓冲当前占用/峰值(字节)及数量上限
+    void GetBufferUsage(size_t *usage, size_t *max_usage, int *limit);
 private:
+    void ParseStreamLevel(const uint8_t* pkt_data, int pkt_size);
+    int CalcBufferCount(RK_U32 width, RK_U32 height);
+
     // base flow context
     MpiCmd mpi_cmd      = MPP_CMD_BASE;
     MppParam mpp_param1      = NULL;
@@ -61,6 +73,12 @@ private:
     unsigned long last_frame_time_ms = 0;
 
     void* userdata = NULL;
+
+    int buffer_count    = 0;    // 配置的帧缓冲数, 0: 自动
+    int extra_buffers   = 3;    // DPB之外额外的帧缓冲数
+    int level_idc       = -1;   // 码流等级(从SPS解析), -1: 未知
+    int buffer_limit    = 0;    // 当前生效的帧缓冲数
+    int64_t frame_pts   = 0;    // 当前输出帧的 pts
 };
 
 size_t mpp_frame_get_buf_size(const MppFrame s);
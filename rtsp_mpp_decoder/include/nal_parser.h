@@ -0,0 +1,101 @@
+#ifndef NAL_PARSER_H
+#define NAL_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum eNalCodec {
+    NAL_CODEC_H264 = 0,
+    NAL_CODEC_H265,
+};
+
+// 一个NAL单元, data 指向原始码流(不含起始码), 不做拷贝
+struct nal_unit_t {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    int type = -1;
+    bool is_vcl = false;        // 图像条带
+    bool is_keyframe = false;   // H.264 IDR / H.265 IRAP
+    bool is_idr = false;
+    bool is_param_set = false;  // VPS/SPS/PPS
+    bool is_sei = false;
+    bool is_reference = false;  // 可被其他帧参考
+    bool is_first_slice = false; // 一帧图像的第一个条带
+    int temporal_id = 0;        // H.265 时域层, H.264 固定为0
+};
+
+// 一个压缩帧(一个或多个NAL)的汇总信息
+struct nal_packet_info_t {
+    bool has_vcl = false;
+    bool is_keyframe = false;
+    bool is_reference = false;  // 任一条带可被参考
+    int temporal_id = 0;
+};
+
+// 在 [p, end) 中查找 00 00 01, 返回起始码首字节地址, 找不到返回 end
+// 按16字节块向量化跳过不含0的数据(NEON/SSE2), 其余走标量
+const uint8_t *nal_find_start_code(const uint8_t *p, const uint8_t *end);
+
+// 根据NAL头填充类型信息, nal.data/nal.size 需已设置
+void nal_classify(eNalCodec codec, nal_unit_t& nal);
+
+// 汇总一个压缩帧内所有NAL的类型信息
+nal_packet_info_t nal_inspect_packet(eNalCodec codec, const uint8_t *data, size_t size);
+
+// Annex-B 码流的零拷贝NAL迭代器
+class NalIterator {
+public:
+    NalIterator(const uint8_t *data, size_t size, eNalCodec codec);
+
+    // 取下一个NAL, 没有更多时返回 false
+    bool next(nal_unit_t& nal);
+
+private:
+    const uint8_t *m_pos;
+    const uint8_t *m_end;
+    eNalCodec m_codec;
+};
+
+// 码流统计, 不解码即可得到码率/帧率/GOP/关键帧信息
+struct nal_stream_stats_t {
+    uint64_t total_bytes = 0;
+    uint64_t total_frames = 0;
+    uint64_t total_keyframes = 0;
+    double bitrate_kbps = 0;    // 统计窗口内的码率
+    double fps = 0;             // 统计窗口内的帧率
+    int last_gop = 0;           // 最近两个关键帧之间的帧数
+    double avg_gop = 0;
+    uint64_t window_non_ref = 0; // 统计窗口内的非参考帧数
+    uint64_t window_sei = 0;
+    uint64_t window_param_sets = 0;
+};
+
+class NalStreamAnalyzer {
+public:
+    explicit NalStreamAnalyzer(eNalCodec codec) : m_codec(codec) {}
+
+    // 送入一段 Annex-B 数据(一个或多个完整NAL), pts 单位毫秒
+    void input(const uint8_t *data, size_t size, uint64_t pts);
+
+    // 计算并返回当前统计, 同时开始新的统计窗口
+    nal_stream_stats_t take_stats();
+
+    eNalCodec get_codec() const { return m_codec; }
+
+private:
+    eNalCodec m_codec;
+    nal_stream_stats_t m_stats;
+
+    uint64_t m_window_bytes = 0;
+    uint64_t m_window_frames = 0;
+    uint64_t m_window_start_pts = 0;
+    uint64_t m_last_pts = 0;
+    bool m_window_started = false;
+
+    int m_frames_since_key = 0;
+    bool m_seen_keyframe = false;
+    uint64_t m_gop_count = 0;
+    uint64_t m_gop_frames = 0;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef OUTPUT_PROFILE_H
+#define OUTPUT_PROFILE_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "rknn_type.h"
+#include "rtsp_server.h"
+
+// 一路额外输出档位: 共享已渲染的检测帧, 独立缩放/降帧/编码/推流
+class OutputProfile {
+public:
+    OutputProfile(const ProfileConfig& config, const PushServer& server);
+    ~OutputProfile() {
+        release();
+    }
+
+    // 创建推流 media
+    int initialize();
+
+    // 送入一帧已渲染的检测帧(编码线程调用), 按降帧因子决定是否编码
+    void encode_frame(const code_frame_t& frame, int src_fps);
+
+    void release();
+
+    const ProfileConfig& get_config() const { return m_config; }
+    // 编码器与缩放缓冲用量, 编码器在首帧时创建
+    size_t get_buffer_bytes() const { return m_buffer_bytes.load(); }
+
+    OutputProfile(const OutputProfile&) = delete;
+    OutputProfile& operator=(const OutputProfile&) = delete;
+
+private:
+    int init_encoder(int src_width, int src_height, int src_fps);
+    // RGA 缩放到 dst(stride 为 m_out_wstride/m_out_hstride), dst_fd 有效时按 fd 访问;
+    // 失败时关闭 RGA 并返回 false, 由调用方改用 CPU 缩放
+    bool scale_frame_rga(const code_frame_t& frame, u_char *dst, int dst_fd);
+    void scale_frame_cpu(const code_frame_t& frame, u_char *dst);
+    // 缩放到池中的DMA缓冲并零拷贝送编码, 失败返回 false 由调用方改走拷贝路径
+    bool encode_dma(const code_frame_t& frame, const std::vector<EncRoiRect>& rois, int64_t *scale_us);
+    void report_cost(int src_fps);
+
+private:
+    ProfileConfig m_config;
+    PushServer m_server_config;
+    std::unique_ptr<RtspServer> m_server;
+    std::unique_ptr<RKEncodeVideo> m_encoder;       // 只由编码线程访问
+    std::atomic<RKEncodeVideo*> m_idr_encoder{nullptr}; // 观众接入回调(ZLM线程)使用, 初始化后发布, 释放前清空
+    bool m_encoder_failed = false;
+
+    int m_out_width = 0;
+    int m_out_height = 0;
+    int m_out_wstride = 0;
+    int m_out_hstride = 0;
+    std::vector<u_char> m_scaled;   // 缩放后的 NV12 帧(拷贝路径, DMA导入不可用时才分配)
+    bool m_dma_input = true;        // 缩放输出直接以 dma-buf 交给编码器
+    std::atomic<size_t> m_buffer_bytes{0};
+
+    uint64_t m_src_frames = 0;      // 收到的源帧数
+    uint64_t m_out_frames = 0;      // 统计周期内编码帧数
+    int64_t m_scale_us = 0;         // 统计周期内缩放耗时
+    int64_t m_encode_us = 0;        // 统计周期内送编码耗时
+};
+
+#endif
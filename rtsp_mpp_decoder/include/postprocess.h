@@ -8,9 +8,12 @@
 
 #define OBJ_NAME_MAX_SIZE 64
 #define OBJ_NUMB_MAX_SIZE 128
-#define OBJ_CLASS_NUM 80
+#define OBJ_CLASS_MAX 256       // 模型类别数上限, 实际类别数由模型输出决定
+#define MODEL_BRANCH_MAX 4      // 检测头分支数上限(P3-P5 为3, 带 P2/P6 为4)
+#define MODEL_DFL_MAX 32        // DFL 分布长度上限
 #define NMS_THRESH 0.45
 #define BOX_THRESH 0.25
+#define LABEL_NALE_TXT_PATH "./model/coco_80_labels_list.txt"
 
 // class rknn_app_context_t;
 
@@ -26,9 +29,73 @@ typedef struct {
     object_detect_result results[OBJ_NUMB_MAX_SIZE];
 } object_detect_result_list;
 
-int init_post_process();
+// 启用的类别和各类别阈值, 量化模型的阈值按各输出分支的 zp/scale 预先换算, 扫描时跳过未启用类别的平面
+typedef struct {
+    int count;                              // 启用的类别数
+    int cls_ids[OBJ_CLASS_MAX];             // 启用的类别(升序)
+    float thresh[OBJ_CLASS_MAX];            // 与 cls_ids 对应的置信度阈值
+    float min_thresh;                       // 启用类别中最低的阈值, 用于 score_sum 预筛
+    int32_t qnt_thresh[MODEL_BRANCH_MAX][OBJ_CLASS_MAX];    // 各分支量化后的类别阈值
+    int32_t qnt_sum_thresh[MODEL_BRANCH_MAX];               // 各分支量化后的 score_sum 阈值
+} class_filter_t;
+
+enum eOutputQnt {
+    OUTPUT_QNT_I8 = 0,
+    OUTPUT_QNT_U8,
+    OUTPUT_FP32
+};
+
+// 一个检测头分支的输出: box [4*dfl_len, H, W], score [num_classes, H, W], 可选 score_sum [1, H, W]
+typedef struct {
+    int box_idx;
+    int score_idx;
+    int sum_idx;            // 无 score_sum 输出时为 -1
+    int grid_h;
+    int grid_w;
+    int stride;
+    int32_t box_zp;
+    float box_scale;
+    int32_t score_zp;
+    float score_scale;
+    int32_t sum_zp;
+    float sum_scale;
+} model_branch_t;
+
+struct model_desc_t;
+typedef int (*branch_kernel_t)(const model_desc_t *desc, int branch, const void *box, const void *score,
+                               const void *score_sum, const class_filter_t *filter, std::vector<float> &boxes,
+                               std::vector<float> &objProbs, std::vector<int> &classId);
+
+// 模型输出描述, 由 rknn_tensor_attr 生成; 类别数/DFL长度/分支数/布局/量化方式都取自模型,
+// 同一程序可加载任意 YOLOv8 系列模型. 常见组合使用编译期展开的解码函数, 其余走通用实现
+struct model_desc_t {
+    int model_width;
+    int model_height;
+    int num_classes;
+    int dfl_len;
+    int num_branches;
+    int output_per_branch;  // 3: box/score/score_sum, 2: box/score
+    bool nhwc;              // 输出为 NHWC(RV1106 等), 否则为按通道分平面
+    eOutputQnt qnt;
+    model_branch_t branches[MODEL_BRANCH_MAX];
+    branch_kernel_t kernel;
+    const char *kernel_name;
+};
+
+int init_post_process(const char *label_path = LABEL_NALE_TXT_PATH);
 void deinit_post_process();
 char *coco_cls_to_name(int cls_id);
-int post_process(rknn_app_context_t *app_ctx, void *outputs, letterbox_t *letter_box, float conf_threshold, float nms_threshold, object_detect_result_list *od_results);
+// 类别名文件的行数, 应与模型类别数一致
+int get_label_count();
+// 类别名或类别号, 未知时返回 -1
+int coco_name_to_cls(const char *name);
+// 按模型输出属性生成描述并选择解码函数, 不是 YOLOv8 输出结构时返回 -1
+int model_desc_init(rknn_app_context_t *app_ctx, model_desc_t *desc);
+// class_thresh 按类别号索引, 阈值 <= 0 的类别不启用; 为空时启用所有类别, 阈值均为 default_thresh.
+// 按模型输出的量化参数换算阈值
+void class_filter_init(const model_desc_t *desc, const std::vector<float>& class_thresh, float default_thresh,
+                       class_filter_t *filter);
+int post_process(const model_desc_t *desc, void *outputs, letterbox_t *letter_box, const class_filter_t *filter, float nms_threshold, object_detect_result_list *od_results);
+int post_process(const model_desc_t *desc, void *outputs, letterbox_t *letter_box, float conf_threshold, float nms_threshold, object_detect_result_list *od_results);
 
 #endif //_RKNN_YOLOV8_DEMO_POSTPROCESS_H_
\ No newline at end of file
@@ -9,6 +9,8 @@
 #include <sys/time.h>
 
 #include <map>
+#include <deque>
+#include <string>
 #include <atomic>
 #include <vector>
 #include <memory>
@@ -19,6 +21,8 @@
 #include "rknn_api.h"
 #include "RgaUtils.h"
 #include "dma_alloc.h"
+#include "dma_pool.h"
+#include "frame_pool.h"
 #include "im2d_type.h"
 
 #include "mpp_decoder.h"
@@ -28,6 +32,13 @@
 
 class Inference;
 class YUVLabelRenderer;
+class OutputProfile;
+class SnapshotService;
+class NalStreamAnalyzer;
+class FrameDropper;
+class DetectRingWriter;
+class FrameExporter;
+class MotionGate;
 
 typedef struct
 {
@@ -125,39 +136,80 @@ struct dma_data_t {
     int fd = 0;
     u_char *buf = nullptr;
     uint64_t frame_seq = 0;
+    int64_t pts = 0;                // 源码流 pts(ms)
+    dma_block_t block;              // 池中的缓冲(容量可能大于 size)
+    const char *owner = "dma_data"; // 池统计中的使用方
+    std::string heap_path;          // 分配所用的堆
+    bool cached = false;            // 带CPU缓存, CPU访问需用 cpu_access() 做缓存维护
 
     dma_data_t() = default;
     dma_data_t(const dma_data_t&) = delete;
     dma_data_t& operator=(const dma_data_t&) = delete;
 
     ~dma_data_t() {
-        if(buf != nullptr) {
-            dma_buf_free(get_size(), &fd, buf);
-        }
+        release();
     }
 
-    int make_dma(int width, int height, int format, int size) {
+    // 从进程级DMA池取缓冲, 已持有的缓冲容量足够时直接复用
+    int make_dma(int width, int height, int format, int size, const char *owner = "dma_data") {
         this->width = width;
         this->height = height;
         this->format = format;
+        if(buf != nullptr && (size_t)size <= block.size && strcmp(this->owner, owner) == 0) {
+            this->size = size;
+            return 0;
+        }
+        release();
         this->size = size;
-        int ret = dma_buf_alloc(CMA_HEAP_PATH, size, &fd, (void **)&buf);
-        if (ret < 0 || fd <= 0 || buf == NULL) {
-            printf("dma_buf_alloc failed: ret=%d, fd=%d, buf=%p\n", ret, fd, buf);
+        this->owner = owner;
+        heap_path = DmaPool::getInstance().default_heap();
+        int ret = DmaPool::getInstance().acquire(heap_path.c_str(), size, owner, &block);
+        if (ret < 0 || block.fd <= 0 || block.va == NULL) {
+            printf("dma_buf_alloc failed: ret=%d, fd=%d, buf=%p\n", ret, block.fd, block.va);
             return -1;
         }
+        cached = block.cached;
+        fd = block.fd;
+        buf = (u_char *)block.va;
         return 0;
     }
 
     void release() {
         if(buf != nullptr) {
-            dma_buf_free(get_size(), &fd, buf);
+            DmaPool::getInstance().release(heap_path.c_str(), &block, owner);
             buf = nullptr;
             fd = 0;
             size = 0;
+            cached = false;
         }
     }
 
+    // CPU访问期间的缓存维护: 构造时使CPU缓存失效(读到设备写入的数据),
+    // 析构时回写CPU缓存(设备读到CPU写入的数据). 非缓存堆上不做任何事.
+    class cpu_access_guard {
+    public:
+        explicit cpu_access_guard(int fd) : m_fd(fd) {
+            if(m_fd > 0) {
+                dma_sync_device_to_cpu(m_fd);
+            }
+        }
+        ~cpu_access_guard() {
+            if(m_fd > 0) {
+                dma_sync_cpu_to_device(m_fd);
+            }
+        }
+        cpu_access_guard(const cpu_access_guard&) = delete;
+        cpu_access_guard& operator=(const cpu_access_guard&) = delete;
+    private:
+        int m_fd;
+    };
+
+    // 用法: { auto guard = data.cpu_access(); memcpy(data.buf, ...); }
+    // guard 的作用域内不能提交 RGA/NPU 等设备访问
+    cpu_access_guard cpu_access() const {
+        return cpu_access_guard(cached && buf != nullptr ? fd : -1);
+    }
+
     int get_size() {
         if(buf != nullptr) {
             return size;
@@ -168,18 +220,46 @@ struct dma_data_t {
     }
 };
 
+// 随帧传递的检测结果(原图坐标)
+struct frame_detect_t {
+    image_rect_t box;
+    float prop;
+    int cls_id;
+    int track_id = -1;  // 跟踪ID, -1: 无
+};
+
 struct code_frame_t {
-    u_char* frame = nullptr;  // 手动管理的指针
+    u_char* frame = nullptr;  // 来自 FramePool 的缓冲
     int size = 0;
+    size_t capacity = 0;      // 缓冲容量, 归还 FramePool 时使用
     int width;
     int height;
+    int valid_width = 0;      // 有效图像宽(width/height 为带对齐的 stride)
+    int valid_height = 0;     // 有效图像高
     uint64_t frame_seq = 0;   // 序列号
+    int64_t pts = 0;          // 源码流 pts(ms)
+    std::vector<frame_detect_t> detects; // 本帧检测结果
+    bool annotated = false;   // 经过推理线程(非直通编码)
+    bool reused = false;      // 未推理, detects 沿用最近一次推理结果
     
-    // 析构函数 - 自动释放 malloc 的内存
+    // 析构函数 - 自动归还帧缓冲
     ~code_frame_t() {
+        release();
+    }
+
+    // 从帧缓冲池分配 size 字节
+    bool alloc(int size) {
+        release();
+        frame = FramePool::getInstance().acquire(size, &capacity);
+        this->size = frame ? size : 0;
+        return frame != nullptr;
+    }
+
+    void release() {
         if(frame) {
-            free(frame);
+            FramePool::getInstance().release(frame, capacity);
             frame = nullptr;
+            capacity = 0;
         }
     }
     
@@ -189,24 +269,36 @@ struct code_frame_t {
     
     // 允许移动
     code_frame_t(code_frame_t&& other) noexcept 
-        : frame(other.frame), size(other.size), frame_seq(other.frame_seq) {
+        : frame(other.frame), size(other.size), capacity(other.capacity), width(other.width), height(other.height),
+          valid_width(other.valid_width), valid_height(other.valid_height),
+          frame_seq(other.frame_seq), pts(other.pts), detects(std::move(other.detects)), annotated(other.annotated),
+          reused(other.reused) {
         other.frame = nullptr;
         other.size = 0;
+        other.capacity = 0;
     }
     
     code_frame_t& operator=(code_frame_t&& other) noexcept {
         if(this != &other) {
             // 释放当前资源
-            if(frame) {
-                free(frame);
-            }
+            release();
             // 转移所有权
             frame = other.frame;
             size = other.size;
+            capacity = other.capacity;
+            width = other.width;
+            height = other.height;
+            valid_width = other.valid_width;
+            valid_height = other.valid_height;
             frame_seq = other.frame_seq;
+            pts = other.pts;
+            detects = std::move(other.detects);
+            annotated = other.annotated;
+            reused = other.reused;
             
             other.frame = nullptr;
             other.size = 0;
+            other.capacity = 0;
         }
         return *this;
     }
@@ -222,26 +314,255 @@ struct StreamConfig {
     std::string stream;
 };
 
+// 编码输出配置
+struct EncoderConfig {
+    int buffers = 4;    // 编码输入/输出缓冲环大小
+    short codec = H264; // eStreamType, h264 / h265
+    int rc_mode = MPP_ENC_RC_MODE_VBR; // cbr / vbr / avbr / fixqp
+    int bitrate = 0;    // 目标码率(bps), 0: 按分辨率和帧率估算
+    int qp_init = -1;   // 初始qp, fixqp 模式下为固定qp
+    int qp_min = 10;
+    int qp_max = 51;
+    int gop = 0;        // 关键帧间隔(帧), 0: fps*2
+    int profile = 0;    // h264: 66/77/100, h265: 1, 0: 默认
+    int level = 0;      // 0: 默认
+    bool low_latency = false; // 按slice切分输出, 逐slice推流
+    int slice_rows = 4; // 每个slice的宏块/CTU行数
+    bool roi_enable = false; // 按检测框做ROI编码
+    int roi_max_regions = 8; // 每帧最多ROI区域数(含背景)
+    int roi_obj_qp = -6; // 目标区域相对qp
+    int roi_bg_qp = 4;  // 背景相对qp
+    bool idr_on_play = true; // 新观众开始播放时立即请求IDR
+};
+
+// 将编码配置填入编码器初始化参数
+inline void apply_encoder_config(InputInfo& info, const EncoderConfig& enc) {
+    info.buf_num = enc.buffers;
+    info.stream_type = enc.codec;
+    info.rc_mode = enc.rc_mode;
+    info.bps = enc.bitrate;
+    info.qp_init = enc.qp_init;
+    info.qp_min = enc.qp_min;
+    info.qp_max = enc.qp_max;
+    info.gop = enc.gop;
+    info.profile = enc.profile;
+    info.level = enc.level;
+    info.low_latency = enc.low_latency;
+    info.slice_rows = enc.slice_rows;
+    info.roi_enable = enc.roi_enable;
+    info.roi_max_regions = enc.roi_max_regions;
+    info.roi_obj_qp = enc.roi_obj_qp;
+    info.roi_bg_qp = enc.roi_bg_qp;
+    info.idr_each_header = enc.idr_on_play;
+}
+
+// 额外输出档位(缩放/降帧的检测子码流)
+struct ProfileConfig {
+    std::string name;
+    StreamConfig stream;    // 推流 app/stream
+    EncoderConfig encoder;  // 编码配置
+    int width = 0;          // 输出宽, 0: 与源相同
+    int height = 0;         // 输出高, 0: 按源比例
+    int fps_div = 1;        // 降帧因子, 每 fps_div 帧编码一帧
+    bool use_rga = true;    // 使用RGA缩放, 否则CPU缩放
+};
+
+// 过载丢帧模式
+enum eDropMode {
+    DROP_AUTO = 0,      // 按推理负载自动升降级
+    DROP_OFF,           // 不丢帧
+    DROP_NON_REF,       // 固定丢弃非参考帧
+    DROP_KEY_ONLY,      // 固定只解码关键帧
+};
+
+// 解码前过载丢帧配置, 负载为推理线程全忙(直通编码)帧的比例
+struct OverloadConfig {
+    eDropMode mode = DROP_OFF;
+    float non_ref_load = 0.3f;  // 负载超过此值时丢弃非参考帧
+    float key_only_load = 0.7f; // 负载超过此值时只解码关键帧
+    float recover_load = 0.05f; // 负载低于此值时降一级
+};
+
+// 推理前的运动/重复帧门控配置
+struct MotionGateConfig {
+    bool enable = false;
+    int block_size = 8;         // 抽样图(1/4 x 1/4)上的分块边长, 8 对应原图 32x32
+    int block_thresh = 6;       // 块内平均每像素绝对差超过此值视为变化块
+    int min_blocks = 2;         // 变化块达到此数量时推理
+    int max_skip = 25;          // 连续跳过推理的最多帧数, 到达后强制推理一次
+};
+
+// 进程内存预算配置
+struct MemoryConfig {
+    int budget_mb = 0;          // 各组件内存总预算, 0: 只按系统可用内存判断
+    float high_ratio = 0.8f;    // 用量超过预算的此比例进入高压
+    float critical_ratio = 0.95f; // 用量超过预算的此比例进入临界
+    int min_available_mb = 128; // 系统可用内存低于此值进入临界, 低于两倍进入高压
+    int poll_ms = 1000;         // 检查周期
+    int max_pending = 0;        // 等待编码的帧数上限, 0: 不限(高压时仍会限制)
+};
+
+// 抓拍配置
+struct SnapshotConfig {
+    bool enable = false;
+    std::string dir = "./snapshots"; // 抓拍保存目录
+    std::string classes;    // 触发抓拍的类别名(逗号分隔), 空: 任意类别
+    float min_score = 0.5f; // 触发抓拍的最低置信度
+    int min_interval_ms = 2000; // 规则触发的最小间隔
+    int workers = 2;        // JPEG编码线程数
+    int queue_size = 4;     // 待编码队列上限, 满时丢弃
+    int quality = 85;       // JPEG质量
+    bool use_mpp = true;    // 优先使用MPP MJPEG硬件编码
+    int http_port = 0;      // 本地HTTP触发端口(GET /snapshot), 0: 不启用
+};
+
+// 检测结果共享内存导出配置
+struct DetectRingConfig {
+    bool enable = false;
+    std::string path = "/dev/shm/rknn_detect"; // 共享内存文件
+    int slots = 256;        // 环形缓冲区记录数
+    int stream_id = 0;      // 写入记录的流ID, 区分多路进程
+};
+
+// 运行时可热更新的配置, 每次重新加载生成一份新的只读快照
+struct RuntimeConfig {
+    float box_thresh = 0.25f;   // 检测框置信度阈值
+    float nms_thresh = 0.45f;   // NMS IoU 阈值
+    int max_objects = 128;      // 每帧最多输出的目标数(不超过 OBJ_NUMB_MAX_SIZE)
+    std::vector<float> class_thresh;// 按类别号索引的阈值, 0: 不输出该类别; 空: 全部类别使用 box_thresh
+    int infer_stride = 1;       // 每N帧送一帧推理, 其余帧直接编码
+    int inference_threads = 2;  // 参与调度的推理线程数(不超过启动时创建的数量)
+    bool overlay = true;        // 检测框/标签/FPS叠加渲染, false: 只输出元数据
+    int detect_bitrate = 0;     // 检测流目标码率(bps), 0: 按分辨率和帧率估算
+    int font_size = 18;         // 叠加样式
+    uint32_t font_color = 0xffff00;
+    uint32_t bg_color = 0x000000;
+    int bg_alpha = 255;
+    uint32_t box_color = 0xff6464;
+    int box_thickness = 2;
+};
+
+// 解码帧导出配置
+struct FrameExportConfig {
+    bool enable = false;
+    std::string socket_path = "/tmp/rknn_frames.sock"; // Unix 套接字路径
+    int max_consumers = 4;  // 客户端数上限
+    int max_leases = 2;     // 每个客户端同时持有的帧数上限, 超过时对该客户端丢帧
+};
+
 struct PushServer {
     std::string type = "rtsp";
     int port = 8554;
     StreamConfig stream_conifg;  // 原始流
 };
 
+// 推理区域, 源帧像素坐标, width/height 为 0 时延伸到帧边缘
+struct InferRegionConfig {
+    std::string name;
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    int stride = 1;     // 每 stride 个推理帧推理一次
+};
+
+// 推理视图: 整帧 letterbox / 自动重叠平铺 / 指定区域, 各自独立的推理间隔
+struct InferRegionsConfig {
+    bool full_frame = true;
+    int full_stride = 1;
+    int tile_cols = 0;          // 自动平铺的列数/行数, 0 关闭
+    int tile_rows = 0;
+    float tile_overlap = 0.15f; // 相邻块重叠占块宽高的比例
+    int tile_stride = 1;
+    float merge_overlap = 0.7f; // 跨视图去重: 同类框交集占较小框的比例超过该值视为同一目标
+    std::vector<InferRegionConfig> regions;
+};
+
 struct Config {
     PushServer pushServer;
     StreamConfig originStream;  // 原始流
     StreamConfig detectStream;  // 检测流
+    EncoderConfig detectEncoder; // 检测流编码配置
+    bool detectSei = false;     // 检测结果写入SEI随检测流输出
+    std::vector<ProfileConfig> profiles; // 额外输出档位
+    SnapshotConfig snapshot; // 抓拍配置
+    DetectRingConfig detectRing; // 检测结果共享内存导出
+    FrameExportConfig frameExport; // 解码帧导出
+    OverloadConfig overload; // 过载丢帧配置
+    MotionGateConfig motionGate; // 运动/重复帧门控配置
+    MemoryConfig memory;     // 内存预算配置
     std::string pullStream;
+    int pullStatsInterval = 10; // 拉流码流统计输出间隔(秒), 0: 不统计
+    int pullReconnectMinMs = 500;   // 断线重连的初始等待时间
+    int pullReconnectMaxMs = 10000; // 断线重连的最大等待时间(指数退避上限)
+    std::string framePages = "auto"; // 帧缓冲页类型 auto / hugetlb / thp / normal
+    int framePoolFree = 8;           // 帧缓冲池保留的空闲缓冲数
+    std::string dmaHeap = "cma";    // dma_data_t 使用的 dma_heap 名称
+    int dmaPoolMaxFreeMB = 64;      // DMA池空闲缓冲上限(MB)
+    bool dmaPoolForceMemfd = false; // DMA池强制使用memfd后端(无 /dev/dma_heap 的主机)
+    int decoderBuffers = 0;     // 解码帧缓冲数, 0: 按码流DPB自动计算
+    int decoderExtraBuffers = 3; // 自动计算时DPB之外的帧缓冲数
     std::string model_path;
-    int inference_threads = 2; // 推理线程数量
+    std::string label_path;    // 类别名文件, 每行一个, 行号为类别号
+    int inference_threads = 2; // 启动时创建的推理线程数(运行时可调的上限)
+    int warmupRuns = 2;        // 每个推理实例启动时的预热次数, 0 不预热
+    int pipelineDepth = 3;     // 每个推理实例流水线中同时处理的帧数
+    InferRegionsConfig inferRegions;
+    bool configWatch = true;   // 监视配置文件变化自动重新加载
+};
+
+// 流水线就绪前缓存的拉流包
+struct startup_packet_t {
+    int codec = 0;
+    std::vector<uint8_t> data;
+    uint64_t dts = 0;
+    uint64_t pts = 0;
 };
 
 struct FrameContext {
     int fps = 30; // 视频流的fps
+    EncoderConfig enc_config; // 检测流编码配置
 
     std::vector<std::unique_ptr<Inference>> inferences; // 多个推理实例
-    RKEncodeVideo *encoder = nullptr;
+    std::vector<std::unique_ptr<OutputProfile>> profiles; // 额外输出档位
+    std::unique_ptr<SnapshotService> snapshot; // 抓拍服务
+    std::unique_ptr<NalStreamAnalyzer> pull_stats; // 拉流码流统计
+    std::unique_ptr<FrameDropper> dropper; // 解码前过载丢帧
+    std::unique_ptr<DetectRingWriter> detect_ring; // 检测结果共享内存导出
+    std::unique_ptr<FrameExporter> frame_export; // 解码帧导出
+    std::unique_ptr<MotionGate> motion_gate; // 推理前的运动/重复帧门控
+    int pull_stats_interval = 0;  // 统计输出间隔(秒)
+    uint64_t pull_stats_pts = 0;  // 上次输出统计时的pts
+    int dec_buffer_count = 0;     // 解码帧缓冲数, 0: 自动
+    int dec_extra_buffers = 3;    // DPB之外的帧缓冲数
+
+    bool sei_enable = false;      // 检测结果写入SEI
+    std::map<uint64_t, std::vector<uint8_t>> sei_pending; // 已送编码器的帧对应的SEI, 按 frame_seq 索引
+    std::mutex sei_mutex;
+    uint64_t sei_last_seq = UINT64_MAX; // 上一个输出包的 frame_seq, 用于识别新帧的第一个包
+
+    std::atomic<size_t> dec_buffer_bytes{0}; // 解码帧缓冲用量
+    std::atomic<size_t> enc_buffer_bytes{0}; // 编码器缓冲用量
+    std::atomic<int> max_pending{0};         // 等待编码的帧数上限(随内存压力调整), 0: 不限
+    std::atomic<uint64_t> pending_dropped{0}; // 因等待队列满丢弃的帧
+
+    int pull_codec = -1;          // 当前拉流的编码类型
+    std::atomic<bool> pipeline_ready{false}; // 推理/编码/推流初始化完成
+    std::atomic<bool> startup_pending{false}; // 有待送入的启动缓存
+    std::mutex startup_mutex;
+    std::vector<startup_packet_t> startup_packets; // 就绪前缓存的最近一个GOP
+    size_t startup_bytes = 0;
+    bool startup_gop_start = false; // 上一个缓存包是参数集/关键帧
+    int64_t startup_us = 0;       // 进程启动时间
+    std::atomic<bool> first_detect_logged{false};
+    std::atomic<int64_t> outage_begin_us{0};  // 断流开始时间, 0: 未断流
+    std::atomic<int64_t> reconnect_us{0};     // 重连成功时间, 等待第一帧推理结果
+
+    // 按间隔跳过或门控跳过推理的帧沿用最近一次的推理结果
+    std::mutex last_detect_mutex;
+    std::vector<frame_detect_t> last_detects;
+    uint64_t last_detect_seq = 0;
+    std::atomic<RKEncodeVideo*> encoder{nullptr}; // 解码回调创建, 编码线程和 ZLM 线程(观众接入)读取
     MppDecoder *decoder = nullptr;
     
     std::atomic<uint64_t> frame_seq_counter{0}; // 帧序列号计数器
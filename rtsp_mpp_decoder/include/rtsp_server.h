@@ -3,21 +3,30 @@
 
 #include <mutex>
 #include <string>
+#include <vector>
+#include <functional>
 #include "rknn_type.h"
 #include "mk_mediakit.h"
 
+// 新观众开始播放回调
+using PlayerAttachCallback = std::function<void()>;
+
 class RtspServer {
 public:
     RtspServer(const PushServer& config);
     ~RtspServer();
-    int initZlmMedia();  // 自动初始化服务器
+    int initZlmMedia(int codec_id = MKCodecH264);  // 自动初始化服务器, codec_id 为 MKCodecXXX
+    int inputFrame(const void *data, int len, uint64_t dts, uint64_t pts); // 按 track 编码类型推送一帧
     int stopServer();    // 减少实例计数
     mk_media getZlmMediaHandle() const;
+    void setOnPlayerAttach(PlayerAttachCallback callback); // 本流有新观众时回调(ZLM线程)
 private:
     int initServer();  // 改为私有
     
     static void API_CALL pushResultCallback(void *user_data, int err_code, const char *err_msg);
     static void API_CALL mediasourceRegistCallback(void *user_data, mk_media_source sender, int regist);
+    static void API_CALL mediaPlayCallback(const mk_media_info url_info, const mk_auth_invoker invoker,
+                                           const mk_sock_info sender);
     
     void zlmPusherInit();
     void zlmPusherStart();
@@ -25,12 +34,15 @@ private:
 private:
     mk_media m_mediaHandle;
     mk_pusher m_pusherHandle;
+    int m_codecId;
     PushServer m_config;
     std::string m_url;
     std::atomic<bool> m_isActive;
     std::atomic<bool> m_isDestroying;  // 新增：标记正在销
+    PlayerAttachCallback m_onPlayerAttach;
     
     static std::mutex s_mutex;
+    static std::vector<RtspServer*> s_instances;  // 用于按 app/stream 分发播放事件
     static int s_instanceCount;
     static bool s_serverInitialized;
 };
@@ -0,0 +1,78 @@
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+
+#include "rknn_type.h"
+#include "postprocess.h"
+
+class INIReader;
+
+// 运行时配置热更新
+// 配置以只读快照的形式发布, 热路径用 get() 无锁读取当前快照. 配置文件变化(inotify)或收到 SIGHUP
+// 时重新解析并校验, 通过后原子替换快照; 解析或校验失败时保留原快照. 快照由 shared_ptr 管理,
+// 热路径持有的快照在本帧处理期间始终有效, 被替换的快照在最后一个持有者放手后释放.
+class RuntimeConfigManager {
+public:
+    using Listener = std::function<void(const RuntimeConfig& old_config, const RuntimeConfig& new_config)>;
+
+    static RuntimeConfigManager& getInstance() {
+        static RuntimeConfigManager instance;
+        return instance;
+    }
+
+    // 启动时加载, 失败时使用默认值
+    bool load(const std::string& path);
+
+    std::shared_ptr<const RuntimeConfig> get() const {
+        return std::atomic_load_explicit(&m_current, std::memory_order_acquire);
+    }
+
+    // 快照替换后在监视线程中调用
+    void subscribe(Listener listener);
+
+    // watch: 是否监视配置文件变化, SIGHUP 始终生效
+    void start(bool watch);
+    void stop();
+
+    // 重新加载, 返回是否替换了快照
+    bool reload();
+
+    // 模型加载后设置类别数并重新校验当前配置文件, 类别号超出模型类别数时返回 false
+    bool set_num_classes(int num_classes);
+
+    // 从 INI 解析并校验, 失败时 error 给出原因; 类别号需小于 num_classes
+    static bool parse(const INIReader& reader, int num_classes, RuntimeConfig& config, std::string& error);
+
+    RuntimeConfigManager(const RuntimeConfigManager&) = delete;
+    RuntimeConfigManager& operator=(const RuntimeConfigManager&) = delete;
+
+private:
+    RuntimeConfigManager();
+    ~RuntimeConfigManager();
+
+    void publish(std::unique_ptr<RuntimeConfig> config);
+    void watch_func();
+
+private:
+    std::string m_path;
+    std::shared_ptr<const RuntimeConfig> m_current;    // 只用 std::atomic_load/atomic_store 访问
+    std::vector<Listener> m_listeners;
+    std::mutex m_mutex;
+
+    std::thread m_watch_thread;
+    std::atomic<bool> m_is_running{false};
+    int m_inotify_fd = -1;
+    int m_wake_fd[2] = {-1, -1};    // SIGHUP 和退出通知
+    uint64_t m_reloads = 0;
+    uint64_t m_rejects = 0;
+    std::atomic<int> m_num_classes{OBJ_CLASS_MAX};  // 模型类别数, 模型加载前为上限
+};
+
+#endif
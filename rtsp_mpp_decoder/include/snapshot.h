@@ -0,0 +1,75 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <condition_variable>
+
+#include "rknn_type.h"
+
+// 一个抓拍任务: 共享引用已渲染的帧, 不在热路径上拷贝
+struct snapshot_task_t {
+    std::shared_ptr<code_frame_t> frame;
+    std::string reason;
+};
+
+// 异步JPEG抓拍服务
+// 编码线程调用 on_frame 判断是否触发(检测规则或本地HTTP请求), 触发后只把帧引用放入有界队列,
+// 由工作线程池完成JPEG编码(优先MPP MJPEG, 失败时走CPU)并写文件, 队列满时直接丢弃.
+class SnapshotService {
+public:
+    SnapshotService() = default;
+    ~SnapshotService() {
+        release();
+    }
+
+    int initialize(const SnapshotConfig& config);
+
+    // 编码线程调用, 只做规则判断和入队, 不阻塞
+    void on_frame(const std::shared_ptr<code_frame_t>& frame);
+
+    // 请求抓拍下一帧(可在任意线程调用)
+    void request(const std::string& reason);
+
+    void release();
+
+    // 各工作线程的编码缓冲用量
+    size_t get_buffer_bytes() const { return m_buffer_bytes.load(); }
+
+    SnapshotService(const SnapshotService&) = delete;
+    SnapshotService& operator=(const SnapshotService&) = delete;
+
+private:
+    bool match_rule(const code_frame_t& frame);
+    bool submit(const std::shared_ptr<code_frame_t>& frame, const std::string& reason);
+    void worker_func(int index);
+    void http_func();
+    bool write_file(const std::string& path, const std::vector<uint8_t>& data);
+
+private:
+    SnapshotConfig m_config;
+    std::vector<bool> m_class_mask;     // 触发抓拍的类别
+    std::atomic<bool> m_is_running{false};
+
+    std::deque<snapshot_task_t> m_queue;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_cv;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_request_mutex;
+    std::string m_request_reason;       // 待处理的手动抓拍请求
+    int64_t m_last_rule_ms = 0;         // 上次规则触发时间
+
+    int m_http_fd = -1;
+    std::thread m_http_thread;
+
+    std::atomic<uint64_t> m_saved{0};
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<size_t> m_buffer_bytes{0};
+};
+
+#endif
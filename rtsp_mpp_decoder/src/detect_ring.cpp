@@ -0,0 +1,132 @@
+#include "detect_ring.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static_assert(sizeof(detect_ring_header_t) == DETECT_RING_HEADER_SIZE, "detect ring header size");
+static_assert(sizeof(detect_ring_slot_t) % 64 == 0, "detect ring slot must be cache line aligned");
+
+static int64_t monotonic_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int16_t clamp_i16(int value) {
+    return value < -32768 ? -32768 : (value > 32767 ? 32767 : value);
+}
+
+DetectRingWriter::~DetectRingWriter() {
+    close();
+}
+
+int DetectRingWriter::initialize(const DetectRingConfig& config) {
+    close();
+
+    m_slot_count = config.slots > 0 ? config.slots : 256;
+    m_stream_id = config.stream_id;
+    m_path = config.path;
+    m_map_size = DETECT_RING_HEADER_SIZE + (size_t)m_slot_count * sizeof(detect_ring_slot_t);
+
+    // 先删除再创建, 写端重启后旧读端不会读到新旧混合的数据
+    unlink(m_path.c_str());
+    int fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        printf("detect ring: open %s failed: %s\n", m_path.c_str(), strerror(errno));
+        return -1;
+    }
+    if (ftruncate(fd, m_map_size) != 0) {
+        printf("detect ring: ftruncate %s failed: %s\n", m_path.c_str(), strerror(errno));
+        ::close(fd);
+        unlink(m_path.c_str());
+        return -1;
+    }
+    void *map = mmap(nullptr, m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        printf("detect ring: mmap %s failed: %s\n", m_path.c_str(), strerror(errno));
+        unlink(m_path.c_str());
+        return -1;
+    }
+
+    m_map = (uint8_t *)map;
+    m_header = (detect_ring_header_t *)m_map;
+    m_slots = (detect_ring_slot_t *)(m_map + DETECT_RING_HEADER_SIZE);
+    m_index = 0;
+    m_truncated = 0;
+
+    m_header->version = DETECT_RING_VERSION;
+    m_header->header_size = DETECT_RING_HEADER_SIZE;
+    m_header->slot_size = sizeof(detect_ring_slot_t);
+    m_header->slot_count = m_slot_count;
+    m_header->max_objects = DETECT_RING_MAX_OBJECTS;
+    m_header->writer_pid = getpid();
+    // magic 最后写入, 读端看到 magic 即可认为头部有效
+    __atomic_store_n(&m_header->magic, DETECT_RING_MAGIC, __ATOMIC_RELEASE);
+
+    printf("detect ring: %s, %u slots x %zu bytes, stream id %u\n",
+           m_path.c_str(), m_slot_count, sizeof(detect_ring_slot_t), m_stream_id);
+    return 0;
+}
+
+void DetectRingWriter::publish(const code_frame_t& frame) {
+    if (m_map == nullptr) {
+        return;
+    }
+
+    uint64_t index = m_index;
+    detect_ring_slot_t *slot = &m_slots[index % m_slot_count];
+
+    // seqlock: 奇数版本号先对读端可见, 之后才写记录内容
+    __atomic_store_n(&slot->version, index * 2 + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    detect_ring_record_t *rec = &slot->record;
+    int count = frame.detects.size();
+    if (count > DETECT_RING_MAX_OBJECTS) {
+        count = DETECT_RING_MAX_OBJECTS;
+        m_truncated++;
+    }
+    rec->stream_id = m_stream_id;
+    rec->count = count;
+    rec->frame_seq = frame.frame_seq;
+    rec->pts = frame.pts;
+    rec->timestamp_us = monotonic_us();
+    rec->width = frame.valid_width > 0 ? frame.valid_width : frame.width;
+    rec->height = frame.valid_height > 0 ? frame.valid_height : frame.height;
+    rec->flags = (frame.annotated ? DETECT_RING_FLAG_INFERRED : 0) | (frame.reused ? DETECT_RING_FLAG_REUSED : 0);
+    for (int i = 0; i < count; i++) {
+        const frame_detect_t& det = frame.detects[i];
+        detect_ring_object_t *obj = &rec->objects[i];
+        obj->left = clamp_i16(det.box.left);
+        obj->top = clamp_i16(det.box.top);
+        obj->right = clamp_i16(det.box.right);
+        obj->bottom = clamp_i16(det.box.bottom);
+        obj->cls_id = clamp_i16(det.cls_id);
+        obj->track_id = clamp_i16(det.track_id);
+        obj->score = det.prop;
+    }
+
+    __atomic_store_n(&slot->version, index * 2 + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&m_header->write_index, index + 1, __ATOMIC_RELEASE);
+    m_index = index + 1;
+}
+
+void DetectRingWriter::close() {
+    if (m_map == nullptr) {
+        return;
+    }
+    if (m_truncated > 0) {
+        printf("detect ring: %lu frames truncated to %d objects\n", m_truncated, DETECT_RING_MAX_OBJECTS);
+    }
+    munmap(m_map, m_map_size);
+    unlink(m_path.c_str());
+    m_map = nullptr;
+    m_header = nullptr;
+    m_slots = nullptr;
+}
@@ -0,0 +1,158 @@
+// 检测结果共享内存环形缓冲区多读端压测
+// 一个写线程使用 DetectRingWriter 连续发布记录, N 个读线程各自用 detect_ring_reader 库独立映射读取,
+// 输出写入速率、各读端读取速率、丢失数和拷贝期间被覆盖(torn)的重试次数, 并校验读到的记录内容完整.
+//
+//   detect_ring_bench [读端数=4] [秒数=5] [slots=256] [写入频率Hz=0 不限] [path=/dev/shm/detect_ring_bench]
+#include "detect_ring.h"
+#include "detect_ring_reader.h"
+
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+
+struct reader_stats_t {
+    uint64_t reads = 0;
+    uint64_t lost = 0;
+    uint64_t torn = 0;
+    uint64_t invalid = 0;   // 内容与 frame_seq 不一致的记录, seqlock 正确时应为0
+};
+
+static int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 记录内容全部由 frame_seq 推出, 读端据此校验是否读到新旧混合的记录
+static int bench_count(uint64_t seq) {
+    return seq % (DETECT_RING_MAX_OBJECTS + 1);
+}
+
+static void fill_frame(code_frame_t& frame, uint64_t seq) {
+    frame.frame_seq = seq;
+    frame.pts = seq * 40;
+    frame.annotated = seq % 3 == 1;
+    frame.reused = seq % 3 == 2;
+    frame.detects.resize(bench_count(seq));
+    for (size_t i = 0; i < frame.detects.size(); i++) {
+        frame_detect_t& det = frame.detects[i];
+        int base = (seq + i) & 0x3fff;
+        det.box.left = base;
+        det.box.top = base + 1;
+        det.box.right = base + 2;
+        det.box.bottom = base + 3;
+        det.cls_id = (seq + i) % 80;
+        det.track_id = i;
+        det.prop = (float)((seq + i) % 100) / 100.0f;
+    }
+}
+
+static bool check_record(const detect_ring_record_t& rec) {
+    uint64_t seq = rec.frame_seq;
+    if ((int)rec.count != bench_count(seq) || rec.pts != (int64_t)(seq * 40) ||
+        rec.flags != (seq % 3 == 1 ? DETECT_RING_FLAG_INFERRED : (seq % 3 == 2 ? DETECT_RING_FLAG_REUSED : 0u))) {
+        return false;
+    }
+    for (uint32_t i = 0; i < rec.count; i++) {
+        const detect_ring_object_t& obj = rec.objects[i];
+        int base = (seq + i) & 0x3fff;
+        if (obj.left != base || obj.top != base + 1 || obj.right != base + 2 || obj.bottom != base + 3 ||
+            obj.cls_id != (int)((seq + i) % 80) || obj.track_id != (int)i ||
+            obj.score != (float)((seq + i) % 100) / 100.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void reader_func(const char *path, std::atomic<bool> *running, reader_stats_t *stats) {
+    detect_ring_reader_t *reader = detect_ring_open(path);
+    if (reader == NULL) {
+        printf("reader: open %s failed\n", path);
+        return;
+    }
+    detect_ring_record_t rec;
+    while (running->load(std::memory_order_relaxed)) {
+        int ret = detect_ring_read(reader, &rec);
+        if (ret == 1) {
+            stats->reads++;
+            if (!check_record(rec)) {
+                stats->invalid++;
+            }
+        } else if (ret == 0) {
+            sched_yield();
+        } else {
+            break;
+        }
+    }
+    stats->lost = detect_ring_lost(reader);
+    stats->torn = detect_ring_torn(reader);
+    detect_ring_close(reader);
+}
+
+int main(int argc, char **argv) {
+    int reader_count = argc > 1 ? atoi(argv[1]) : 4;
+    int seconds = argc > 2 ? atoi(argv[2]) : 5;
+    DetectRingConfig config;
+    config.slots = argc > 3 ? atoi(argv[3]) : 256;
+    int write_hz = argc > 4 ? atoi(argv[4]) : 0;
+    config.path = argc > 5 ? argv[5] : "/dev/shm/detect_ring_bench";
+    if (reader_count < 1 || seconds < 1) {
+        printf("usage: %s [readers] [seconds] [slots] [write_hz] [path]\n", argv[0]);
+        return 1;
+    }
+
+    DetectRingWriter writer;
+    if (writer.initialize(config) != 0) {
+        return 1;
+    }
+
+    std::atomic<bool> running{true};
+    std::vector<reader_stats_t> stats(reader_count);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < reader_count; i++) {
+        readers.emplace_back(reader_func, config.path.c_str(), &running, &stats[i]);
+    }
+
+    code_frame_t frame;
+    frame.width = 1920;
+    frame.height = 1088;
+    frame.valid_width = 1920;
+    frame.valid_height = 1080;
+    int64_t begin_us = now_us();
+    int64_t end_us = begin_us + (int64_t)seconds * 1000000;
+    int64_t interval_us = write_hz > 0 ? 1000000 / write_hz : 0;
+    uint64_t seq = 0;
+    for (int64_t t = begin_us; t < end_us; t = now_us()) {
+        fill_frame(frame, seq++);
+        writer.publish(frame);
+        if (interval_us > 0) {
+            std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+                std::chrono::microseconds(begin_us + (int64_t)seq * interval_us)));
+        }
+    }
+    double elapsed = (now_us() - begin_us) / 1e6;
+    running = false;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    printf("writer: %lu records, %.0f records/s, %u slots\n", writer.published(), writer.published() / elapsed,
+           config.slots);
+    reader_stats_t total;
+    for (int i = 0; i < reader_count; i++) {
+        printf("reader %d: %.0f reads/s, lost %lu, torn retries %lu, invalid %lu\n", i,
+               stats[i].reads / elapsed, stats[i].lost, stats[i].torn, stats[i].invalid);
+        total.reads += stats[i].reads;
+        total.lost += stats[i].lost;
+        total.torn += stats[i].torn;
+        total.invalid += stats[i].invalid;
+    }
+    printf("total: %.0f reads/s, lost %lu, torn retries %lu, invalid %lu\n", total.reads / elapsed,
+           total.lost, total.torn, total.invalid);
+    writer.close();
+    return total.invalid == 0 ? 0 : 2;
+}
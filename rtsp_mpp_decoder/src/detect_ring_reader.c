@@ -0,0 +1,134 @@
+#include "detect_ring_reader.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct detect_ring_reader {
+    const uint8_t *map;
+    size_t map_size;
+    const detect_ring_header_t *header;
+    const uint8_t *slots;
+    uint32_t slot_size;
+    uint32_t slot_count;
+    uint64_t cursor;    /* 下一条要读的记录序号 */
+    uint64_t lost;
+    uint64_t torn;      /* 拷贝期间被写端覆盖的次数 */
+};
+
+static uint64_t load_write_index(const detect_ring_reader_t *reader) {
+    return __atomic_load_n(&reader->header->write_index, __ATOMIC_ACQUIRE);
+}
+
+detect_ring_reader_t *detect_ring_open(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < DETECT_RING_HEADER_SIZE) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    const detect_ring_header_t *header = (const detect_ring_header_t *)map;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != DETECT_RING_MAGIC ||
+        header->version != DETECT_RING_VERSION ||
+        header->slot_size < sizeof(detect_ring_slot_t) || header->slot_count == 0 ||
+        header->header_size + (size_t)header->slot_size * header->slot_count > (size_t)st.st_size) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    detect_ring_reader_t *reader = (detect_ring_reader_t *)calloc(1, sizeof(*reader));
+    if (reader == NULL) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    reader->map = (const uint8_t *)map;
+    reader->map_size = st.st_size;
+    reader->header = header;
+    reader->slots = reader->map + header->header_size;
+    reader->slot_size = header->slot_size;
+    reader->slot_count = header->slot_count;
+    reader->cursor = load_write_index(reader);
+    return reader;
+}
+
+void detect_ring_close(detect_ring_reader_t *reader) {
+    if (reader == NULL) {
+        return;
+    }
+    munmap((void *)reader->map, reader->map_size);
+    free(reader);
+}
+
+int detect_ring_read(detect_ring_reader_t *reader, detect_ring_record_t *record) {
+    if (reader == NULL || record == NULL) {
+        return -1;
+    }
+
+    for (;;) {
+        uint64_t write_index = load_write_index(reader);
+        if (reader->cursor >= write_index) {
+            return 0;
+        }
+        /* 落后超过一圈, 跳到仍然有效的最旧记录 */
+        if (write_index - reader->cursor > reader->slot_count) {
+            reader->lost += write_index - reader->slot_count - reader->cursor;
+            reader->cursor = write_index - reader->slot_count;
+        }
+
+        uint64_t index = reader->cursor;
+        const detect_ring_slot_t *slot =
+            (const detect_ring_slot_t *)(reader->slots + (index % reader->slot_count) * reader->slot_size);
+        uint64_t expected = index * 2 + 2;
+
+        uint64_t v1 = __atomic_load_n(&slot->version, __ATOMIC_ACQUIRE);
+        if (v1 == expected) {
+            /* 只拷贝有效的目标 */
+            memcpy(record, &slot->record, offsetof(detect_ring_record_t, objects));
+            uint32_t count = record->count < DETECT_RING_MAX_OBJECTS ? record->count : DETECT_RING_MAX_OBJECTS;
+            memcpy(record->objects, slot->record.objects, count * sizeof(detect_ring_object_t));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            uint64_t v2 = __atomic_load_n(&slot->version, __ATOMIC_RELAXED);
+            if (v2 == v1) {
+                record->count = count;
+                reader->cursor = index + 1;
+                return 1;
+            }
+            reader->torn++;
+        }
+        /* 拷贝期间或之前已被写端覆盖 */
+        reader->lost++;
+        reader->cursor = index + 1;
+    }
+}
+
+void detect_ring_seek_latest(detect_ring_reader_t *reader) {
+    if (reader != NULL) {
+        reader->cursor = load_write_index(reader);
+    }
+}
+
+uint64_t detect_ring_lost(const detect_ring_reader_t *reader) {
+    return reader != NULL ? reader->lost : 0;
+}
+
+uint64_t detect_ring_torn(const detect_ring_reader_t *reader) {
+    return reader != NULL ? reader->torn : 0;
+}
+
+uint64_t detect_ring_published(const detect_ring_reader_t *reader) {
+    return reader != NULL ? load_write_index(reader) : 0;
+}
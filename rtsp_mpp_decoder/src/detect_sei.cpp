@@ -0,0 +1,161 @@
+#include "detect_sei.h"
+
+#include <string.h>
+
+// 检测结果 SEI 的 uuid_iso_iec_11578
+static const uint8_t kDetectSeiUuid[16] = {
+    0x72, 0x6b, 0x6e, 0x6e, 0x2d, 0x64, 0x65, 0x74,
+    0x65, 0x63, 0x74, 0x2d, 0x73, 0x65, 0x69, 0x01,
+};
+
+static void put_u16(std::vector<uint8_t>& buf, int value) {
+    value = value < 0 ? 0 : (value > 0xffff ? 0xffff : value);
+    buf.push_back((value >> 8) & 0xff);
+    buf.push_back(value & 0xff);
+}
+
+static int get_u16(const uint8_t *p) {
+    return (p[0] << 8) | p[1];
+}
+
+void detect_sei_build(eNalCodec codec, const detect_sei_t& sei, std::vector<uint8_t>& out) {
+    int count = sei.detects.size() > DETECT_SEI_MAX_OBJECTS ? DETECT_SEI_MAX_OBJECTS : sei.detects.size();
+
+    // SEI 消息: payloadType, payloadSize(0xff 分段), uuid, 负载
+    std::vector<uint8_t> rbsp;
+    rbsp.reserve(32 + count * 12);
+    int payload_size = sizeof(kDetectSeiUuid) + 10 + count * 12;
+    rbsp.push_back(5);
+    for (int size = payload_size; ; size -= 0xff) {
+        if (size < 0xff) {
+            rbsp.push_back(size);
+            break;
+        }
+        rbsp.push_back(0xff);
+    }
+    rbsp.insert(rbsp.end(), kDetectSeiUuid, kDetectSeiUuid + sizeof(kDetectSeiUuid));
+    rbsp.push_back(DETECT_SEI_VERSION);
+    rbsp.push_back(count);
+    rbsp.push_back((sei.frame_seq >> 24) & 0xff);
+    rbsp.push_back((sei.frame_seq >> 16) & 0xff);
+    rbsp.push_back((sei.frame_seq >> 8) & 0xff);
+    rbsp.push_back(sei.frame_seq & 0xff);
+    put_u16(rbsp, sei.width);
+    put_u16(rbsp, sei.height);
+    for (int i = 0; i < count; i++) {
+        const frame_detect_t& det = sei.detects[i];
+        int score = (int)(det.prop * 255.0f + 0.5f);
+        rbsp.push_back(det.cls_id & 0xff);
+        rbsp.push_back(score < 0 ? 0 : (score > 255 ? 255 : score));
+        put_u16(rbsp, det.track_id < 0 ? 0xffff : det.track_id);
+        put_u16(rbsp, det.box.left);
+        put_u16(rbsp, det.box.top);
+        put_u16(rbsp, det.box.right);
+        put_u16(rbsp, det.box.bottom);
+    }
+    // rbsp_trailing_bits
+    rbsp.push_back(0x80);
+
+    out.clear();
+    out.reserve(rbsp.size() + rbsp.size() / 64 + 8);
+    static const uint8_t start_code[4] = {0, 0, 0, 1};
+    out.insert(out.end(), start_code, start_code + 4);
+    if (codec == NAL_CODEC_H264) {
+        out.push_back(0x06);
+    } else {
+        out.push_back(39 << 1);     // PREFIX_SEI_NUT
+        out.push_back(0x01);
+    }
+    // 防竞争: 连续两个0后出现 0~3 时插入 0x03
+    int zeros = 0;
+    for (uint8_t byte : rbsp) {
+        if (zeros >= 2 && byte <= 0x03) {
+            out.push_back(0x03);
+            zeros = 0;
+        }
+        out.push_back(byte);
+        zeros = byte == 0 ? zeros + 1 : 0;
+    }
+}
+
+bool detect_sei_parse(eNalCodec codec, const uint8_t *nal, size_t size, detect_sei_t& sei) {
+    size_t header = codec == NAL_CODEC_H264 ? 1 : 2;
+    if (size <= header) {
+        return false;
+    }
+    int type = codec == NAL_CODEC_H264 ? (nal[0] & 0x1f) : ((nal[0] >> 1) & 0x3f);
+    if ((codec == NAL_CODEC_H264 && type != 6) || (codec == NAL_CODEC_H265 && type != 39)) {
+        return false;
+    }
+
+    // 去掉防竞争字节
+    std::vector<uint8_t> rbsp;
+    rbsp.reserve(size);
+    int zeros = 0;
+    for (size_t i = header; i < size; i++) {
+        if (zeros >= 2 && nal[i] == 0x03) {
+            zeros = 0;
+            continue;
+        }
+        rbsp.push_back(nal[i]);
+        zeros = nal[i] == 0 ? zeros + 1 : 0;
+    }
+
+    // 一个 SEI NAL 中可能有多条消息, 逐条查找
+    size_t pos = 0;
+    while (pos + 2 <= rbsp.size() && rbsp[pos] != 0x80) {
+        int payload_type = 0;
+        while (pos < rbsp.size() && rbsp[pos] == 0xff) {
+            payload_type += 0xff;
+            pos++;
+        }
+        if (pos >= rbsp.size()) {
+            return false;
+        }
+        payload_type += rbsp[pos++];
+        size_t payload_size = 0;
+        while (pos < rbsp.size() && rbsp[pos] == 0xff) {
+            payload_size += 0xff;
+            pos++;
+        }
+        if (pos >= rbsp.size()) {
+            return false;
+        }
+        payload_size += rbsp[pos++];
+        if (pos + payload_size > rbsp.size()) {
+            return false;
+        }
+
+        const uint8_t *p = rbsp.data() + pos;
+        if (payload_type == 5 && payload_size >= sizeof(kDetectSeiUuid) + 10 &&
+            memcmp(p, kDetectSeiUuid, sizeof(kDetectSeiUuid)) == 0) {
+            p += sizeof(kDetectSeiUuid);
+            if (p[0] != DETECT_SEI_VERSION) {
+                return false;
+            }
+            int count = p[1];
+            if (payload_size < sizeof(kDetectSeiUuid) + 10 + (size_t)count * 12) {
+                return false;
+            }
+            sei.frame_seq = ((uint64_t)p[2] << 24) | (p[3] << 16) | (p[4] << 8) | p[5];
+            sei.width = get_u16(p + 6);
+            sei.height = get_u16(p + 8);
+            sei.detects.resize(count);
+            p += 10;
+            for (int i = 0; i < count; i++, p += 12) {
+                frame_detect_t& det = sei.detects[i];
+                det.cls_id = p[0];
+                det.prop = p[1] / 255.0f;
+                int track_id = get_u16(p + 2);
+                det.track_id = track_id == 0xffff ? -1 : track_id;
+                det.box.left = get_u16(p + 4);
+                det.box.top = get_u16(p + 6);
+                det.box.right = get_u16(p + 8);
+                det.box.bottom = get_u16(p + 10);
+            }
+            return true;
+        }
+        pos += payload_size;
+    }
+    return false;
+}
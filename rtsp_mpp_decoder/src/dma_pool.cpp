@@ -0,0 +1,176 @@
+#include "dma_pool.h"
+#include "dma_alloc.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static int64_t get_time_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+DmaPool::~DmaPool() {
+    trim(0);
+    for (auto& item : m_heaps) {
+        if (item.second.heap_fd >= 0) {
+            close(item.second.heap_fd);
+        }
+    }
+}
+
+void DmaPool::configure(size_t max_free_bytes, bool force_memfd) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_max_free_bytes = max_free_bytes;
+    m_force_memfd = force_memfd;
+}
+
+// 4KB 对齐, 每个2的幂区间分8档, 浪费不超过12.5%
+size_t DmaPool::size_class(size_t size) {
+    const size_t page = 4096;
+    size = (size + page - 1) & ~(page - 1);
+    if (size <= page * 8) {
+        return size;
+    }
+    size_t high = (size_t)1 << (63 - __builtin_clzll(size));
+    size_t step = high / 8;
+    return (size + step - 1) & ~(step - 1);
+}
+
+DmaPool::heap_t& DmaPool::get_heap(const char *heap_path) {
+    auto it = m_heaps.find(heap_path);
+    if (it != m_heaps.end()) {
+        return it->second;
+    }
+    heap_t& heap = m_heaps[heap_path];
+    if (!m_force_memfd) {
+        heap.heap_fd = dma_heap_open(heap_path);
+    }
+    if (heap.heap_fd < 0) {
+        heap.use_memfd = true;
+        printf("dma pool: %s unavailable, using memfd backend\n", heap_path);
+    }
+    return heap;
+}
+
+int DmaPool::alloc_block(heap_t& heap, size_t size, dma_block_t *block) {
+    if (!heap.use_memfd) {
+        return dma_heap_alloc(heap.heap_fd, size, &block->fd, &block->va);
+    }
+
+    int fd = memfd_create("dma_pool", MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return -1;
+    }
+    void *va = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (va == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    block->fd = fd;
+    block->va = va;
+    return 0;
+}
+
+void DmaPool::free_block(dma_block_t *block) {
+    dma_buf_free(block->size, &block->fd, block->va);
+    block->va = nullptr;
+    block->size = 0;
+}
+
+int DmaPool::acquire(const char *heap_path, size_t size, const char *owner, dma_block_t *block) {
+    size_t class_size = size_class(size);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    dma_owner_stats_t& stats = m_owners[owner];
+    heap_t& heap = get_heap(heap_path);
+
+    auto it = heap.free_lists.find(class_size);
+    if (it != heap.free_lists.end() && !it->second.empty()) {
+        *block = it->second.back().block;
+        it->second.pop_back();
+        m_free_bytes -= class_size;
+        stats.reuses++;
+    } else {
+        dma_block_t new_block;
+        if (alloc_block(heap, class_size, &new_block) < 0) {
+            printf("dma pool: alloc %zu bytes for %s failed\n", class_size, owner);
+            return -1;
+        }
+        new_block.size = class_size;
+        // memfd 不是 dma-buf, 不支持 DMA_BUF_IOCTL_SYNC
+        new_block.cached = !heap.use_memfd && is_cached_heap(heap_path);
+        *block = new_block;
+        m_total_bytes += class_size;
+        stats.allocs++;
+    }
+
+    stats.in_use_bytes += class_size;
+    stats.in_use_blocks++;
+    if (stats.in_use_bytes > stats.peak_bytes) {
+        stats.peak_bytes = stats.in_use_bytes;
+    }
+    return 0;
+}
+
+void DmaPool::release(const char *heap_path, dma_block_t *block, const char *owner) {
+    if (block->va == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    dma_owner_stats_t& stats = m_owners[owner];
+    stats.in_use_bytes -= block->size;
+    stats.in_use_blocks--;
+
+    heap_t& heap = get_heap(heap_path);
+    heap.free_lists[block->size].push_back({*block, get_time_ms()});
+    m_free_bytes += block->size;
+    *block = dma_block_t();
+
+    if (m_free_bytes > m_max_free_bytes) {
+        trim_locked(0, m_max_free_bytes);
+    }
+}
+
+void DmaPool::trim(int idle_ms) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    trim_locked(idle_ms, 0);
+}
+
+// 从大尺寸档开始归还空闲超过 idle_ms 的缓冲, 直到空闲总量不超过 target_free_bytes
+void DmaPool::trim_locked(int idle_ms, size_t target_free_bytes) {
+    int64_t now_ms = get_time_ms();
+    for (auto& item : m_heaps) {
+        auto& free_lists = item.second.free_lists;
+        for (auto it = free_lists.rbegin(); it != free_lists.rend(); ++it) {
+            auto& list = it->second;
+            for (size_t i = 0; i < list.size() && m_free_bytes > target_free_bytes;) {
+                if (now_ms - list[i].idle_since_ms < idle_ms) {
+                    i++;
+                    continue;
+                }
+                m_free_bytes -= list[i].block.size;
+                m_total_bytes -= list[i].block.size;
+                free_block(&list[i].block);
+                list.erase(list.begin() + i);
+            }
+        }
+    }
+}
+
+void DmaPool::dump_stats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    printf("dma pool: total %.1f MB, free %.1f MB\n",
+           m_total_bytes / (1024.0 * 1024.0), m_free_bytes / (1024.0 * 1024.0));
+    for (const auto& item : m_owners) {
+        const dma_owner_stats_t& stats = item.second;
+        printf("  %-12s in use %d blocks %.1f MB, peak %.1f MB, allocs %lu, reuses %lu\n",
+               item.first.c_str(), stats.in_use_blocks, stats.in_use_bytes / (1024.0 * 1024.0),
+               stats.peak_bytes / (1024.0 * 1024.0), stats.allocs, stats.reuses);
+    }
+}
@@ -1,10 +1,19 @@
 #include "encode_video.h"
+#include <rockchip/mpp_meta.h>
 #include <cstring>
+#include <chrono>
+#include <algorithm>
 #include <iostream>
 #define MPP_ALIGN(x, a) (((x) + (a)-1) & ~((a)-1))
 #define SZ_1K (1024)
 #define SZ_2K (SZ_1K * 2)
 #define SZ_4K (SZ_1K * 4)
+#define ENC_OUTPUT_TIMEOUT_MS 100   // 编码线程取包的最长等待
+
+static int64_t GetCurrentTimeUS() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 
 RKEncodeVideo::RKEncodeVideo()
@@ -18,6 +27,7 @@ RKEncodeVideo::~RKEncodeVideo(void) {
 void RKEncodeVideo::Release() {
     m_is_running = false;
     m_is_init = false;
+    m_slot_cv.notify_all();
     if(m_recv_thread.joinable()) {
         m_recv_thread.join();
     }
@@ -31,15 +41,26 @@ void RKEncodeVideo::Release() {
         m_mppcfg = NULL;
     }
 
-    if (nullptr != m_frame_buf) {
-        mpp_buffer_put(m_frame_buf);
-        m_frame_buf = nullptr;
-    }
-    
-    if (nullptr !=  m_pkt_buf) {
-        mpp_buffer_put(m_pkt_buf);
-        m_pkt_buf = nullptr;
+    for (auto& slot : m_slots) {
+        if (nullptr != slot.frame_buf) {
+            mpp_buffer_put(slot.frame_buf);
+            slot.frame_buf = nullptr;
+        }
+        if (nullptr != slot.pkt_buf) {
+            mpp_buffer_put(slot.pkt_buf);
+            slot.pkt_buf = nullptr;
+        }
+        if (nullptr != slot.ext_buf) {
+            mpp_buffer_put(slot.ext_buf);
+            slot.ext_buf = nullptr;
+        }
+        if (slot.release) {
+            slot.release();
+            slot.release = nullptr;
+        }
     }
+    m_slots.clear();
+    m_inflight.clear();
 
     if (nullptr != m_grpbuffer ) {
         mpp_buffer_group_put(m_grpbuffer);
@@ -149,34 +170,16 @@ int RKEncodeVideo::GetHeaderSize(MppFrameFormat frame_format, uint32_t width, ui
     return header_size;
 }
 
-bool RKEncodeVideo::SetMppEncCfg(void)
+int RKEncodeVideo::GetCtuSize()
 {
-    mpp_enc_cfg_set_s32(m_mppcfg, "prep:width", m_enc_info.width);
-    mpp_enc_cfg_set_s32(m_mppcfg, "prep:height", m_enc_info.height);
-    mpp_enc_cfg_set_s32(m_mppcfg, "prep:hor_stride", m_enc_info.hor_stride);
-    mpp_enc_cfg_set_s32(m_mppcfg, "prep:ver_stride", m_enc_info.ver_stride);
-    mpp_enc_cfg_set_s32(m_mppcfg, "prep:format", m_enc_info.frame_format);
-
-    mpp_enc_cfg_set_s32(m_mppcfg, "rc:mode", m_enc_info.rc_mode);
-
-    /* fix input / output m_frame rate */
-    mpp_enc_cfg_set_s32(m_mppcfg, "rc:fps_in_flex", 0);
-    mpp_enc_cfg_set_s32(m_mppcfg, "rc:fps_in_num", m_frame_info.fps);
-    mpp_enc_cfg_set_s32(m_mppcfg, "rc:fps_in_denorm", 1);
-    mpp_enc_cfg_set_s32(m_mppcfg, "rc:fps_out_flex", 0);
-    mpp_enc_cfg_set_s32(m_mppcfg, "rc:fps_out_num", m_frame_info.fps);
-    mpp_enc_cfg_set_s32(m_mppcfg, "rc:fps_out_denorm", 1);
-    mpp_enc_cfg_set_s32(m_mppcfg, "rc:gop", m_stream_info.gop ? m_stream_info.gop : m_frame_info.fps * 2);
-
-    /* drop m_frame or not when bitrate overflow */
-    mpp_enc_cfg_set_u32(m_mppcfg, "rc:drop_mode", MPP_ENC_RC_DROP_FRM_DISABLED);
-    mpp_enc_cfg_set_u32(m_mppcfg, "rc:drop_thd", 20); /* 20% of max bps */
-    mpp_enc_cfg_set_u32(m_mppcfg, "rc:drop_gap", 1); /* Do not continuous drop m_frame */
+    return (MPP_VIDEO_CodingHEVC == m_enc_info.code_type) ? 64 : 16;
+}
 
+void RKEncodeVideo::SetupRcBitrate()
+{
     /* setup bitrate for different rc_mode */
     mpp_enc_cfg_set_s32(m_mppcfg, "rc:bps_target", m_enc_info.bps);
 
-
     switch (m_enc_info.rc_mode) {
     case MPP_ENC_RC_MODE_FIXQP: {
         /* do not setup bitrate on FIXQP mode */
@@ -198,6 +201,52 @@ bool RKEncodeVideo::SetMppEncCfg(void)
         mpp_enc_cfg_set_s32(m_mppcfg, "rc:bps_min", m_enc_info.bps * 15 / 16);
     } break;
     }
+}
+
+bool RKEncodeVideo::SetBitrate(int bps)
+{
+    if (!m_is_init || bps <= 0 || bps == m_enc_info.bps || bps == m_failed_bps) {
+        return false;
+    }
+    int old_bps = m_enc_info.bps;
+    m_enc_info.bps = bps;
+    SetupRcBitrate();
+    if (m_mppapi->control(m_mppctx, MPP_ENC_SET_CFG, m_mppcfg) != MPP_OK) {
+        printf("encoder: set bitrate %d failed, keep %d\n", bps, old_bps);
+        m_enc_info.bps = old_bps;
+        m_failed_bps = bps;
+        SetupRcBitrate();
+        return false;
+    }
+    printf("encoder: bitrate %d -> %d\n", old_bps, bps);
+    return true;
+}
+
+bool RKEncodeVideo::SetMppEncCfg(void)
+{
+    mpp_enc_cfg_set_s32(m_mppcfg, "prep:width", m_enc_info.width);
+    mpp_enc_cfg_set_s32(m_mppcfg, "prep:height", m_enc_info.height);
+    mpp_enc_cfg_set_s32(m_mppcfg, "prep:hor_stride", m_enc_info.hor_stride);
+    mpp_enc_cfg_set_s32(m_mppcfg, "prep:ver_stride", m_enc_info.ver_stride);
+    mpp_enc_cfg_set_s32(m_mppcfg, "prep:format", m_enc_info.frame_format);
+
+    mpp_enc_cfg_set_s32(m_mppcfg, "rc:mode", m_enc_info.rc_mode);
+
+    /* fix input / output m_frame rate */
+    mpp_enc_cfg_set_s32(m_mppcfg, "rc:fps_in_flex", 0);
+    mpp_enc_cfg_set_s32(m_mppcfg, "rc:fps_in_num", m_frame_info.fps);
+    mpp_enc_cfg_set_s32(m_mppcfg, "rc:fps_in_denorm", 1);
+    mpp_enc_cfg_set_s32(m_mppcfg, "rc:fps_out_flex", 0);
+    mpp_enc_cfg_set_s32(m_mppcfg, "rc:fps_out_num", m_frame_info.fps);
+    mpp_enc_cfg_set_s32(m_mppcfg, "rc:fps_out_denorm", 1);
+    mpp_enc_cfg_set_s32(m_mppcfg, "rc:gop", m_stream_info.gop ? m_stream_info.gop : m_frame_info.fps * 2);
+
+    /* drop m_frame or not when bitrate overflow */
+    mpp_enc_cfg_set_u32(m_mppcfg, "rc:drop_mode", MPP_ENC_RC_DROP_FRM_DISABLED);
+    mpp_enc_cfg_set_u32(m_mppcfg, "rc:drop_thd", 20); /* 20% of max bps */
+    mpp_enc_cfg_set_u32(m_mppcfg, "rc:drop_gap", 1); /* Do not continuous drop m_frame */
+
+    SetupRcBitrate();
 
     /* setup qp for different codec and rc_mode */
     switch (m_enc_info.code_type) {
@@ -205,7 +254,7 @@ bool RKEncodeVideo::SetMppEncCfg(void)
     case MPP_VIDEO_CodingHEVC: {
         switch (m_enc_info.rc_mode) {
         case MPP_ENC_RC_MODE_FIXQP: {
-            RK_S32 fix_qp = 0;
+            RK_S32 fix_qp = m_enc_info.qp_init >= 0 ? m_enc_info.qp_init : 26;
             mpp_enc_cfg_set_s32(m_mppcfg, "rc:qp_init", fix_qp);
             mpp_enc_cfg_set_s32(m_mppcfg, "rc:qp_max", fix_qp);
             mpp_enc_cfg_set_s32(m_mppcfg, "rc:qp_min", fix_qp);
@@ -216,11 +265,11 @@ bool RKEncodeVideo::SetMppEncCfg(void)
         case MPP_ENC_RC_MODE_CBR:
         case MPP_ENC_RC_MODE_VBR:
         case MPP_ENC_RC_MODE_AVBR: {
-            mpp_enc_cfg_set_s32(m_mppcfg, "rc:qp_init", -1);
-            mpp_enc_cfg_set_s32(m_mppcfg, "rc:qp_max", 51);
-            mpp_enc_cfg_set_s32(m_mppcfg, "rc:qp_min", 10);
-            mpp_enc_cfg_set_s32(m_mppcfg, "rc:qp_max_i", 51);
-            mpp_enc_cfg_set_s32(m_mppcfg, "rc:qp_min_i", 10);
+            mpp_enc_cfg_set_s32(m_mppcfg, "rc:qp_init", m_enc_info.qp_init);
+            mpp_enc_cfg_set_s32(m_mppcfg, "rc:qp_max", m_enc_info.qp_max);
+            mpp_enc_cfg_set_s32(m_mppcfg, "rc:qp_min", m_enc_info.qp_min);
+            mpp_enc_cfg_set_s32(m_mppcfg, "rc:qp_max_i", m_enc_info.qp_max);
+            mpp_enc_cfg_set_s32(m_mppcfg, "rc:qp_min_i", m_enc_info.qp_min);
             mpp_enc_cfg_set_s32(m_mppcfg, "rc:qp_ip", 2);
         } break;
         default: {
@@ -260,7 +309,7 @@ bool RKEncodeVideo::SetMppEncCfg(void)
          * 77  - Main profile
          * 100 - High profile
          */
-        mpp_enc_cfg_set_s32(m_mppcfg, "h264:profile", 100);
+        mpp_enc_cfg_set_s32(m_mppcfg, "h264:profile", m_stream_info.profile ? m_stream_info.profile : 100);
         /*
          * H.264 level_idc parameter
          * 10 / 11 / 12 / 13    - qcif@15fps / cif@7.5fps / cif@15fps / cif@30fps
@@ -269,13 +318,27 @@ bool RKEncodeVideo::SetMppEncCfg(void)
          * 40 / 41 / 42         - 1080p@30fps / 1080p@30fps / 1080p@60fps
          * 50 / 51 / 52         - 4K@30fps
          */
-        mpp_enc_cfg_set_s32(m_mppcfg, "h264:level", 40);
-        mpp_enc_cfg_set_s32(m_mppcfg, "h264:cabac_en", 1);
+        mpp_enc_cfg_set_s32(m_mppcfg, "h264:level", m_stream_info.level ? m_stream_info.level : 40);
+        /* baseline profile does not support cabac and 8x8 transform */
+        RK_S32 cabac_en = (m_stream_info.profile == 66) ? 0 : 1;
+        mpp_enc_cfg_set_s32(m_mppcfg, "h264:cabac_en", cabac_en);
         mpp_enc_cfg_set_s32(m_mppcfg, "h264:cabac_idc", 0);
-        mpp_enc_cfg_set_s32(m_mppcfg, "h264:trans8x8", 1);
+        mpp_enc_cfg_set_s32(m_mppcfg, "h264:trans8x8", (m_stream_info.profile == 100 || m_stream_info.profile == 0) ? 1 : 0);
 
     } break;
-    case MPP_VIDEO_CodingHEVC:
+    case MPP_VIDEO_CodingHEVC: {
+        /*
+         * H.265 profile / level parameter
+         * profile 1 - Main profile
+         * level_idc = 30 * level, e.g. 120 - level 4 / 123 - level 4.1 / 153 - level 5.1
+         */
+        if (m_stream_info.profile) {
+            mpp_enc_cfg_set_s32(m_mppcfg, "h265:profile", m_stream_info.profile);
+        }
+        if (m_stream_info.level) {
+            mpp_enc_cfg_set_s32(m_mppcfg, "h265:level", m_stream_info.level);
+        }
+    } break;
     case MPP_VIDEO_CodingMJPEG:
     case MPP_VIDEO_CodingVP8: {
     } break;
@@ -285,6 +348,16 @@ bool RKEncodeVideo::SetMppEncCfg(void)
     }
 
 
+    /* low delay mode: split frame into slices and output each slice once it is done */
+    if (m_enc_info.low_latency) {
+        int ctu_size = GetCtuSize();
+        int ctu_per_row = MPP_ALIGN(m_enc_info.width, ctu_size) / ctu_size;
+        int rows = m_enc_info.slice_rows > 0 ? m_enc_info.slice_rows : 1;
+        mpp_enc_cfg_set_u32(m_mppcfg, "split:mode", MPP_ENC_SPLIT_BY_CTU);
+        mpp_enc_cfg_set_u32(m_mppcfg, "split:arg", ctu_per_row * rows);
+        mpp_enc_cfg_set_u32(m_mppcfg, "split:out", MPP_ENC_SPLIT_OUT_LOWDELAY);
+    }
+
     auto ret = m_mppapi->control(m_mppctx, MPP_ENC_SET_CFG, m_mppcfg);
     if (ret){
         return false;
@@ -302,8 +375,9 @@ void RKEncodeVideo::InitMppEnc()
     m_enc_info.frame_size = GetFrameSize(m_enc_info.frame_format, m_frame_info.width, m_enc_info.ver_stride);
     m_enc_info.header_size = GetHeaderSize(m_enc_info.frame_format, m_frame_info.width, m_frame_info.height);
     m_enc_info.mdinfo_size = (MPP_VIDEO_CodingHEVC == m_enc_info.code_type) ? (MPP_ALIGN(m_enc_info.hor_stride, 32) >> 5) * (MPP_ALIGN(m_enc_info.ver_stride, 32) >> 5) * 16 : (MPP_ALIGN(m_enc_info.hor_stride, 64) >> 6) * (MPP_ALIGN(m_enc_info.ver_stride, 16) >> 4) * 16;
-    m_enc_info.bps = m_frame_info.width * m_frame_info.height / 8 * m_frame_info.fps;
-    m_enc_info.rc_mode = MPP_ENC_RC_MODE_VBR;
+    if (m_enc_info.bps <= 0) {
+        m_enc_info.bps = m_frame_info.width * m_frame_info.height / 8 * m_frame_info.fps;
+    }
 }
 
 bool RKEncodeVideo::AllocterDrmbuf()
@@ -314,16 +388,18 @@ bool RKEncodeVideo::AllocterDrmbuf()
         return false;
     }
 
-    ret = mpp_buffer_get(m_grpbuffer, &m_frame_buf, m_enc_info.frame_size + m_enc_info.header_size);
-    if (ret) {
-        // spdlog::error("failed to get buffer for input m_frame ret {}", ret);
-        return false;
-    }
+    for (auto& slot : m_slots) {
+        ret = mpp_buffer_get(m_grpbuffer, &slot.frame_buf, m_enc_info.frame_size + m_enc_info.header_size);
+        if (ret) {
+            // spdlog::error("failed to get buffer for input m_frame ret {}", ret);
+            return false;
+        }
 
-    ret = mpp_buffer_get(m_grpbuffer, &m_pkt_buf, m_enc_info.frame_size);
-    if (ret) {
-        // spdlog::error("failed to get buffer for output packet ret {}", ret);
-        return false;
+        ret = mpp_buffer_get(m_grpbuffer, &slot.pkt_buf, m_enc_info.frame_size);
+        if (ret) {
+            // spdlog::error("failed to get buffer for output packet ret {}", ret);
+            return false;
+        }
     }
     return true;
 }
@@ -346,7 +422,8 @@ bool RKEncodeVideo::InitMppAPI()
         return false;
     }
 
-    timeout = MPP_POLL_BLOCK;
+    // 取包限时等待: 送帧失败时队列中的槽不会有包输出, 编码线程须能退出等待并检查 m_is_running
+    timeout = (MppPollType)ENC_OUTPUT_TIMEOUT_MS;
     ret = m_mppapi->control(m_mppctx, MPP_SET_OUTPUT_TIMEOUT, &timeout);
     if (ret != MPP_SUCCESS){
         return false;
@@ -367,6 +444,14 @@ bool RKEncodeVideo::InitMppAPI()
         return false;
     }
 
+    if (m_enc_info.header_mode == MPP_ENC_HEADER_MODE_EACH_IDR) {
+        MppEncHeaderMode header_mode = MPP_ENC_HEADER_MODE_EACH_IDR;
+        ret = m_mppapi->control(m_mppctx, MPP_ENC_SET_HEADER_MODE, &header_mode);
+        if (ret){
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -390,24 +475,26 @@ void RKEncodeVideo::GetHeaderInfo(SpsHeader *sps_header)
 
 void RKEncodeVideo::EncRecvThread()
 {
-    MppPacket packet = NULL;
     RK_U32 eoi = 1;
 
-    mpp_packet_init_with_buffer(&packet, m_pkt_buf);
-    mpp_packet_set_length(packet, 0);
-
     while (m_is_running)
     {
-        if(m_encode_num == m_put_num){
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            continue;
+        {
+            // 没有在编码中的帧时不取包, 避免阻塞在 encode_get_packet
+            std::unique_lock<std::mutex> lock(m_slot_mutex);
+            m_slot_cv.wait_for(lock, std::chrono::milliseconds(10), [this]() {
+                return !m_inflight.empty() || !m_is_running;
+            });
+            if (m_inflight.empty()) {
+                continue;
+            }
         }
+        MppPacket packet = NULL;
         auto ret = m_mppapi->encode_get_packet(m_mppctx, &packet);
         if (ret || NULL == packet) {
             std::this_thread::sleep_for(std::chrono::milliseconds(3));
             continue;
         }
-        m_encode_num++;
         auto data = (uint8_t*)mpp_packet_get_pos(packet);
         auto len = mpp_packet_get_length(packet);
 
@@ -419,13 +506,76 @@ void RKEncodeVideo::EncRecvThread()
         //  std::cout << "pts:" << pts << "dts:" << dts << std::endl;
          
         /* for low delay partition encoding */
+        eoi = 1;
         if (mpp_packet_is_partition(packet)){
             eoi = mpp_packet_is_eoi(packet);
         }
-        Packaging(data, len);
+
+        // 统计从IDR请求到IDR输出的时间
+        int64_t request_us = m_idr_request_us.load();
+        if (request_us > 0 && mpp_packet_has_meta(packet)) {
+            RK_S32 intra = 0;
+            mpp_meta_get_s32(mpp_packet_get_meta(packet), KEY_OUTPUT_INTRA, &intra);
+            if (intra) {
+                m_idr_request_us = 0;
+                printf("encoder[%d] on-demand IDR out after %.2f ms\n", m_srcindex,
+                       (GetCurrentTimeUS() - request_us) / 1000.0);
+            }
+        }
+        // 按输出包找到对应的槽; 排在它前面的槽已被编码器丢弃或不会再有输出, 一并归还
+        std::vector<int> done;
+        int64_t put_time_us = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_slot_mutex);
+            int pos = FindInflight(packet);
+            if (pos >= 0) {
+                EncBufSlot& slot = m_slots[m_inflight[pos]];
+                put_time_us = slot.put_time_us;
+                m_output_tag = slot.tag;
+                int count = eoi ? pos + 1 : pos;
+                done.assign(m_inflight.begin(), m_inflight.begin() + count);
+                m_inflight.erase(m_inflight.begin(), m_inflight.begin() + count);
+            } else {
+                m_output_tag = 0;
+            }
+        }
+        if (done.size() > (eoi ? 1u : 0u)) {
+            printf("encoder[%d] %zu frame(s) dropped by encoder, slots reclaimed\n", m_srcindex,
+                   done.size() - (eoi ? 1 : 0));
+        }
+        Packaging(data, len, eoi);
         ret = mpp_packet_deinit(&packet);
         // assert(ret == MPP_SUCCESS);
+
+        UpdateLatency(put_time_us, eoi);
+        for (int index : done) {
+            ReleaseSlot(index);
+        }
+        if (eoi) {
+            m_encode_num++;
+        }
+    }
+}
+
+int RKEncodeVideo::FindInflight(MppPacket packet)
+{
+    if (!m_enc_info.low_latency) {
+        // 帧模式下每帧指定了自己的输出缓冲
+        MppBuffer buffer = mpp_packet_get_buffer(packet);
+        for (size_t i = 0; i < m_inflight.size(); i++) {
+            if (m_slots[m_inflight[i]].pkt_buf == buffer) {
+                return i;
+            }
+        }
+    }
+    // 低延迟模式的 slice 由编码器内部分配, 用 pts 中的送入序号匹配
+    uint64_t put_seq = (uint64_t)mpp_packet_get_pts(packet);
+    for (size_t i = 0; i < m_inflight.size(); i++) {
+        if (m_slots[m_inflight[i]].put_seq == put_seq) {
+            return i;
+        }
     }
+    return -1;
 }
 
 
@@ -441,10 +591,34 @@ int RKEncodeVideo::Initencoder(InputInfo& encoderinfo, int srcindex, PacketCallb
     m_frame_info.height = encoderinfo.height;
     m_frame_info.width = encoderinfo.width;
     m_frame_info.format = encoderinfo.format;
-    m_stream_info.StreamType = 0;
-    m_stream_info.gop = encoderinfo.fps * 2;
+    m_stream_info.StreamType = encoderinfo.stream_type;
+    m_stream_info.gop = encoderinfo.gop > 0 ? encoderinfo.gop : encoderinfo.fps * 2;
+    m_stream_info.profile = encoderinfo.profile;
+    m_stream_info.level = encoderinfo.level;
+    m_enc_info.rc_mode = (MppEncRcMode)encoderinfo.rc_mode;
+    m_enc_info.bps = encoderinfo.bps;
+    m_enc_info.qp_init = encoderinfo.qp_init;
+    m_enc_info.qp_min = encoderinfo.qp_min;
+    m_enc_info.qp_max = encoderinfo.qp_max;
+    m_enc_info.low_latency = encoderinfo.low_latency;
+    m_enc_info.slice_rows = encoderinfo.slice_rows;
+    m_enc_info.roi_enable = encoderinfo.roi_enable;
+    m_enc_info.roi_max_regions = encoderinfo.roi_max_regions;
+    m_enc_info.roi_obj_qp = encoderinfo.roi_obj_qp;
+    m_enc_info.roi_bg_qp = encoderinfo.roi_bg_qp;
+    m_enc_info.header_mode = encoderinfo.idr_each_header ? MPP_ENC_HEADER_MODE_EACH_IDR : MPP_ENC_HEADER_MODE_DEFAULT;
+    m_idr_request = false;
+    m_idr_request_us = 0;
+    m_first_slice = true;
+    m_first_slice_us = 0;
+    m_full_frame_us = 0;
+    m_latency_frames = 0;
     m_put_num = 0;
     m_encode_num = 0;
+    m_slots = std::vector<EncBufSlot>(encoderinfo.buf_num > 0 ? encoderinfo.buf_num : 1);
+    m_inflight.clear();
+    m_put_seq = 0;
+    m_next_slot = 0;
     InitMppEnc();
 
     if (!AllocterDrmbuf()){
@@ -479,7 +653,184 @@ int RKEncodeVideo::Initencoder(InputInfo& encoderinfo, int srcindex, PacketCallb
 }
 
 
+int RKEncodeVideo::AcquireSlot()
+{
+    std::unique_lock<std::mutex> lock(m_slot_mutex);
+    int count = m_slots.size();
+    auto found = [&]() {
+        for (int i = 0; i < count; i++) {
+            if (m_slots[(m_next_slot + i) % count].state == ENC_BUF_IDLE) {
+                return true;
+            }
+        }
+        return !m_is_running;
+    };
+    // 缓冲环满时等待编码线程归还, 超时说明编码器异常
+    if (!m_slot_cv.wait_for(lock, std::chrono::seconds(1), found) || !m_is_running) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        int index = (m_next_slot + i) % count;
+        if (m_slots[index].state == ENC_BUF_IDLE) {
+            m_slots[index].state = ENC_BUF_ENCODING;
+            m_next_slot = (index + 1) % count;
+            return index;
+        }
+    }
+    return -1;
+}
+
+int RKEncodeVideo::PutSlot(int index, MppBuffer buffer)
+{
+    EncBufSlot& slot = m_slots[index];
+    MppFrame frame = nullptr;
+    auto ret = mpp_frame_init(&frame);
+    if (ret){
+        return 3;
+    }
+    mpp_frame_set_width(frame, m_enc_info.width);
+    mpp_frame_set_height(frame, m_enc_info.height);
+    mpp_frame_set_hor_stride(frame, m_enc_info.hor_stride);
+    mpp_frame_set_ver_stride(frame, m_enc_info.ver_stride);
+    mpp_frame_set_fmt(frame, m_enc_info.frame_format);
+    mpp_frame_set_eos(frame, 0);
+    mpp_frame_set_buffer(frame, buffer);
+    // 编码器把帧的 pts 带到输出包(含每个slice), 用来把输出包对应回缓冲槽
+    slot.put_seq = ++m_put_seq;
+    mpp_frame_set_pts(frame, (RK_S64)slot.put_seq);
+
+    // 指定本帧的输出缓冲, 输出包与输入帧一一对应
+    // 低延迟模式下一帧输出多个slice包, 由编码器内部分配
+    MppPacket packet = nullptr;
+    if (!m_enc_info.low_latency) {
+        mpp_packet_init_with_buffer(&packet, slot.pkt_buf);
+        mpp_packet_set_length(packet, 0);
+        MppMeta meta = mpp_frame_get_meta(frame);
+        mpp_meta_set_packet(meta, KEY_OUTPUT_PACKET, packet);
+    }
+    if (slot.roi_cfg.number > 0) {
+        MppMeta meta = mpp_frame_get_meta(frame);
+        mpp_meta_set_ptr(meta, KEY_ROI_DATA, (void*)&slot.roi_cfg);
+    }
+    // 新观众请求的IDR随本帧送入编码器
+    bool idr = m_idr_request.exchange(false);
+    if (idr) {
+        MppMeta meta = mpp_frame_get_meta(frame);
+        mpp_meta_set_s32(meta, KEY_INPUT_IDR_REQ, 1);
+    }
+
+    {
+        // 先入队再送帧, 保证编码线程取到包时能找到对应的槽
+        std::lock_guard<std::mutex> lock(m_slot_mutex);
+        slot.put_time_us = GetCurrentTimeUS();
+        m_inflight.push_back(index);
+    }
+    ret = m_mppapi->encode_put_frame(m_mppctx, frame);
+    if (ret != MPP_SUCCESS){
+        {
+            std::lock_guard<std::mutex> lock(m_slot_mutex);
+            m_inflight.pop_back();
+        }
+        if (packet) {
+            mpp_packet_deinit(&packet);
+        }
+        mpp_frame_deinit(&frame);
+        if (idr) {
+            m_idr_request = true;
+        }
+        return 4;
+    }
+    m_put_num++;
+    mpp_frame_deinit(&frame);
+    m_slot_cv.notify_all();
+    return 0;
+}
+
+void RKEncodeVideo::ReleaseSlot(int index)
+{
+    BufferReleaseCallback release;
+    {
+        std::lock_guard<std::mutex> lock(m_slot_mutex);
+        EncBufSlot& slot = m_slots[index];
+        if (nullptr != slot.ext_buf) {
+            mpp_buffer_put(slot.ext_buf);
+            slot.ext_buf = nullptr;
+        }
+        release.swap(slot.release);
+        slot.state = ENC_BUF_IDLE;
+    }
+    // 归还回调在锁外执行, 回调中可以再次推帧
+    if (release) {
+        release();
+    }
+    m_slot_cv.notify_all();
+}
+
+void RKEncodeVideo::SetupSlotRoi(int index, const std::vector<EncRoiRect>& rois)
+{
+    EncBufSlot& slot = m_slots[index];
+    slot.roi_regions.clear();
+    slot.roi_cfg.number = 0;
+    slot.roi_cfg.regions = nullptr;
+    if (!m_enc_info.roi_enable || rois.empty() || m_enc_info.roi_max_regions <= 0) {
+        return;
+    }
+
+    int align = GetCtuSize();
+    int width = m_enc_info.width;
+    int height = m_enc_info.height;
+    int max_regions = m_enc_info.roi_max_regions;
+
+    // 背景区域放在最前面, 后面的目标区域覆盖它
+    if (m_enc_info.roi_bg_qp != 0 && max_regions > 1) {
+        MppEncROIRegion bg;
+        memset(&bg, 0, sizeof(bg));
+        bg.w = MPP_ALIGN(width, align);
+        bg.h = MPP_ALIGN(height, align);
+        bg.quality = m_enc_info.roi_bg_qp;
+        bg.area_map_en = 1;
+        slot.roi_regions.push_back(bg);
+    }
+
+    // 区域数超限时优先保留面积大的目标
+    std::vector<EncRoiRect> sorted(rois);
+    std::sort(sorted.begin(), sorted.end(), [](const EncRoiRect& a, const EncRoiRect& b) {
+        return a.w * a.h > b.w * b.h;
+    });
+    for (const auto& r : sorted) {
+        if ((int)slot.roi_regions.size() >= max_regions) {
+            break;
+        }
+        int x0 = std::max(0, std::min(r.x, width - 1)) / align * align;
+        int y0 = std::max(0, std::min(r.y, height - 1)) / align * align;
+        int x1 = MPP_ALIGN(std::max(0, std::min(r.x + r.w, width)), align);
+        int y1 = MPP_ALIGN(std::max(0, std::min(r.y + r.h, height)), align);
+        if (x1 <= x0 || y1 <= y0) {
+            continue;
+        }
+        MppEncROIRegion region;
+        memset(&region, 0, sizeof(region));
+        region.x = x0;
+        region.y = y0;
+        region.w = x1 - x0;
+        region.h = y1 - y0;
+        region.quality = m_enc_info.roi_obj_qp;
+        region.area_map_en = 1;
+        slot.roi_regions.push_back(region);
+    }
+
+    if (!slot.roi_regions.empty()) {
+        slot.roi_cfg.number = slot.roi_regions.size();
+        slot.roi_cfg.regions = slot.roi_regions.data();
+    }
+}
+
 int RKEncodeVideo::WriteData(const uint8_t *data,int size)
+{
+    return WriteData(data, size, std::vector<EncRoiRect>());
+}
+
+int RKEncodeVideo::WriteData(const uint8_t *data,int size, const std::vector<EncRoiRect>& rois, uint64_t tag)
 {
     if(!m_is_init) {
         return -1;
@@ -487,31 +838,72 @@ int RKEncodeVideo::WriteData(const uint8_t *data,int size)
     if (nullptr == data){
         return 1;
     }
-    void *buf = mpp_buffer_get_ptr(m_frame_buf);
+    int index = AcquireSlot();
+    if (index < 0) {
+        return 5;
+    }
+    MppBuffer frame_buf = m_slots[index].frame_buf;
+    void *buf = mpp_buffer_get_ptr(frame_buf);
     if (nullptr == buf){
-         return 2;
+        ReleaseSlot(index);
+        return 2;
     }
     memcpy(buf,data,size);
-    auto ret = mpp_frame_init(&m_frame);
-    if (ret){
-        return 3;
+    SetupSlotRoi(index, rois);
+    m_slots[index].tag = tag;
+    int ret = PutSlot(index, frame_buf);
+    if (ret != 0) {
+        ReleaseSlot(index);
     }
-    mpp_frame_set_width(m_frame, m_enc_info.width);
-    mpp_frame_set_height(m_frame, m_enc_info.height);
-    mpp_frame_set_hor_stride(m_frame, m_enc_info.hor_stride);
-    mpp_frame_set_ver_stride(m_frame, m_enc_info.ver_stride);
-    mpp_frame_set_fmt(m_frame, m_enc_info.frame_format);
-    mpp_frame_set_eos(m_frame, 0);
-    mpp_frame_set_buffer(m_frame, m_frame_buf);
+    return ret;
+}
 
-    ret = m_mppapi->encode_put_frame(m_mppctx, m_frame);
-    if (ret != MPP_SUCCESS){
-        mpp_frame_deinit(&m_frame);
-        return 4;
+int RKEncodeVideo::WriteDmaData(int fd, int size, const std::vector<EncRoiRect>& rois, BufferReleaseCallback release,
+                                uint64_t tag)
+{
+    if(!m_is_init) {
+        if (release) {
+            release();
+        }
+        return -1;
     }
-    m_put_num++;
-    mpp_frame_deinit(&m_frame);
-    return 0;
+    if (fd < 0){
+        if (release) {
+            release();
+        }
+        return 1;
+    }
+    int index = AcquireSlot();
+    if (index < 0) {
+        if (release) {
+            release();
+        }
+        return 5;
+    }
+
+    MppBufferInfo info;
+    memset(&info, 0, sizeof(info));
+    info.type = MPP_BUFFER_TYPE_EXT_DMA;
+    info.fd = fd;
+    info.size = size;
+    MppBuffer ext_buf = nullptr;
+    auto ret = mpp_buffer_import(&ext_buf, &info);
+    {
+        std::lock_guard<std::mutex> lock(m_slot_mutex);
+        m_slots[index].ext_buf = ext_buf;
+        m_slots[index].release = release;
+    }
+    if (ret != MPP_SUCCESS || nullptr == ext_buf) {
+        ReleaseSlot(index);
+        return 2;
+    }
+    SetupSlotRoi(index, rois);
+    m_slots[index].tag = tag;
+    int put = PutSlot(index, ext_buf);
+    if (put != 0) {
+        ReleaseSlot(index);
+    }
+    return put;
 }
 
 void RKEncodeVideo::EndEncode()
@@ -520,11 +912,50 @@ void RKEncodeVideo::EndEncode()
     Release();
 }
 
- void RKEncodeVideo::Packaging(uint8_t* data,uint32_t size)
+ void RKEncodeVideo::Packaging(uint8_t* data,uint32_t size, bool eoi)
  {
      if (m_callback) {
         uint32_t pts = m_frame_index * 1000 / m_frame_info.fps;
         m_callback(data, size, pts, m_userdata);
+    }
+    if (eoi) {
         m_frame_index++;
     }
- }
\ No newline at end of file
+ }
+
+void RKEncodeVideo::RequestIDR()
+{
+    int64_t expected = 0;
+    m_idr_request_us.compare_exchange_strong(expected, GetCurrentTimeUS());
+    m_idr_request = true;
+}
+
+void RKEncodeVideo::UpdateLatency(int64_t put_time_us, bool eoi)
+{
+    if (put_time_us <= 0) {
+        return;
+    }
+    int64_t cost = GetCurrentTimeUS() - put_time_us;
+    if (m_first_slice) {
+        m_first_slice_us += cost;
+        m_first_slice = false;
+    }
+    if (!eoi) {
+        return;
+    }
+    m_full_frame_us += cost;
+    m_first_slice = true;
+    m_latency_frames++;
+
+    // 每10秒输出一次平均编码延迟
+    int report_frames = m_frame_info.fps > 0 ? m_frame_info.fps * 10 : 300;
+    if (m_latency_frames >= report_frames) {
+        printf("encoder[%d] %s latency: first slice %.2f ms, full frame %.2f ms\n", m_srcindex,
+               m_enc_info.low_latency ? "low-delay" : "frame",
+               m_first_slice_us / 1000.0 / m_latency_frames,
+               m_full_frame_us / 1000.0 / m_latency_frames);
+        m_first_slice_us = 0;
+        m_full_frame_us = 0;
+        m_latency_frames = 0;
+    }
+}
\ No newline at end of file
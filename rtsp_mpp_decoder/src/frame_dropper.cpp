@@ -0,0 +1,87 @@
+#include "frame_dropper.h"
+
+#include <stdio.h>
+
+void FrameDropper::report_load(bool busy) {
+    // 约 30 帧的滑动平均
+    float load = m_load.load() * 0.97f + (busy ? 0.03f : 0.0f);
+    m_load = load;
+
+    int level = m_load_level.load();
+    if(level == DROP_OFF && load > m_config.non_ref_load) {
+        level = DROP_NON_REF;
+    } else if(level == DROP_NON_REF && load > m_config.key_only_load) {
+        level = DROP_KEY_ONLY;
+    } else if(level != DROP_OFF && load < m_config.recover_load) {
+        level = level == DROP_KEY_ONLY ? DROP_NON_REF : DROP_OFF;
+    } else {
+        return;
+    }
+    m_load_level = level;
+    printf("decoder overload level %d (load %.2f)\n", level, load);
+}
+
+int FrameDropper::target_level() const {
+    switch(m_config.mode) {
+    case DROP_OFF:
+    case DROP_NON_REF:
+    case DROP_KEY_ONLY:
+        return m_config.mode;
+    default:
+        return m_load_level.load();
+    }
+}
+
+bool FrameDropper::should_drop(eNalCodec codec, const uint8_t *data, size_t size) {
+    if(m_config.mode == DROP_OFF) {
+        return false;
+    }
+    nal_packet_info_t info = nal_inspect_packet(codec, data, size);
+    if(!info.has_vcl) {
+        // 参数集/SEI 等始终送入解码器
+        return false;
+    }
+    m_total++;
+    if(info.temporal_id > m_max_temporal_id) {
+        m_max_temporal_id = info.temporal_id;
+    }
+
+    // 升级立即生效; 从只解码关键帧恢复时参考帧已丢失, 需等到下一个关键帧
+    int level = target_level();
+    if(info.is_keyframe) {
+        m_active_level = level;
+        m_waiting_key = false;
+        return false;
+    }
+    if(m_active_level == DROP_KEY_ONLY) {
+        m_waiting_key = level < DROP_KEY_ONLY;
+    } else {
+        m_active_level = level;
+    }
+
+    if(m_waiting_key) {
+        m_wait_key++;
+        return true;
+    }
+    if(m_active_level == DROP_KEY_ONLY) {
+        m_key_only++;
+        return true;
+    }
+    if(m_active_level == DROP_NON_REF) {
+        // 非参考帧, 以及 H.265 最高时域层(不会被更低层参考)
+        if(!info.is_reference || (m_max_temporal_id > 0 && info.temporal_id == m_max_temporal_id)) {
+            m_non_ref++;
+            return true;
+        }
+    }
+    return false;
+}
+
+drop_stats_t FrameDropper::get_stats() const {
+    drop_stats_t stats;
+    stats.total = m_total.load();
+    stats.non_ref = m_non_ref.load();
+    stats.key_only = m_key_only.load();
+    stats.wait_key = m_wait_key.load();
+    return stats;
+}
@@ -0,0 +1,416 @@
+#include "frame_export.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "dma_alloc.h"
+
+#define FRAME_EXPORT_OWNER "frame_export"
+
+static_assert(sizeof(frame_export_header_t) == FRAME_EXPORT_HEADER_SIZE, "frame export header size");
+static_assert(sizeof(frame_export_desc_t) == 64, "frame export desc size");
+
+static int64_t monotonic_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 发送一条消息, fd >= 0 时通过 SCM_RIGHTS 附带
+static bool send_msg(int sock, const frame_export_msg_t& msg, int fd) {
+    struct iovec iov;
+    iov.iov_base = (void *)&msg;
+    iov.iov_len = sizeof(msg);
+
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    if (fd >= 0) {
+        memset(control, 0, sizeof(control));
+        hdr.msg_control = control;
+        hdr.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    return sendmsg(sock, &hdr, MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)sizeof(msg);
+}
+
+FrameExporter::~FrameExporter() {
+    release();
+}
+
+int FrameExporter::initialize(const FrameExportConfig& config) {
+    m_config = config;
+    if (m_config.max_consumers < 1) {
+        m_config.max_consumers = 1;
+    }
+    if (m_config.max_leases < 1) {
+        m_config.max_leases = 1;
+    }
+    // 每个客户端租约用满时仍留有空闲缓冲给其他客户端
+    int max_buffers = m_config.max_consumers * m_config.max_leases + 2;
+
+    // 描述符表, 客户端拿到的是只读 fd
+    m_desc_fd = memfd_create("frame_export_desc", MFD_CLOEXEC);
+    m_desc_map_size = FRAME_EXPORT_HEADER_SIZE + max_buffers * sizeof(frame_export_desc_t);
+    if (m_desc_fd < 0 || ftruncate(m_desc_fd, m_desc_map_size) != 0) {
+        printf("frame export: memfd failed: %s\n", strerror(errno));
+        release();
+        return -1;
+    }
+    void *map = mmap(nullptr, m_desc_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_desc_fd, 0);
+    if (map == MAP_FAILED) {
+        printf("frame export: mmap failed: %s\n", strerror(errno));
+        release();
+        return -1;
+    }
+    m_header = (frame_export_header_t *)map;
+    m_descs = (frame_export_desc_t *)((uint8_t *)map + FRAME_EXPORT_HEADER_SIZE);
+    m_header->magic = FRAME_EXPORT_MAGIC;
+    m_header->version = FRAME_EXPORT_VERSION;
+    m_header->max_buffers = max_buffers;
+    m_header->desc_size = sizeof(frame_export_desc_t);
+    m_buffers.resize(max_buffers);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (m_config.socket_path.size() >= sizeof(addr.sun_path)) {
+        printf("frame export: socket path too long: %s\n", m_config.socket_path.c_str());
+        release();
+        return -1;
+    }
+    strcpy(addr.sun_path, m_config.socket_path.c_str());
+    unlink(m_config.socket_path.c_str());
+
+    m_listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (m_listen_fd < 0 || bind(m_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(m_listen_fd, m_config.max_consumers) < 0 || pipe2(m_wake_fd, O_CLOEXEC) != 0) {
+        printf("frame export: listen on %s failed: %s\n", m_config.socket_path.c_str(), strerror(errno));
+        release();
+        return -1;
+    }
+
+    m_is_running = true;
+    m_io_thread = std::thread(&FrameExporter::io_func, this);
+    printf("frame export: %s, max consumers %d, max leases %d, %d buffers\n",
+           m_config.socket_path.c_str(), m_config.max_consumers, m_config.max_leases, max_buffers);
+    return 0;
+}
+
+void FrameExporter::release() {
+    if (m_is_running.exchange(false)) {
+        char c = 0;
+        if (write(m_wake_fd[1], &c, 1) < 0) {
+            printf("frame export: wake io thread failed\n");
+        }
+        if (m_io_thread.joinable()) {
+            m_io_thread.join();
+        }
+        frame_export_stats_t stats = get_stats();
+        printf("frame export stopped: exported=%lu delivered=%lu dropped=%lu no_buffer=%lu\n",
+               stats.exported, stats.delivered, stats.dropped, stats.no_buffer);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& consumer : m_consumers) {
+        close(consumer.fd);
+    }
+    m_consumers.clear();
+    m_consumer_count = 0;
+    for (auto& buffer : m_buffers) {
+        if (buffer.block.fd >= 0) {
+            DmaPool::getInstance().release(DmaPool::getInstance().default_heap().c_str(), &buffer.block, FRAME_EXPORT_OWNER);
+        }
+    }
+    m_buffers.clear();
+
+    if (m_listen_fd >= 0) {
+        close(m_listen_fd);
+        m_listen_fd = -1;
+        unlink(m_config.socket_path.c_str());
+    }
+    for (int& fd : m_wake_fd) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (m_header != nullptr) {
+        munmap(m_header, m_desc_map_size);
+        m_header = nullptr;
+        m_descs = nullptr;
+    }
+    if (m_desc_fd >= 0) {
+        close(m_desc_fd);
+        m_desc_fd = -1;
+    }
+}
+
+int FrameExporter::pick_buffer_locked(size_t size) {
+    int count = m_buffers.size();
+    for (int i = 0; i < count; i++) {
+        int id = (m_next_buffer + i) % count;
+        export_buffer_t& buffer = m_buffers[id];
+        if (buffer.refs != 0) {
+            continue;
+        }
+        if (buffer.block.fd < 0 || buffer.block.size < size) {
+            // 首次使用或分辨率变大, 重新分配, generation 变化后客户端会收到新的 fd
+            const char *heap = DmaPool::getInstance().default_heap().c_str();
+            if (buffer.block.fd >= 0) {
+                DmaPool::getInstance().release(heap, &buffer.block, FRAME_EXPORT_OWNER);
+            }
+            if (DmaPool::getInstance().acquire(heap, size, FRAME_EXPORT_OWNER, &buffer.block) < 0) {
+                buffer.block = dma_block_t();
+                return -1;
+            }
+            buffer.generation++;
+        }
+        m_next_buffer = (id + 1) % count;
+        return id;
+    }
+    return -1;
+}
+
+bool FrameExporter::send_buffer(consumer_t& consumer, int id) {
+    const export_buffer_t& buffer = m_buffers[id];
+    if (consumer.sent_generation[id] == buffer.generation) {
+        return true;
+    }
+    frame_export_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = FRAME_EXPORT_MSG_BUFFER;
+    msg.buffer_id = id;
+    msg.generation = buffer.generation;
+    msg.size = buffer.block.size;
+    if (!send_msg(consumer.fd, msg, buffer.block.fd)) {
+        return false;
+    }
+    consumer.sent_generation[id] = buffer.generation;
+    return true;
+}
+
+void FrameExporter::publish(const void *data, int width, int height, int hor_stride, int ver_stride,
+                            uint64_t frame_seq, int64_t pts) {
+    if (m_consumer_count.load() == 0) {
+        return;
+    }
+    size_t size = (size_t)hor_stride * ver_stride * 3 / 2;
+
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // 所有客户端租约都满时不拷贝
+        bool wanted = false;
+        for (const auto& consumer : m_consumers) {
+            wanted |= consumer.leases < m_config.max_leases;
+        }
+        if (!wanted) {
+            for (auto& consumer : m_consumers) {
+                consumer.dropped++;
+            }
+            m_stats.dropped += m_consumers.size();
+            return;
+        }
+        id = pick_buffer_locked(size);
+        if (id < 0) {
+            m_stats.no_buffer++;
+            return;
+        }
+        // 拷贝期间写端持有一次引用, 缓冲不会被选中或回收
+        m_buffers[id].refs = 1;
+    }
+
+    export_buffer_t& buffer = m_buffers[id];
+    if (buffer.block.cached) {
+        dma_sync_device_to_cpu(buffer.block.fd);
+    }
+    memcpy(buffer.block.va, data, size);
+    if (buffer.block.cached) {
+        dma_sync_cpu_to_device(buffer.block.fd);
+    }
+    frame_export_desc_t *desc = &m_descs[id];
+    desc->generation = buffer.generation;
+    desc->format = FRAME_EXPORT_FMT_NV12;
+    desc->width = width;
+    desc->height = height;
+    desc->hor_stride = hor_stride;
+    desc->ver_stride = ver_stride;
+    desc->size = size;
+    desc->frame_seq = frame_seq;
+    desc->pts = pts;
+    desc->timestamp_us = monotonic_us();
+    __atomic_store_n(&m_header->last_frame_seq, frame_seq, __ATOMIC_RELEASE);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.exported++;
+    frame_export_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = FRAME_EXPORT_MSG_FRAME;
+    msg.buffer_id = id;
+    msg.generation = buffer.generation;
+    msg.frame_seq = frame_seq;
+    msg.size = size;
+    for (auto& consumer : m_consumers) {
+        // 租约用满、发送缓冲满(EAGAIN)或对端已断开都只丢这一个客户端的这一帧
+        if (consumer.leases >= m_config.max_leases || !send_buffer(consumer, id) || !send_msg(consumer.fd, msg, -1)) {
+            consumer.dropped++;
+            m_stats.dropped++;
+            continue;
+        }
+        consumer.leased[id] = 1;
+        consumer.leases++;
+        consumer.delivered++;
+        m_stats.delivered++;
+        buffer.refs++;
+    }
+    buffer.refs--;
+}
+
+frame_export_stats_t FrameExporter::get_stats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    frame_export_stats_t stats = m_stats;
+    for (const auto& consumer : m_consumers) {
+        stats.leased += consumer.fd >= 0 ? consumer.leases : 0;
+    }
+    return stats;
+}
+
+void FrameExporter::accept_consumer() {
+    int fd = accept4(m_listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if ((int)m_consumers.size() >= m_config.max_consumers) {
+        printf("frame export: too many consumers, reject\n");
+        close(fd);
+        return;
+    }
+
+    // 通过 /proc 重新以只读方式打开描述符表, 客户端无法改写
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", m_desc_fd);
+    int ro_fd = open(path, O_RDONLY | O_CLOEXEC);
+    frame_export_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = FRAME_EXPORT_MSG_HELLO;
+    msg.buffer_id = m_buffers.size();
+    msg.size = m_desc_map_size;
+    bool ok = ro_fd >= 0 && send_msg(fd, msg, ro_fd);
+    if (ro_fd >= 0) {
+        close(ro_fd);
+    }
+    if (!ok) {
+        close(fd);
+        return;
+    }
+
+    consumer_t consumer;
+    consumer.fd = fd;
+    consumer.sent_generation.assign(m_buffers.size(), 0);
+    consumer.leased.assign(m_buffers.size(), 0);
+    m_consumers.push_back(std::move(consumer));
+    m_consumer_count = m_consumers.size();
+    printf("frame export: consumer connected, %d total\n", m_consumer_count.load());
+}
+
+void FrameExporter::drop_consumer_locked(consumer_t& consumer) {
+    // 断开时归还该客户端的全部租约
+    for (size_t id = 0; id < consumer.leased.size(); id++) {
+        if (consumer.leased[id]) {
+            m_buffers[id].refs--;
+        }
+    }
+    printf("frame export: consumer disconnected, delivered=%lu dropped=%lu\n", consumer.delivered, consumer.dropped);
+    close(consumer.fd);
+    consumer.fd = -1;
+}
+
+void FrameExporter::handle_consumer(consumer_t& consumer) {
+    frame_export_msg_t msg;
+    for (;;) {
+        ssize_t len = recv(consumer.fd, &msg, sizeof(msg), MSG_DONTWAIT);
+        if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        if (len <= 0) {
+            drop_consumer_locked(consumer);
+            return;
+        }
+        if (len != sizeof(msg) || msg.type != FRAME_EXPORT_MSG_RELEASE) {
+            continue;
+        }
+        // 重复或无效的归还直接忽略
+        if (msg.buffer_id < consumer.leased.size() && consumer.leased[msg.buffer_id]) {
+            consumer.leased[msg.buffer_id] = 0;
+            consumer.leases--;
+            m_buffers[msg.buffer_id].refs--;
+        }
+    }
+}
+
+void FrameExporter::io_func() {
+    std::vector<struct pollfd> fds;
+    while (m_is_running) {
+        fds.clear();
+        fds.push_back({m_wake_fd[0], POLLIN, 0});
+        fds.push_back({m_listen_fd, POLLIN, 0});
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const auto& consumer : m_consumers) {
+                fds.push_back({consumer.fd, POLLIN, 0});
+            }
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("frame export: poll failed: %s\n", strerror(errno));
+            break;
+        }
+        if (fds[0].revents) {
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            accept_consumer();
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 2; i < fds.size(); i++) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            // 只有本线程增删客户端, 按 fd 查找即可
+            for (auto& consumer : m_consumers) {
+                if (consumer.fd == fds[i].fd) {
+                    handle_consumer(consumer);
+                    break;
+                }
+            }
+        }
+        size_t before = m_consumers.size();
+        for (auto it = m_consumers.begin(); it != m_consumers.end();) {
+            it = it->fd < 0 ? m_consumers.erase(it) : it + 1;
+        }
+        if (m_consumers.size() != before) {
+            m_consumer_count = m_consumers.size();
+        }
+    }
+}
@@ -0,0 +1,244 @@
+#include "frame_export_client.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/dma-buf.h>
+
+typedef struct {
+    int fd;
+    void *va;
+    size_t size;
+    uint32_t generation;
+} client_buffer_t;
+
+struct frame_export_client {
+    int sock;
+    const uint8_t *desc_map;
+    size_t desc_map_size;
+    uint32_t max_buffers;
+    client_buffer_t *buffers;
+};
+
+/* 接收一条消息, 附带的 fd 通过 fd_out 返回(没有时为 -1) */
+static int recv_msg(int sock, frame_export_msg_t *msg, int *fd_out) {
+    struct iovec iov;
+    iov.iov_base = msg;
+    iov.iov_len = sizeof(*msg);
+
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+
+    *fd_out = -1;
+    ssize_t len;
+    do {
+        len = recvmsg(sock, &hdr, MSG_CMSG_CLOEXEC);
+    } while (len < 0 && errno == EINTR);
+    if (len <= 0) {
+        return -1;
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(fd_out, CMSG_DATA(cmsg), sizeof(int));
+    }
+    if (len != sizeof(*msg)) {
+        if (*fd_out >= 0) {
+            close(*fd_out);
+            *fd_out = -1;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static void unmap_buffer(client_buffer_t *buffer) {
+    if (buffer->va != NULL) {
+        munmap(buffer->va, buffer->size);
+        buffer->va = NULL;
+    }
+    if (buffer->fd >= 0) {
+        close(buffer->fd);
+        buffer->fd = -1;
+    }
+}
+
+static void dma_sync(int fd, uint64_t flags) {
+    /* memfd 不支持, 忽略错误 */
+    struct dma_buf_sync sync;
+    sync.flags = flags;
+    ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+}
+
+frame_export_client_t *frame_export_connect(const char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        return NULL;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return NULL;
+    }
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(sock);
+        return NULL;
+    }
+
+    frame_export_msg_t msg;
+    int desc_fd;
+    if (recv_msg(sock, &msg, &desc_fd) != 0 || msg.type != FRAME_EXPORT_MSG_HELLO || desc_fd < 0) {
+        if (desc_fd >= 0) {
+            close(desc_fd);
+        }
+        close(sock);
+        return NULL;
+    }
+    void *map = mmap(NULL, msg.size, PROT_READ, MAP_SHARED, desc_fd, 0);
+    close(desc_fd);
+    if (map == MAP_FAILED) {
+        close(sock);
+        return NULL;
+    }
+    const frame_export_header_t *header = (const frame_export_header_t *)map;
+    if (header->magic != FRAME_EXPORT_MAGIC || header->version != FRAME_EXPORT_VERSION ||
+        header->desc_size != sizeof(frame_export_desc_t) || header->max_buffers != msg.buffer_id) {
+        munmap(map, msg.size);
+        close(sock);
+        return NULL;
+    }
+
+    frame_export_client_t *client = (frame_export_client_t *)calloc(1, sizeof(*client));
+    client_buffer_t *buffers = (client_buffer_t *)calloc(header->max_buffers, sizeof(*buffers));
+    if (client == NULL || buffers == NULL) {
+        free(client);
+        free(buffers);
+        munmap(map, msg.size);
+        close(sock);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < header->max_buffers; i++) {
+        buffers[i].fd = -1;
+    }
+    client->sock = sock;
+    client->desc_map = (const uint8_t *)map;
+    client->desc_map_size = msg.size;
+    client->max_buffers = header->max_buffers;
+    client->buffers = buffers;
+    return client;
+}
+
+void frame_export_close(frame_export_client_t *client) {
+    if (client == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < client->max_buffers; i++) {
+        unmap_buffer(&client->buffers[i]);
+    }
+    free(client->buffers);
+    munmap((void *)client->desc_map, client->desc_map_size);
+    close(client->sock);
+    free(client);
+}
+
+int frame_export_next(frame_export_client_t *client, frame_export_frame_t *frame, int timeout_ms) {
+    for (;;) {
+        struct pollfd pfd = {client->sock, POLLIN, 0};
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret == 0) {
+            return 0;
+        }
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        frame_export_msg_t msg;
+        int fd;
+        if (recv_msg(client->sock, &msg, &fd) != 0) {
+            return -1;
+        }
+        if (msg.buffer_id >= client->max_buffers) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            continue;
+        }
+        client_buffer_t *buffer = &client->buffers[msg.buffer_id];
+
+        if (msg.type == FRAME_EXPORT_MSG_BUFFER) {
+            /* 新缓冲或重新分配的缓冲, 替换旧映射 */
+            unmap_buffer(buffer);
+            if (fd < 0) {
+                continue;
+            }
+            void *va = mmap(NULL, msg.size, PROT_READ, MAP_SHARED, fd, 0);
+            if (va == MAP_FAILED) {
+                close(fd);
+                continue;
+            }
+            buffer->fd = fd;
+            buffer->va = va;
+            buffer->size = msg.size;
+            buffer->generation = msg.generation;
+            continue;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (msg.type != FRAME_EXPORT_MSG_FRAME) {
+            continue;
+        }
+
+        const frame_export_desc_t *desc = (const frame_export_desc_t *)
+            (client->desc_map + FRAME_EXPORT_HEADER_SIZE + msg.buffer_id * sizeof(frame_export_desc_t));
+        frame->buffer_id = msg.buffer_id;
+        frame->fd = -1;
+        frame->data = NULL;
+        frame->desc = *desc;
+        if (buffer->va == NULL || buffer->generation != msg.generation || frame->desc.size > buffer->size) {
+            /* 缓冲映射失败, 直接归还 */
+            frame_export_release(client, frame);
+            continue;
+        }
+        frame->fd = buffer->fd;
+        frame->data = buffer->va;
+        dma_sync(buffer->fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ);
+        return 1;
+    }
+}
+
+int frame_export_release(frame_export_client_t *client, const frame_export_frame_t *frame) {
+    if (frame->buffer_id >= client->max_buffers) {
+        return -1;
+    }
+    client_buffer_t *buffer = &client->buffers[frame->buffer_id];
+    if (buffer->fd >= 0 && buffer->fd == frame->fd) {
+        dma_sync(buffer->fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+    }
+    frame_export_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = FRAME_EXPORT_MSG_RELEASE;
+    msg.buffer_id = frame->buffer_id;
+    msg.frame_seq = frame->desc.frame_seq;
+    return send(client->sock, &msg, sizeof(msg), MSG_NOSIGNAL) == sizeof(msg) ? 0 : -1;
+}
+
+int frame_export_socket(const frame_export_client_t *client) {
+    return client->sock;
+}
@@ -0,0 +1,177 @@
+#include "frame_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define HUGE_PAGE_SIZE  (2 * 1024 * 1024)
+
+enum {
+    PAGE_KIND_HUGETLB = 0,
+    PAGE_KIND_THP,
+    PAGE_KIND_NORMAL,
+};
+
+FramePool::FramePool() {
+    // perf 计数器需在工作线程创建前打开, inherit 才能覆盖之后创建的线程
+    open_tlb_counter();
+}
+
+FramePool::~FramePool() {
+    for (auto& item : m_free_lists) {
+        for (uint8_t *buf : item.second) {
+            munmap(buf, item.first);
+        }
+    }
+    if (m_tlb_fd >= 0) {
+        close(m_tlb_fd);
+    }
+}
+
+void FramePool::open_tlb_counter() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    m_tlb_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void FramePool::configure(eFramePageMode mode, int max_free_frames) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_mode = mode;
+    m_max_free_frames = max_free_frames < 0 ? 0 : max_free_frames;
+}
+
+uint8_t *FramePool::map_buffer(size_t capacity, int *page_kind) {
+    void *va = MAP_FAILED;
+    if (m_mode == FRAME_PAGE_AUTO || m_mode == FRAME_PAGE_HUGETLB) {
+        va = mmap(NULL, capacity, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (va != MAP_FAILED) {
+            *page_kind = PAGE_KIND_HUGETLB;
+            return (uint8_t *)va;
+        }
+    }
+
+    // 多映射一个大页再裁掉头尾, 保证2MB对齐, 透明大页才能整页合并
+    size_t map_size = capacity + HUGE_PAGE_SIZE;
+    va = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (va == MAP_FAILED) {
+        return nullptr;
+    }
+    uintptr_t start = (uintptr_t)va;
+    uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~((uintptr_t)HUGE_PAGE_SIZE - 1);
+    if (aligned > start) {
+        munmap(va, aligned - start);
+    }
+    size_t tail = (start + map_size) - (aligned + capacity);
+    if (tail > 0) {
+        munmap((void *)(aligned + capacity), tail);
+    }
+
+    *page_kind = PAGE_KIND_NORMAL;
+#ifdef MADV_HUGEPAGE
+    if (m_mode != FRAME_PAGE_NORMAL && madvise((void *)aligned, capacity, MADV_HUGEPAGE) == 0) {
+        *page_kind = PAGE_KIND_THP;
+    }
+#endif
+    // 预先触页, 缺页只发生在首次分配时
+    for (size_t offset = 0; offset < capacity; offset += 4096) {
+        ((volatile uint8_t *)aligned)[offset] = 0;
+    }
+    return (uint8_t *)aligned;
+}
+
+uint8_t *FramePool::acquire(size_t size, size_t *capacity) {
+    size_t cap = (size + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_free_lists.find(cap);
+        if (it != m_free_lists.end() && !it->second.empty()) {
+            uint8_t *buf = it->second.back();
+            it->second.pop_back();
+            m_reuses++;
+            *capacity = cap;
+            return buf;
+        }
+    }
+
+    int page_kind = PAGE_KIND_NORMAL;
+    uint8_t *buf = map_buffer(cap, &page_kind);
+    if (buf == nullptr) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_allocs++;
+    m_total_bytes += cap;
+    if (page_kind == PAGE_KIND_HUGETLB) {
+        m_hugetlb++;
+    } else if (page_kind == PAGE_KIND_THP) {
+        m_thp++;
+    } else {
+        m_normal++;
+    }
+    *capacity = cap;
+    return buf;
+}
+
+void FramePool::release(uint8_t *buf, size_t capacity) {
+    if (buf == nullptr) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<uint8_t *>& list = m_free_lists[capacity];
+        if ((int)list.size() < m_max_free_frames) {
+            list.push_back(buf);
+            return;
+        }
+        m_total_bytes -= capacity;
+    }
+    munmap(buf, capacity);
+}
+
+void FramePool::trim(int max_free_frames) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_max_free_frames = max_free_frames < 0 ? 0 : max_free_frames;
+    for (auto& item : m_free_lists) {
+        while ((int)item.second.size() > m_max_free_frames) {
+            munmap(item.second.back(), item.first);
+            item.second.pop_back();
+            m_total_bytes -= item.first;
+        }
+    }
+}
+
+void FramePool::report() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    uint64_t tlb = 0;
+    bool has_tlb = m_tlb_fd >= 0 && read(m_tlb_fd, &tlb, sizeof(tlb)) == sizeof(tlb);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    printf("frame pool: allocs %lu (hugetlb %lu, thp %lu, normal %lu), reuses %lu, "
+           "minor faults +%ld, major faults +%ld",
+           m_allocs, m_hugetlb, m_thp, m_normal, m_reuses,
+           usage.ru_minflt - m_last_minflt, usage.ru_majflt - m_last_majflt);
+    if (has_tlb) {
+        printf(", dTLB read misses +%lu\n", tlb - m_last_tlb);
+        m_last_tlb = tlb;
+    } else {
+        printf(", dTLB counter unavailable\n");
+    }
+    m_last_minflt = usage.ru_minflt;
+    m_last_majflt = usage.ru_majflt;
+}
@@ -0,0 +1,189 @@
+#include "infer_regions.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+static int align_down2(int value) {
+    return value & ~1;
+}
+
+// 裁剪到帧内并按2对齐, 太小的区域无效
+static bool clip_view(infer_view_t& view, int width, int height) {
+    int x1 = std::max(0, view.x);
+    int y1 = std::max(0, view.y);
+    int x2 = std::min(width, view.x + view.width);
+    int y2 = std::min(height, view.y + view.height);
+    view.x = align_down2(x1);
+    view.y = align_down2(y1);
+    view.width = align_down2(x2 - view.x);
+    view.height = align_down2(y2 - view.y);
+    return view.width >= 16 && view.height >= 16;
+}
+
+void InferRegionPlanner::configure(const InferRegionsConfig& config) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_config = config;
+    m_width = 0;
+    m_height = 0;
+    m_views.clear();
+}
+
+// 帧尺寸变化时重新计算各视图的位置, 之前的结果作废
+void InferRegionPlanner::layout(int width, int height) {
+    m_width = width;
+    m_height = height;
+    m_views.clear();
+
+    if (m_config.full_frame) {
+        view_state_t state;
+        state.view.width = width;
+        state.view.height = height;
+        state.stride = m_config.full_stride;
+        if (clip_view(state.view, width, height)) {
+            m_views.push_back(state);
+        }
+    }
+
+    if (m_config.tile_cols > 0 && m_config.tile_rows > 0) {
+        // 块宽 w 满足 cols * w - (cols - 1) * overlap * w = width
+        int cols = m_config.tile_cols;
+        int rows = m_config.tile_rows;
+        float overlap = m_config.tile_overlap;
+        int tile_w = (int)(width / (cols - (cols - 1) * overlap) + 0.5f);
+        int tile_h = (int)(height / (rows - (rows - 1) * overlap) + 0.5f);
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+                view_state_t state;
+                // 最后一块贴齐帧边缘
+                state.view.x = cols > 1 ? (width - tile_w) * c / (cols - 1) : 0;
+                state.view.y = rows > 1 ? (height - tile_h) * r / (rows - 1) : 0;
+                state.view.width = tile_w;
+                state.view.height = tile_h;
+                state.stride = m_config.tile_stride;
+                if (clip_view(state.view, width, height)) {
+                    m_views.push_back(state);
+                }
+            }
+        }
+    }
+
+    for (const auto& region : m_config.regions) {
+        view_state_t state;
+        state.view.x = region.x;
+        state.view.y = region.y;
+        state.view.width = region.width > 0 ? region.width : width - region.x;
+        state.view.height = region.height > 0 ? region.height : height - region.y;
+        state.stride = region.stride;
+        if (!clip_view(state.view, width, height)) {
+            printf("infer region %s is outside %dx%d frame, ignored\n", region.name.c_str(), width, height);
+            continue;
+        }
+        m_views.push_back(state);
+    }
+
+    for (size_t i = 0; i < m_views.size(); i++) {
+        m_views[i].view.id = (int)i;
+        m_views[i].stride = std::max(1, m_views[i].stride);
+    }
+    if (m_views.size() > 1) {
+        printf("infer views for %dx%d:", width, height);
+        for (const auto& state : m_views) {
+            printf(" [%d,%d %dx%d /%d]", state.view.x, state.view.y, state.view.width, state.view.height, state.stride);
+        }
+        printf("\n");
+    }
+}
+
+void InferRegionPlanner::plan(int width, int height, uint64_t frame_seq, int infer_stride, std::vector<infer_view_t>& views) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (width != m_width || height != m_height) {
+        layout(width, height);
+    }
+
+    // 按推理帧计数, 与全局推理间隔叠加
+    uint64_t infer_index = frame_seq / (uint64_t)std::max(1, infer_stride);
+    views.clear();
+    for (const auto& state : m_views) {
+        if (infer_index % state.stride == 0) {
+            views.push_back(state.view);
+        }
+    }
+}
+
+static float box_area(const image_rect_t& box) {
+    return (float)(box.right - box.left + 1) * (box.bottom - box.top + 1);
+}
+
+void InferRegionPlanner::merge(uint64_t frame_seq, int width, int height, const std::vector<infer_view_t>& views,
+                               const std::vector<object_detect_result_list>& results, float nms_thresh,
+                               object_detect_result_list *out) {
+    std::vector<object_detect_result> candidates;
+    int sources = 0;
+    float merge_overlap;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (width != m_width || height != m_height) {
+            layout(width, height);
+        }
+        merge_overlap = m_config.merge_overlap;
+        // 本帧推理过的视图用本帧结果; 多个推理实例乱序完成, 保存时只保留每个视图最新一帧的结果
+        std::vector<bool> fresh(m_views.size(), false);
+        for (size_t i = 0; i < views.size() && i < results.size(); i++) {
+            int id = views[i].id;
+            if (id < 0 || id >= (int)m_views.size()) {
+                continue;
+            }
+            fresh[id] = true;
+            candidates.insert(candidates.end(), results[i].results, results[i].results + results[i].count);
+            sources++;
+            view_state_t& state = m_views[id];
+            if (state.has_result && state.result_seq > frame_seq) {
+                continue;
+            }
+            state.results.assign(results[i].results, results[i].results + results[i].count);
+            state.result_seq = frame_seq;
+            state.has_result = true;
+        }
+        // 本帧未推理的视图沿用最近一次的结果
+        for (size_t id = 0; id < m_views.size(); id++) {
+            if (!fresh[id] && m_views[id].has_result) {
+                candidates.insert(candidates.end(), m_views[id].results.begin(), m_views[id].results.end());
+                sources++;
+            }
+        }
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(), [](const object_detect_result& a, const object_detect_result& b) {
+        return a.prop > b.prop;
+    });
+
+    // 同一目标会出现在整帧和平铺块/重叠区域中, 被块边缘截断的框与完整框 IoU 偏低, 同时按交集占较小框的比例去重
+    out->count = 0;
+    for (size_t i = 0; i < candidates.size() && out->count < OBJ_NUMB_MAX_SIZE; i++) {
+        const object_detect_result& cand = candidates[i];
+        bool keep = true;
+        for (int j = 0; sources > 1 && j < out->count; j++) {
+            const object_detect_result& kept = out->results[j];
+            if (kept.cls_id != cand.cls_id) {
+                continue;
+            }
+            int iw = std::min(kept.box.right, cand.box.right) - std::max(kept.box.left, cand.box.left) + 1;
+            int ih = std::min(kept.box.bottom, cand.box.bottom) - std::max(kept.box.top, cand.box.top) + 1;
+            if (iw <= 0 || ih <= 0) {
+                continue;
+            }
+            float inter = (float)iw * ih;
+            float area_a = box_area(kept.box);
+            float area_b = box_area(cand.box);
+            float iou = inter / (area_a + area_b - inter);
+            float iom = inter / std::min(area_a, area_b);
+            if (iou > nms_thresh || iom > merge_overlap) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) {
+            out->results[out->count++] = cand;
+        }
+    }
+}
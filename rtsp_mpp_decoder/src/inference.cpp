@@ -1,4 +1,5 @@
 #include "inference.h"
+#include "runtime_config.h"
 
 std::mutex m_rga_mutex;
 
@@ -6,6 +7,12 @@ inline static double __get_us(struct timeval t) {
     return (t.tv_sec * 1000000 + t.tv_usec); 
 }
 
+static int64_t get_time_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
 static void dump_tensor_attr(rknn_tensor_attr *attr) {
     printf("index=%d, name=%s, n_dims=%d, dims=[", attr->index, attr->name, attr->n_dims);
     for(int i=0; i < attr->n_dims; i++) {
@@ -68,27 +75,36 @@ static unsigned char *load_model(const char *filename, int *model_size) {
     return data;
 }
 
-int Inference::initialize(const char *model_path, bool info) {
-    int ret;
-    memset(&app_ctx, 0, sizeof(rknn_app_context_t));
-    
+bool Inference::read_model(const char *model_path, std::vector<unsigned char>& model_data) {
     int model_data_size = 0;
-    unsigned char *model_data = load_model(model_path, &model_data_size);
-    if (model_data == NULL) {
+    unsigned char *data = load_model(model_path, &model_data_size);
+    if (data == NULL) {
         printf("Failed to load model file\n");
+        return false;
+    }
+    model_data.assign(data, data + model_data_size);
+    free(data);
+    return true;
+}
+
+int Inference::initialize(const char *model_path, bool info) {
+    std::vector<unsigned char> model_data;
+    if (!read_model(model_path, model_data)) {
         return -1;
     }
+    return initialize(model_data, info);
+}
+
+int Inference::initialize(const std::vector<unsigned char>& model_data, bool info) {
+    int ret;
+    memset(&app_ctx, 0, sizeof(rknn_app_context_t));
 
-    ret = rknn_init(&app_ctx.rknn_ctx, model_data, model_data_size, 0, NULL);
+    // rknn_init 不修改模型数据, 多个实例可并发使用同一份
+    ret = rknn_init(&app_ctx.rknn_ctx, (void *)model_data.data(), model_data.size(), 0, NULL);
     if (ret < 0) {
         printf("rknn_init error ret=%d\n", ret);
-        free(model_data);
         return -2;
     }
-
-    if (model_data) {
-        free(model_data);
-    }
     if(info) {
         rknn_sdk_version version;
         ret = rknn_query(app_ctx.rknn_ctx, RKNN_QUERY_SDK_VERSION, &version, sizeof(rknn_sdk_version));
@@ -154,184 +170,424 @@ int Inference::initialize(const char *model_path, bool info) {
         app_ctx.model_channel = app_ctx.input_attrs[0].dims[3];
     }
     
+    // 类别数/DFL长度/分支/布局/量化方式取自模型输出, 不同类别数的模型无需重新编译
+    if (model_desc_init(&app_ctx, &m_model_desc) < 0) {
+        return -8;
+    }
+    // 类别名按类别号取, 行数不一致时标签和类别过滤都会错位
+    if (get_label_count() != m_model_desc.num_classes) {
+        printf("label file has %d names but model outputs %d classes, check [model_path] labels\n",
+               get_label_count(), m_model_desc.num_classes);
+        return -9;
+    }
+    if(info)
+        printf("model output: %d classes, dfl %d, %d branches x %d outputs, %s %s, decode kernel: %s\n",
+               m_model_desc.num_classes, m_model_desc.dfl_len, m_model_desc.num_branches,
+               m_model_desc.output_per_branch, m_model_desc.nhwc ? "NHWC" : "NCHW",
+               m_model_desc.qnt == OUTPUT_FP32 ? "fp32" : (m_model_desc.qnt == OUTPUT_QNT_U8 ? "uint8" : "int8"),
+               m_model_desc.kernel_name);
+
     int size = app_ctx.model_height * app_ctx.model_width * app_ctx.model_channel;
-    ret = resize_img.make_dma(app_ctx.model_width, app_ctx.model_height, RK_FORMAT_RGB_888, size);
-    if(ret < 0) {
-        printf("resize_img make_dma error\n");
-        return -6;
+
+    // 批大小大于1的模型一次推理多个视图(平铺块/区域)
+    m_input_size = size;
+    m_batch = 1;
+    if (app_ctx.input_attrs[0].n_dims == 4 && app_ctx.input_attrs[0].dims[0] > 1) {
+        m_batch = app_ctx.input_attrs[0].dims[0];
+        if(info)
+            printf("model batch size %d\n", m_batch);
     }
 
-    ret = input_img.make_dma(app_ctx.model_width, app_ctx.model_height, RK_FORMAT_RGB_888, size);
-    if(ret < 0) {
-        printf("input_img make_dma error\n");
-        return -7;
+    // 每个槽位独立的模型输入和预分配输出, NPU 运行时前后两帧的读写互不干扰; 先按整帧一个视图分配
+    for (int i = 0; i < m_depth; i++) {
+        infer_slot_t& slot = m_slots[i];
+        if(ensure_view_inputs(slot, 1) < 0) {
+            printf("input_img make_dma error\n");
+            return -7;
+        }
+        ensure_view_outputs(slot, 1);
+        slot.state = INFER_STAGE_NUM;
     }
     if(info)
-        printf("model input height=%d, width=%d, channel=%d\n", app_ctx.model_height, app_ctx.model_width, app_ctx.model_channel);
+        printf("model input height=%d, width=%d, channel=%d, pipeline depth %d\n",
+               app_ctx.model_height, app_ctx.model_width, app_ctx.model_channel, m_depth);
     
     m_is_init = true;
     m_is_running = true;
-    m_inferenceThread = std::thread(&Inference::inference_model, this);
+    m_fill_idx = 0;
+    m_free_slots = m_depth;
+    m_pipeline_begin_us = get_time_us();
+    for (int i = 0; i < INFER_STAGE_NUM; i++) {
+        m_stage_threads[i] = std::thread(&Inference::stage_loop, this, i);
+    }
     
     return 0;
 }
 
+// 前处理阶段调用, 按视图数增加模型输入缓冲
+int Inference::ensure_view_inputs(infer_slot_t& slot, size_t count) {
+    while (slot.view_inputs.size() < count) {
+        auto input_img = std::make_unique<dma_data_t>();
+        int ret = input_img->make_dma(app_ctx.model_width, app_ctx.model_height, RK_FORMAT_RGB_888, m_input_size, "model_input");
+        if(ret < 0) {
+            return ret;
+        }
+        slot.view_inputs.push_back(std::move(input_img));
+        slot.view_input_rects.push_back({0, 0, 0, 0});
+    }
+    return 0;
+}
+
+// NPU 阶段调用, 按视图数增加预分配输出; 批大小大于1时一批视图共用一组输出, 各视图指向其中一段
+void Inference::ensure_view_outputs(infer_slot_t& slot, size_t count) {
+    int n_output = app_ctx.io_num.n_output;
+    size_t runs = (count + m_batch - 1) / m_batch;
+    size_t elem_size = app_ctx.is_quant ? 1 : sizeof(float);
+    while (slot.output_bufs.size() < runs * n_output) {
+        int j = slot.output_bufs.size() % n_output;
+        slot.output_bufs.emplace_back(app_ctx.output_attrs[j].n_elems * elem_size);
+    }
+    while (slot.view_outputs.size() < count) {
+        size_t v = slot.view_outputs.size();
+        size_t r = v / m_batch;
+        size_t b = v % m_batch;
+        std::vector<rknn_output> outputs(n_output);
+        for (int j = 0; j < n_output; j++) {
+            std::vector<uint8_t>& buf = slot.output_bufs[r * n_output + j];
+            size_t part = buf.size() / m_batch;
+            memset(&outputs[j], 0, sizeof(rknn_output));
+            outputs[j].index = j;
+            outputs[j].want_float = (!app_ctx.is_quant);
+            outputs[j].is_prealloc = 1;
+            outputs[j].buf = buf.data() + b * part;
+            outputs[j].size = part;
+        }
+        slot.view_outputs.push_back(std::move(outputs));
+    }
+}
+
+void Inference::set_pipeline_depth(int depth) {
+    m_depth = std::max(1, std::min(depth, INFERENCE_PIPELINE_MAX_DEPTH));
+}
+
+int Inference::warmup(int runs) {
+    if (!m_is_init || runs <= 0) {
+        return 0;
+    }
+
+    // 首次 rknn_run 会做内存分配/权重搬运等一次性工作, 用全零输入提前跑掉
+    rknn_input inputs[1];
+    memset(inputs, 0, sizeof(inputs));
+    inputs[0].index = 0;
+    inputs[0].type = RKNN_TENSOR_UINT8;
+    std::vector<uint8_t> zero_input((size_t)m_batch * m_input_size, 0);
+    inputs[0].size = zero_input.size();
+    inputs[0].fmt = RKNN_TENSOR_NHWC;
+    inputs[0].buf = zero_input.data();
+
+    int64_t first_us = 0;
+    int64_t rest_us = 0;
+    for (int i = 0; i < runs; i++) {
+        int64_t start = get_time_us();
+        rknn_output outputs[app_ctx.io_num.n_output];
+        memset(outputs, 0, sizeof(outputs));
+        for (int j = 0; j < app_ctx.io_num.n_output; j++) {
+            outputs[j].index = j;
+            outputs[j].want_float = (!app_ctx.is_quant);
+        }
+        int ret = rknn_inputs_set(app_ctx.rknn_ctx, app_ctx.io_num.n_input, inputs);
+        if (ret >= 0) {
+            ret = rknn_run(app_ctx.rknn_ctx, NULL);
+        }
+        if (ret >= 0) {
+            ret = rknn_outputs_get(app_ctx.rknn_ctx, app_ctx.io_num.n_output, outputs, NULL);
+        }
+        if (ret < 0) {
+            printf("inference warm-up failed: %d\n", ret);
+            return ret;
+        }
+        rknn_outputs_release(app_ctx.rknn_ctx, app_ctx.io_num.n_output, outputs);
+        int64_t cost = get_time_us() - start;
+        if (i == 0) {
+            first_us = cost;
+        } else {
+            rest_us += cost;
+        }
+    }
+    printf("inference warm-up: first run %.1f ms, steady %.1f ms (%d runs)\n",
+           first_us / 1000.0, runs > 1 ? rest_us / 1000.0 / (runs - 1) : 0.0, runs);
+    return 0;
+}
+
 void Inference::trigger_inference(uint64_t frame_seq) {
     // 不需要检查 is_init 和 is_busy，因为外部已经检查过了
+    infer_slot_t& slot = m_slots[m_fill_idx];
+    slot.src_frame.frame_seq = frame_seq;
+    m_free_slots.fetch_sub(1);
     {
-        std::lock_guard<std::mutex> lock(m_signal_mutex);
-        m_current_frame_seq = frame_seq;
-        m_has_frame = true;
-        m_is_busy.store(true);
+        std::lock_guard<std::mutex> lock(m_stage_mutex);
+        slot.state = INFER_STAGE_PRE;
     }
-    m_frame_cv.notify_one();
+    m_fill_idx = (m_fill_idx + 1) % m_depth;
+    m_stage_cv.notify_all();
 }
 
-void Inference::inference_model() {
-    while(m_is_running) {
-        
-        // 等待新帧
+// 每个阶段按环形顺序处理槽位, 处理完交给下一阶段, 后处理完成后槽位回到空闲
+void Inference::stage_loop(int stage) {
+    int idx = 0;
+    while(true) {
+        infer_slot_t& slot = m_slots[idx];
         {
-            std::unique_lock<std::mutex> lock(m_signal_mutex);
-            m_frame_cv.wait(lock, [this]() {
-                return m_has_frame || !m_is_running;
+            std::unique_lock<std::mutex> lock(m_stage_mutex);
+            m_stage_cv.wait(lock, [this, &slot, stage]() {
+                return slot.state == stage || !m_is_running;
             });
-            
             if(!m_is_running) {
                 break;
             }
-            
-            if(!m_has_frame) {
-                continue;
-            }
-            m_has_frame = false;
         }
 
-        int ret;
-        std::vector<float> out_scales;
-        std::vector<int32_t> out_zps;
-        
-        object_detect_result_list detect_result;
-        memset(&detect_result, 0, sizeof(object_detect_result_list));
-        im_rect rect[OBJ_NUMB_MAX_SIZE];
-        
-        rknn_context ctx = app_ctx.rknn_ctx;
-        int model_width = app_ctx.model_width;
-        int model_height = app_ctx.model_height;
-        int model_channel = app_ctx.model_channel;
+        int64_t start = get_time_us();
+        if(stage == INFER_STAGE_PRE) {
+            preprocess(slot);
+        } else if(stage == INFER_STAGE_NPU) {
+            run_npu(slot);
+        } else {
+            postprocess(slot);
+        }
+        m_stage_busy_us[stage] += get_time_us() - start;
+
+        {
+            std::lock_guard<std::mutex> lock(m_stage_mutex);
+            slot.state = stage + 1;
+        }
+        if(stage == INFER_STAGE_POST) {
+            // 处理完成，槽位可以接收新帧
+            m_free_slots.fetch_add(1);
+        }
+        m_stage_cv.notify_all();
+        idx = (idx + 1) % m_depth;
+    }
+}
+
+// RGA 裁剪缩放后直接写入模型输入的 letterbox 区域, 每个视图一份
+void Inference::preprocess(infer_slot_t& slot) {
+    dma_data_t& src_frame = slot.src_frame;
+    int model_width = app_ctx.model_width;
+    int model_height = app_ctx.model_height;
 
-        const float nms_threshold = NMS_THRESH;
-        const float box_conf_threshold = BOX_THRESH;
+    // 本帧使用同一份运行时配置快照
+    slot.rt = RuntimeConfigManager::getInstance().get();
+    slot.failed = true;
 
-        float scale_w = (float)model_width / src_frame.width;
-        float scale_h = (float)model_height / src_frame.height;
+    InferRegionPlanner::getInstance().plan(src_frame.width, src_frame.height, src_frame.frame_seq,
+                                           slot.rt->infer_stride, slot.views);
+    if(ensure_view_inputs(slot, slot.views.size()) < 0) {
+        printf("input_img make_dma error\n");
+        return;
+    }
+
+    rga_buffer_t src;
+    rga_buffer_t pat;
+    memset(&src, 0, sizeof(src));
+    memset(&pat, 0, sizeof(pat));
+    src = wrapbuffer_fd(src_frame.fd, src_frame.width, src_frame.height, src_frame.format, src_frame.width_stride, src_frame.height_stride);
+
+    for (size_t v = 0; v < slot.views.size(); v++) {
+        infer_view_t& view = slot.views[v];
+        float scale_w = (float)model_width / view.width;
+        float scale_h = (float)model_height / view.height;
         float scale = (scale_w < scale_h) ? scale_w : scale_h;
-        int new_width = (int)(src_frame.width * scale);
-        int new_height = (int)(src_frame.height * scale);
+        int new_width = std::min(model_width, (int)(view.width * scale));
+        int new_height = std::min(model_height, (int)(view.height * scale));
 
         int pad_top = (model_height - new_height) / 2;
-        int pad_bottom = model_height - new_height - pad_top;
         int pad_left = (model_width - new_width) / 2;
-        int pad_right = model_width - new_width - pad_left;
-        int rgba_size = src_frame.width * src_frame.height * get_bpp_from_format(RK_FORMAT_RGBA_8888);
 
-        letterbox_t letter_box;
-        letter_box.x_pad = pad_left;
-        letter_box.y_pad = pad_top;
-        letter_box.scale = scale;
+        view.letter_box.x_pad = pad_left;
+        view.letter_box.y_pad = pad_top;
+        view.letter_box.scale = scale;
 
+        dma_data_t& input_img = *slot.view_inputs[v];
+        rga_buffer_t dst;
+        memset(&dst, 0, sizeof(dst));
+        dst = wrapbuffer_fd(input_img.fd, model_width, model_height, RK_FORMAT_RGB_888);
+        im_rect src_rect = {view.x, view.y, view.width, view.height};
+        im_rect dst_rect = {pad_left, pad_top, new_width, new_height};
+        im_rect pat_rect = {0, 0, 0, 0};
+
+        // 填充区只在 letterbox 区域变化(缓冲新建或换了视图)时整块刷成底色, 之后每帧只写图像区域
+        im_rect& filled = slot.view_input_rects[v];
+        if(filled.x != dst_rect.x || filled.y != dst_rect.y ||
+           filled.width != dst_rect.width || filled.height != dst_rect.height) {
+            auto guard = input_img.cpu_access();
+            memset(input_img.buf, 0x72, m_input_size);
+            filled = dst_rect;
+        }
+
+        // 源区域裁剪、缩放和颜色转换在一次 RGA 操作中完成, 直接写到模型输入中
+        int ret = improcess(src, dst, pat, src_rect, dst_rect, pat_rect, IM_SYNC);
+        if(ret != IM_STATUS_SUCCESS) {
+            printf("improcess failed: %s\n", imStrError((IM_STATUS)ret));
+            filled = {0, 0, 0, 0};
+            return;
+        }
+    }
+    slot.failed = false;
+}
+
+// 只有这个阶段调用 rknn 接口, 输出写入槽位的预分配缓冲
+void Inference::run_npu(infer_slot_t& slot) {
+    if(slot.failed) {
+        return;
+    }
+    slot.failed = true;
+    rknn_context ctx = app_ctx.rknn_ctx;
+    int n_output = app_ctx.io_num.n_output;
+    size_t count = slot.views.size();
+    ensure_view_outputs(slot, count);
+
+    for (size_t first = 0; first < count; first += m_batch) {
+        size_t n = std::min(count - first, (size_t)m_batch);
         rknn_input inputs[1];
         memset(inputs, 0, sizeof(inputs));
         inputs[0].index = 0;
         inputs[0].type = RKNN_TENSOR_UINT8;
-        inputs[0].size = model_width * model_height * model_channel;
+        inputs[0].size = m_batch * m_input_size;
         inputs[0].fmt = RKNN_TENSOR_NHWC;
         inputs[0].pass_through = 0;
-        inputs[0].buf = input_img.buf;
 
-        rknn_output outputs[app_ctx.io_num.n_output];
-        memset(outputs, 0, sizeof(outputs));
-        memset(&src, 0, sizeof(src));
-        memset(&dst, 0, sizeof(dst));
-        memset(&resize, 0, sizeof(resize));
-        memset(&rgba, 0, sizeof(rgba));
-        
-        // 检查并重新分配 RGBA 缓冲区
-        if(rgba_data.get_size() == 0 || 
-           rgba_data.width != src_frame.width || 
-           rgba_data.height != src_frame.height) {
-            
-            rgba_data.release();
-            ret = rgba_data.make_dma(src_frame.width, src_frame.height, RK_FORMAT_RGBA_8888, rgba_size);
-            if (ret < 0) {
-                printf("alloc rgba_data buffer failed!\n");
-                goto CallBack;
+        int ret;
+        if (m_batch == 1) {
+            // rknn_inputs_set 由CPU拷贝 RGA 写入的输入图像
+            dma_data_t& input_img = *slot.view_inputs[first];
+            inputs[0].buf = input_img.buf;
+            auto guard = input_img.cpu_access();
+            ret = rknn_inputs_set(ctx, app_ctx.io_num.n_input, inputs);
+        } else {
+            // 一批视图拼接成一个输入, 不足一批的部分填零
+            m_batch_input.resize((size_t)m_batch * m_input_size);
+            for (size_t b = 0; b < n; b++) {
+                dma_data_t& input_img = *slot.view_inputs[first + b];
+                auto guard = input_img.cpu_access();
+                memcpy(m_batch_input.data() + b * m_input_size, input_img.buf, m_input_size);
             }
+            memset(m_batch_input.data() + n * m_input_size, 0, (m_batch - n) * m_input_size);
+            inputs[0].buf = m_batch_input.data();
+            ret = rknn_inputs_set(ctx, app_ctx.io_num.n_input, inputs);
         }
-        memset(rgba_data.buf, 0, rgba_size);
-        
-        resize = wrapbuffer_fd(resize_img.fd, new_width, new_height, RK_FORMAT_RGB_888);
-        dst = wrapbuffer_fd(input_img.fd, model_width, model_height, RK_FORMAT_RGB_888);
-        src = wrapbuffer_fd(src_frame.fd, src_frame.width, src_frame.height, src_frame.format, src_frame.width_stride, src_frame.height_stride);
-        rgba = wrapbuffer_fd(rgba_data.fd, src_frame.width, src_frame.height, rgba_data.format);
-
-                        
-        ret = imresize(src, resize);
-        if(ret != IM_STATUS_SUCCESS) {
-            printf("imresize failed: %s\n", imStrError((IM_STATUS)ret));
-            goto CallBack;
-        }
-
-        ret = immakeBorder(resize, dst, pad_top, pad_bottom, pad_left, pad_right, 
-                          IM_BORDER_CONSTANT, 0x727272);
-        if(ret != IM_STATUS_SUCCESS) {
-            goto CallBack;
-        }
-
-        ret = rknn_inputs_set(ctx, app_ctx.io_num.n_input, inputs);
         if(ret < 0) {
             printf("rknn_inputs_set failed: %d\n", ret);
-            goto CallBack;
-        }
-
-        for (int i = 0; i < app_ctx.io_num.n_output; i++) {
-            outputs[i].index = i;
-            outputs[i].want_float = (!app_ctx.is_quant);
+            return;
         }
 
         ret = rknn_run(ctx, NULL);
         if(ret < 0) {
             printf("rknn_run failed: %d\n", ret);
-            goto CallBack;
+            return;
         }
-        
-        ret = rknn_outputs_get(ctx, app_ctx.io_num.n_output, outputs, NULL);
+
+        size_t run = first / m_batch;
+        rknn_output outputs[n_output];
+        memset(outputs, 0, sizeof(outputs));
+        for (int j = 0; j < n_output; j++) {
+            std::vector<uint8_t>& buf = slot.output_bufs[run * n_output + j];
+            outputs[j].index = j;
+            outputs[j].want_float = (!app_ctx.is_quant);
+            outputs[j].is_prealloc = 1;
+            outputs[j].buf = buf.data();
+            outputs[j].size = buf.size();
+        }
+        ret = rknn_outputs_get(ctx, n_output, outputs, NULL);
         if(ret < 0) {
             printf("rknn_outputs_get failed: %d\n", ret);
-            goto CallBack;
+            return;
         }
+        rknn_outputs_release(ctx, n_output, outputs);
+    }
+    slot.failed = false;
+}
+
+// 解码检测框, 叠加渲染, 拷出给编码线程
+void Inference::postprocess(infer_slot_t& slot) {
+    dma_data_t& src_frame = slot.src_frame;
+    const RuntimeConfig *rt = slot.rt.get();
+    int ret;
+
+    object_detect_result_list detect_result;
+    memset(&detect_result, 0, sizeof(object_detect_result_list));
+    im_rect rect[OBJ_NUMB_MAX_SIZE];
+    rga_buffer_t src;
+    rga_buffer_t rgba;
+    int rgba_size = src_frame.width * src_frame.height * get_bpp_from_format(RK_FORMAT_RGBA_8888);
+
+    if(slot.failed) {
+        goto CallBack;
+    }
+
+    // 类别过滤和各类别阈值随配置热更新, 快照不变时沿用换算好的量化阈值
+    if(slot.rt != m_filter_rt) {
+        class_filter_init(&m_model_desc, rt->class_thresh, rt->box_thresh, &m_class_filter);
+        m_filter_rt = slot.rt;
+    }
 
-        for (int i = 0; i < app_ctx.io_num.n_output; ++i) {
-            out_scales.push_back(app_ctx.output_attrs[i].scale);
-            out_zps.push_back(app_ctx.output_attrs[i].zp);
+    // 各视图结果映射回帧坐标, 与未推理视图沿用的结果合并去重
+    m_view_results.resize(slot.views.size());
+    for (size_t v = 0; v < slot.views.size(); v++) {
+        const infer_view_t& view = slot.views[v];
+        object_detect_result_list& view_result = m_view_results[v];
+        memset(&view_result, 0, sizeof(object_detect_result_list));
+        letterbox_t letter_box = view.letter_box;
+        int64_t decode_start = get_time_us();
+        post_process(&m_model_desc, slot.view_outputs[v].data(), &letter_box, &m_class_filter, rt->nms_thresh, &view_result);
+        m_post_us += get_time_us() - decode_start;
+        for (int i = 0; i < view_result.count; i++) {
+            image_rect_t& box = view_result.results[i].box;
+            box.left = std::min(box.left + view.x, src_frame.width - 1);
+            box.top = std::min(box.top + view.y, src_frame.height - 1);
+            box.right = std::min(box.right + view.x, src_frame.width - 1);
+            box.bottom = std::min(box.bottom + view.y, src_frame.height - 1);
         }
+    }
+    InferRegionPlanner::getInstance().merge(src_frame.frame_seq, src_frame.width, src_frame.height, slot.views,
+                                            m_view_results, rt->nms_thresh, &detect_result);
+    // 结果按置信度降序, 截断保留置信度最高的目标
+    if(detect_result.count > rt->max_objects) {
+        detect_result.count = rt->max_objects;
+    }
 
-        post_process(&app_ctx, outputs, &letter_box, box_conf_threshold, nms_threshold, &detect_result);
+    // 只输出元数据时不做任何叠加渲染, 检测结果随帧传给编码线程
+    if(!rt->overlay) {
+        goto CallBack;
+    }
 
-        ret = rknn_outputs_release(ctx, app_ctx.io_num.n_output, outputs);
+    // 检查并重新分配 RGBA 缓冲区(只在叠加渲染时需要)
+    if(rgba_data.get_size() == 0 || 
+       rgba_data.width != src_frame.width || 
+       rgba_data.height != src_frame.height) {
+        
+        ret = rgba_data.make_dma(src_frame.width, src_frame.height, RK_FORMAT_RGBA_8888, rgba_size, "rgba");
+        if (ret < 0) {
+            printf("alloc rgba_data buffer failed!\n");
+            goto CallBack;
+        }
+    }
+    {
+        auto guard = rgba_data.cpu_access();
+        memset(rgba_data.buf, 0, rgba_size);
+    }
 
+    {
+        auto guard = src_frame.cpu_access();
+        int64_t blend_start = get_time_us();
         for (int i = 0; i < detect_result.count; i++) {
             object_detect_result *det_result = &(detect_result.results[i]);
-            // printf("%s @ (%d %d %d %d) %f\n", coco_cls_to_name(det_result->cls_id), 
-            //        det_result->box.left, det_result->box.top,
-            //        det_result->box.right, det_result->box.bottom, det_result->prop);
             
             int x1 = det_result->box.left;
             int y1 = det_result->box.top;
             int x2 = det_result->box.right;
             int y2 = det_result->box.bottom;
 
-            
             YUVLabelRenderer::getInstance().drawDetection(
                 src_frame.buf,           // YUV420SP数据指针
                 src_frame.width_stride, src_frame.height_stride,      // 帧尺寸
@@ -346,59 +602,117 @@ void Inference::inference_model() {
                 std::min(x2, src_frame.width - 1) - std::max(0, x1) + 1,
                 std::min(y2, src_frame.height - 1) - std::max(0, y1) + 1
             };
-            
         }
+        m_blend_us += get_time_us() - blend_start;
+    }
 
-        ret = imrectangleArray(rgba, rect, detect_result.count, 0x000000FF, 4);
-        if (ret != IM_STATUS_SUCCESS) {
-            printf("imrectangle failed: %s\n", imStrError((IM_STATUS)ret));
-            goto CallBack;
-        }
-        // 合成结果
-        src = wrapbuffer_fd(src_frame.fd, src_frame.width, src_frame.height, src_frame.format, 
-                           src_frame.width_stride, src_frame.height_stride);
-        ret = imcomposite(rgba, src, src);
-        if (ret != IM_STATUS_SUCCESS) {
-            printf("imcomposite failed: %s\n", imStrError((IM_STATUS)ret));
+    rgba = wrapbuffer_fd(rgba_data.fd, src_frame.width, src_frame.height, rgba_data.format);
+    {
+        // 与门控帧的CPU画框使用同一份配置 [overlay] box_color/box_thickness, RGA 颜色按 0xAABBGGRR
+        uint32_t box_color = 0xff000000 | ((rt->box_color & 0xff) << 16) | (rt->box_color & 0xff00) |
+                             ((rt->box_color >> 16) & 0xff);
+        ret = imrectangleArray(rgba, rect, detect_result.count, box_color, rt->box_thickness);
+    }
+    if (ret != IM_STATUS_SUCCESS) {
+        printf("imrectangle failed: %s\n", imStrError((IM_STATUS)ret));
+        goto CallBack;
+    }
+    // 合成结果
+    src = wrapbuffer_fd(src_frame.fd, src_frame.width, src_frame.height, src_frame.format, 
+                       src_frame.width_stride, src_frame.height_stride);
+    ret = imcomposite(rgba, src, src);
+    if (ret != IM_STATUS_SUCCESS) {
+        printf("imcomposite failed: %s\n", imStrError((IM_STATUS)ret));
+    }
+
+CallBack:
+    // 调用编码回调 - 每一帧都必须回调
+    if(m_encode_callback) {
+        // 创建 shared_ptr 包装的 code_frame_t
+        auto new_frame = std::make_shared<code_frame_t>();
+        new_frame->frame_seq = src_frame.frame_seq;
+        new_frame->pts = src_frame.pts;
+        new_frame->width = src_frame.width_stride;
+        new_frame->height = src_frame.height_stride;
+        new_frame->valid_width = src_frame.width;
+        new_frame->valid_height = src_frame.height;
+        new_frame->annotated = true;
+        new_frame->alloc(src_frame.size);
+        for (int i = 0; i < detect_result.count; i++) {
+            object_detect_result *det_result = &(detect_result.results[i]);
+            new_frame->detects.push_back({det_result->box, det_result->prop, det_result->cls_id});
         }
-    
-    CallBack:
-        // 调用编码回调 - 每一帧都必须回调
-        if(m_encode_callback) {
-            // 创建 shared_ptr 包装的 code_frame_t
-            auto new_frame = std::make_shared<code_frame_t>();
-            new_frame->frame_seq = src_frame.frame_seq;
-            new_frame->size = src_frame.size;
-            new_frame->width = src_frame.width_stride;
-            new_frame->height = src_frame.height_stride;
-            new_frame->frame = (u_char*)malloc(src_frame.size);
-            
-            if(new_frame->frame) {
-                memcpy(new_frame->frame, src_frame.buf, src_frame.size);
-            } else {
-                new_frame->frame = NULL;
-                new_frame->size = 0;
-            }
-            
-            m_encode_callback(new_frame);
+        
+        if(new_frame->frame) {
+            auto guard = src_frame.cpu_access();
+            int64_t copy_start = get_time_us();
+            memcpy(new_frame->frame, src_frame.buf, src_frame.size);
+            m_copy_us += get_time_us() - copy_start;
+            m_copy_bytes += src_frame.size;
         }
         
-        // 处理完成，标记为非忙碌
-        m_is_busy.store(false);
+        m_encode_callback(new_frame);
     }
+    report_cpu_access(src_frame.cached);
+    report_pipeline();
+}
+
+// CPU 访问 DMA 缓冲的吞吐, 用于对比缓存堆和非缓存堆
+void Inference::report_cpu_access(bool cached) {
+    if(++m_access_frames < 300) {
+        return;
+    }
+    printf("inference cpu access (%s heap): copy-out %.0f MB/s, label blend %.2f ms/frame\n",
+           cached ? "cached" : "uncached",
+           m_copy_us > 0 ? m_copy_bytes / (double)m_copy_us : 0.0,
+           m_blend_us / 1000.0 / m_access_frames);
+    m_access_frames = 0;
+    m_copy_bytes = 0;
+    m_copy_us = 0;
+    m_blend_us = 0;
+}
+
+// 各阶段占用率: 阶段耗时 / 统计窗口时长, NPU 接近 100% 说明流水线已把 NPU 喂满
+void Inference::report_pipeline() {
+    if(++m_pipeline_frames < 300) {
+        return;
+    }
+    int64_t now_us = get_time_us();
+    int64_t window_us = std::max<int64_t>(now_us - m_pipeline_begin_us, 1);
+    int64_t pre_us = m_stage_busy_us[INFER_STAGE_PRE].exchange(0);
+    int64_t npu_us = m_stage_busy_us[INFER_STAGE_NPU].exchange(0);
+    int64_t post_us = m_stage_busy_us[INFER_STAGE_POST].exchange(0);
+    printf("inference pipeline: %.1f fps, occupancy pre %.0f%% npu %.0f%% post %.0f%% (depth %d)\n",
+           m_pipeline_frames * 1000000.0 / window_us,
+           pre_us * 100.0 / window_us, npu_us * 100.0 / window_us, post_us * 100.0 / window_us, m_depth);
+    printf("inference post-process: %.3f ms/frame (%d/%d classes)\n",
+           m_post_us / 1000.0 / m_pipeline_frames, m_class_filter.count, m_model_desc.num_classes);
+    m_post_us = 0;
+    m_pipeline_frames = 0;
+    m_pipeline_begin_us = now_us;
 }
 
 void Inference::release() {
-    m_is_running = false;
-    m_frame_cv.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(m_stage_mutex);
+        m_is_running = false;
+    }
+    m_stage_cv.notify_all();
     
-    if(m_inferenceThread.joinable()) {
-        m_inferenceThread.join();
+    for (int i = 0; i < INFER_STAGE_NUM; i++) {
+        if(m_stage_threads[i].joinable()) {
+            m_stage_threads[i].join();
+        }
     }
     
-    src_frame.release();
-    resize_img.release();
-    input_img.release();
+    for (int i = 0; i < INFERENCE_PIPELINE_MAX_DEPTH; i++) {
+        m_slots[i].src_frame.release();
+        m_slots[i].view_inputs.clear();
+        m_slots[i].view_outputs.clear();
+        m_slots[i].output_bufs.clear();
+        m_slots[i].state = INFER_STAGE_NUM;
+    }
+    m_free_slots = 0;
     rgba_data.release();
     
     if(app_ctx.rknn_ctx) {
@@ -12,7 +12,7 @@ YUVLabelRenderer::YUVLabelRenderer()
     , last_fps_time_ms_(0)
     , current_fps_(0.0f)
 {
-    for (int i = 0; i < OBJ_CLASS_NUM; i++) {
+    for (int i = 0; i < OBJ_CLASS_MAX; i++) {
         labels_[i] = nullptr;
     }
 }
@@ -21,7 +21,7 @@ YUVLabelRenderer::~YUVLabelRenderer() {
     cleanup();
 }
 
-bool YUVLabelRenderer::initialize(char* labels[OBJ_CLASS_NUM], const Config& config) {
+bool YUVLabelRenderer::initialize(char* labels[OBJ_CLASS_MAX], const Config& config) {
     std::lock_guard<std::mutex> lock(config_mutex_);
     
     if (initialized_.load()) {
@@ -30,7 +30,7 @@ bool YUVLabelRenderer::initialize(char* labels[OBJ_CLASS_NUM], const Config& con
     
     config_ = config;
     
-    for (int i = 0; i < OBJ_CLASS_NUM; i++) {
+    for (int i = 0; i < OBJ_CLASS_MAX; i++) {
         labels_[i] = labels[i];
     }
     
@@ -53,6 +53,8 @@ bool YUVLabelRenderer::updateConfig(const Config& new_config) {
         return false;
     }
     
+    // 与绘制互斥, 标签图像重新生成期间不能被读取
+    std::lock_guard<std::mutex> render_lock(render_mutex_);
     std::lock_guard<std::mutex> lock(config_mutex_);
     
     bool need_regenerate = false;
@@ -148,7 +150,7 @@ void YUVLabelRenderer::drawDetection(uint8_t* yuv420sp,
                                     int class_id, float confidence,
                                     int box_x, int box_y,
                                     bool is_nv21) {
-    if (!initialized_.load() || class_id < 0 || class_id >= OBJ_CLASS_NUM) {
+    if (!initialized_.load() || class_id < 0 || class_id >= OBJ_CLASS_MAX) {
         return;
     }
 
@@ -198,10 +200,38 @@ void YUVLabelRenderer::drawDetection(uint8_t* y_plane, uint8_t* uv_plane,
     }
 }
 
+void YUVLabelRenderer::drawBox(uint8_t* yuv420sp,
+                               int frame_width, int frame_height,
+                               int x1, int y1, int x2, int y2,
+                               bool is_nv21) {
+    if (!initialized_.load()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(render_mutex_);
+
+    // 色度按2x2采样, 边线起点和宽度按2对齐
+    int t = (config_.box_thickness + 1) & ~1;
+    x1 &= ~1;
+    y1 &= ~1;
+    int w = ((x2 - x1 + 1) + 1) & ~1;
+    int h = ((y2 - y1 + 1) + 1) & ~1;
+    if (w <= 2 * t || h <= 2 * t) {
+        return;
+    }
+    uint8_t r = config_.box_color_r;
+    uint8_t g = config_.box_color_g;
+    uint8_t b = config_.box_color_b;
+    fillRectYUV420SP(yuv420sp, frame_width, frame_height, x1, y1, w, t, r, g, b, 255, is_nv21);
+    fillRectYUV420SP(yuv420sp, frame_width, frame_height, x1, y1 + h - t, w, t, r, g, b, 255, is_nv21);
+    fillRectYUV420SP(yuv420sp, frame_width, frame_height, x1, y1 + t, t, h - 2 * t, r, g, b, 255, is_nv21);
+    fillRectYUV420SP(yuv420sp, frame_width, frame_height, x1 + w - t, y1 + t, t, h - 2 * t, r, g, b, 255, is_nv21);
+}
+
 void YUVLabelRenderer::cleanup() {
     std::lock_guard<std::mutex> lock(config_mutex_);
     
-    for (int i = 0; i < OBJ_CLASS_NUM; i++) {
+    for (int i = 0; i < OBJ_CLASS_MAX; i++) {
         label_images_[i].data.clear();
         label_images_[i].width = 0;
         label_images_[i].height = 0;
@@ -322,7 +352,7 @@ YUVLabelRenderer::TextImageRGBA YUVLabelRenderer::generateTextImage(const char*
 bool YUVLabelRenderer::regenerateAllLabels() {
     printf("Regenerating label atlas...\n");
     
-    for (int i = 0; i < OBJ_CLASS_NUM; i++) {
+    for (int i = 0; i < OBJ_CLASS_MAX; i++) {
         if (labels_[i] == nullptr || strlen(labels_[i]) == 0) {
             continue;
         }
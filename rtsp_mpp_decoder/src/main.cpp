@@ -5,10 +5,22 @@
 #include <semaphore.h>
 
 #include <iostream>
+#include <chrono>
+#include <future>
 
 #include "mk_mediakit.h"
 #include "rtsp_server.h"
 #include "inference.h"
+#include "output_profile.h"
+#include "snapshot.h"
+#include "detect_ring.h"
+#include "frame_export.h"
+#include "nal_parser.h"
+#include "frame_dropper.h"
+#include "motion_gate.h"
+#include "mem_governor.h"
+#include "detect_sei.h"
+#include "runtime_config.h"
 #include "INIReader.h"
 
 static sem_t exit_sem;
@@ -16,6 +28,48 @@ static sem_t exit_sem;
 std::unique_ptr<RtspServer> server_raw;
 std::unique_ptr<RtspServer> server_detect;
 
+// 拉流会话, 断流或拉流失败后由重连线程按指数退避重建播放器
+struct PullSession {
+    std::string url;
+    FrameContext *ctx = nullptr;
+    mk_player player = nullptr;
+    int min_delay_ms = 500;
+    int max_delay_ms = 10000;
+    int delay_ms = 500;
+    int retry = 0;
+    bool need_reconnect = false;
+    bool exiting = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread thread;
+};
+
+static PullSession pull_session;
+
+// 启动缓存上限, GOP超过该大小时放弃缓存
+#define STARTUP_CACHE_MAX_BYTES (16 * 1024 * 1024)
+
+static int64_t get_time_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 运行时配置中的叠加样式写入渲染器配置
+static void apply_label_style(YUVLabelRenderer::Config& style, const RuntimeConfig& config) {
+    style.font_size = config.font_size;
+    style.font_color_r = (config.font_color >> 16) & 0xff;
+    style.font_color_g = (config.font_color >> 8) & 0xff;
+    style.font_color_b = config.font_color & 0xff;
+    style.bg_color_r = (config.bg_color >> 16) & 0xff;
+    style.bg_color_g = (config.bg_color >> 8) & 0xff;
+    style.bg_color_b = config.bg_color & 0xff;
+    style.bg_alpha = config.bg_alpha;
+    style.box_color_r = (config.box_color >> 16) & 0xff;
+    style.box_color_g = (config.box_color >> 8) & 0xff;
+    style.box_color_b = config.box_color & 0xff;
+    style.box_thickness = config.box_thickness;
+}
+
 static void sigint_handler(int sig) {
     sem_post(&exit_sem);
 }
@@ -49,6 +103,123 @@ std::vector<std::string> GetAllLocalIPs() {
     return ips;
 }
 
+static short ParseCodec(const std::string& codec) {
+    if (codec == "h265" || codec == "hevc") return H265;
+    return H264;
+}
+
+static eDropMode ParseDropMode(const std::string& mode) {
+    if (mode == "auto") return DROP_AUTO;
+    if (mode == "non_ref") return DROP_NON_REF;
+    if (mode == "key_only") return DROP_KEY_ONLY;
+    return DROP_OFF;
+}
+
+static eFramePageMode ParseFramePages(const std::string& pages) {
+    if (pages == "hugetlb") return FRAME_PAGE_HUGETLB;
+    if (pages == "thp") return FRAME_PAGE_THP;
+    if (pages == "normal") return FRAME_PAGE_NORMAL;
+    return FRAME_PAGE_AUTO;
+}
+
+static int ParseRcMode(const std::string& mode) {
+    if (mode == "cbr") return MPP_ENC_RC_MODE_CBR;
+    if (mode == "avbr") return MPP_ENC_RC_MODE_AVBR;
+    if (mode == "fixqp") return MPP_ENC_RC_MODE_FIXQP;
+    return MPP_ENC_RC_MODE_VBR;
+}
+
+// 读取一路输出的编码配置
+static EncoderConfig loadEncoderConfig(INIReader& reader, const std::string& section) {
+    EncoderConfig enc;
+    enc.buffers = reader.GetInteger(section, "enc_buffers", enc.buffers);
+    enc.codec = ParseCodec(reader.Get(section, "codec", "h264"));
+    enc.rc_mode = ParseRcMode(reader.Get(section, "rc_mode", "vbr"));
+    enc.bitrate = reader.GetInteger(section, "bitrate", enc.bitrate);
+    enc.qp_init = reader.GetInteger(section, "qp_init", enc.qp_init);
+    enc.qp_min = reader.GetInteger(section, "qp_min", enc.qp_min);
+    enc.qp_max = reader.GetInteger(section, "qp_max", enc.qp_max);
+    enc.gop = reader.GetInteger(section, "gop", enc.gop);
+    enc.profile = reader.GetInteger(section, "profile", enc.profile);
+    enc.level = reader.GetInteger(section, "level", enc.level);
+    enc.low_latency = reader.GetBoolean(section, "low_latency", enc.low_latency);
+    enc.slice_rows = reader.GetInteger(section, "slice_rows", enc.slice_rows);
+    enc.roi_enable = reader.GetBoolean(section, "roi_enable", enc.roi_enable);
+    enc.roi_max_regions = reader.GetInteger(section, "roi_max_regions", enc.roi_max_regions);
+    enc.roi_obj_qp = reader.GetInteger(section, "roi_obj_qp", enc.roi_obj_qp);
+    enc.roi_bg_qp = reader.GetInteger(section, "roi_bg_qp", enc.roi_bg_qp);
+    enc.idr_on_play = reader.GetBoolean(section, "idr_on_play", enc.idr_on_play);
+    return enc;
+}
+
+// 逗号分隔的名称列表, 去掉空白和空项
+static std::vector<std::string> splitNames(const std::string& names) {
+    std::vector<std::string> result;
+    size_t start = 0;
+    while(start <= names.size()) {
+        size_t end = names.find(',', start);
+        if(end == std::string::npos) {
+            end = names.size();
+        }
+        std::string name = names.substr(start, end - start);
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        start = end + 1;
+        if(!name.empty()) {
+            result.push_back(name);
+        }
+    }
+    return result;
+}
+
+// 读取额外输出档位, names 为逗号分隔的档位名, 每个档位对应 [profile_名称] 段
+static std::vector<ProfileConfig> loadProfileConfigs(INIReader& reader) {
+    std::vector<ProfileConfig> profiles;
+    for(const std::string& name : splitNames(reader.Get("detect_profiles", "names", ""))) {
+        std::string section = "profile_" + name;
+        ProfileConfig profile;
+        profile.name = name;
+        profile.stream.vhost = reader.Get(section, "vhost", "__defaultVhost__");
+        profile.stream.app = reader.Get(section, "app", "app");
+        profile.stream.stream = reader.Get(section, "stream", "detect_" + name);
+        profile.width = reader.GetInteger(section, "width", 0);
+        profile.height = reader.GetInteger(section, "height", 0);
+        profile.fps_div = reader.GetInteger(section, "fps_div", 1);
+        profile.use_rga = reader.Get(section, "scaler", "rga") != "cpu";
+        profile.encoder = loadEncoderConfig(reader, section);
+        profiles.push_back(profile);
+    }
+    return profiles;
+}
+
+// 推理视图, names 为逗号分隔的区域名, 每个区域对应 [region_名称] 段
+static InferRegionsConfig loadInferRegionsConfig(INIReader& reader) {
+    InferRegionsConfig regions;
+    regions.full_frame = reader.GetBoolean("infer_regions", "full_frame", true);
+    regions.full_stride = reader.GetInteger("infer_regions", "full_stride", 1);
+    regions.tile_cols = reader.GetInteger("infer_regions", "tile_cols", 0);
+    regions.tile_rows = reader.GetInteger("infer_regions", "tile_rows", 0);
+    regions.tile_overlap = std::max(0.0, std::min(0.5, reader.GetReal("infer_regions", "tile_overlap", 0.15)));
+    regions.tile_stride = reader.GetInteger("infer_regions", "tile_stride", 1);
+    regions.merge_overlap = reader.GetReal("infer_regions", "merge_overlap", 0.7);
+    for(const std::string& name : splitNames(reader.Get("infer_regions", "names", ""))) {
+        std::string section = "region_" + name;
+        InferRegionConfig region;
+        region.name = name;
+        region.x = reader.GetInteger(section, "x", 0);
+        region.y = reader.GetInteger(section, "y", 0);
+        region.width = reader.GetInteger(section, "width", 0);
+        region.height = reader.GetInteger(section, "height", 0);
+        region.stride = reader.GetInteger(section, "stride", 1);
+        regions.regions.push_back(region);
+    }
+    if(!regions.full_frame && regions.regions.empty() && (regions.tile_cols <= 0 || regions.tile_rows <= 0)) {
+        printf("infer_regions: no view configured, fall back to full frame\n");
+        regions.full_frame = true;
+    }
+    return regions;
+}
+
 Config loadConfig(const std::string& filename) {
     Config config;
     INIReader reader(filename);
@@ -59,6 +230,30 @@ Config loadConfig(const std::string& filename) {
     }
     
     config.pullStream = reader.Get("pull_stream", "url", "");
+    config.pullStatsInterval = reader.GetInteger("pull_stream", "stats_interval", 10);
+    config.pullReconnectMinMs = reader.GetInteger("pull_stream", "reconnect_min_ms", 500);
+    config.pullReconnectMaxMs = reader.GetInteger("pull_stream", "reconnect_max_ms", 10000);
+
+    // 内存预算配置
+    config.memory.budget_mb = reader.GetInteger("memory", "budget_mb", 0);
+    config.memory.high_ratio = reader.GetReal("memory", "high_ratio", 0.8);
+    config.memory.critical_ratio = reader.GetReal("memory", "critical_ratio", 0.95);
+    config.memory.min_available_mb = reader.GetInteger("memory", "min_available_mb", 128);
+    config.memory.poll_ms = reader.GetInteger("memory", "poll_ms", 1000);
+    config.memory.max_pending = reader.GetInteger("memory", "max_pending", 0);
+
+    // 帧缓冲池配置
+    config.framePages = reader.Get("frame_pool", "pages", "auto");
+    config.framePoolFree = reader.GetInteger("frame_pool", "max_free", 8);
+
+    // DMA缓冲池配置
+    config.dmaHeap = reader.Get("dma_pool", "heap", "cma");
+    config.dmaPoolMaxFreeMB = reader.GetInteger("dma_pool", "max_free_mb", 64);
+    config.dmaPoolForceMemfd = reader.GetBoolean("dma_pool", "force_memfd", false);
+
+    // 解码帧缓冲配置
+    config.decoderBuffers = reader.GetInteger("decoder", "buffer_count", 0);
+    config.decoderExtraBuffers = reader.GetInteger("decoder", "extra_buffers", 3);
     
     // 推流服务器配置
     config.pushServer.type = reader.Get("push_server", "type", "rtsp");
@@ -73,10 +268,52 @@ Config loadConfig(const std::string& filename) {
     config.detectStream.vhost = reader.Get("detect_stream", "vhost", "__defaultVhost__");
     config.detectStream.app = reader.Get("detect_stream", "app", "app");
     config.detectStream.stream = reader.Get("detect_stream", "stream", "detect");
+    config.detectEncoder = loadEncoderConfig(reader, "detect_stream");
+    config.detectSei = reader.GetBoolean("detect_stream", "sei", false);
+    config.profiles = loadProfileConfigs(reader);
+
+    // 抓拍配置
+    config.snapshot.enable = reader.GetBoolean("snapshot", "enable", false);
+    config.snapshot.dir = reader.Get("snapshot", "dir", "./snapshots");
+    config.snapshot.classes = reader.Get("snapshot", "classes", "");
+    config.snapshot.min_score = reader.GetReal("snapshot", "min_score", 0.5);
+    config.snapshot.min_interval_ms = reader.GetInteger("snapshot", "min_interval_ms", 2000);
+    config.snapshot.workers = reader.GetInteger("snapshot", "workers", 2);
+    config.snapshot.queue_size = reader.GetInteger("snapshot", "queue_size", 4);
+    config.snapshot.quality = reader.GetInteger("snapshot", "quality", 85);
+    config.snapshot.use_mpp = reader.GetBoolean("snapshot", "use_mpp", true);
+    config.snapshot.http_port = reader.GetInteger("snapshot", "http_port", 0);
+    config.detectRing.enable = reader.GetBoolean("detect_ring", "enable", false);
+    config.detectRing.path = reader.Get("detect_ring", "path", "/dev/shm/rknn_detect");
+    config.detectRing.slots = reader.GetInteger("detect_ring", "slots", 256);
+    config.detectRing.stream_id = reader.GetInteger("detect_ring", "stream_id", 0);
+    config.frameExport.enable = reader.GetBoolean("frame_export", "enable", false);
+    config.frameExport.socket_path = reader.Get("frame_export", "socket", "/tmp/rknn_frames.sock");
+    config.frameExport.max_consumers = reader.GetInteger("frame_export", "max_consumers", 4);
+    config.frameExport.max_leases = reader.GetInteger("frame_export", "max_leases", 2);
+
+    // 解码前过载丢帧配置
+    config.overload.mode = ParseDropMode(reader.Get("overload", "mode", "off"));
+    config.overload.non_ref_load = reader.GetReal("overload", "non_ref_load", 0.3);
+    config.overload.key_only_load = reader.GetReal("overload", "key_only_load", 0.7);
+    config.overload.recover_load = reader.GetReal("overload", "recover_load", 0.05);
+
+    config.motionGate.enable = reader.GetBoolean("motion_gate", "enable", false);
+    config.motionGate.block_size = reader.GetInteger("motion_gate", "block_size", 8);
+    config.motionGate.block_thresh = reader.GetInteger("motion_gate", "block_thresh", 6);
+    config.motionGate.min_blocks = reader.GetInteger("motion_gate", "min_blocks", 2);
+    config.motionGate.max_skip = reader.GetInteger("motion_gate", "max_skip", 25);
 
     config.model_path = reader.Get("model_path", "path", "./model/yolov8n.rknn");
+    config.label_path = reader.Get("model_path", "labels", LABEL_NALE_TXT_PATH);
     
+    // 运行时 threads 可调, 启动时按 max_threads 创建
     config.inference_threads = reader.GetInteger("inference", "threads", 2);
+    config.inference_threads = std::max<int>(config.inference_threads, reader.GetInteger("inference", "max_threads", 0));
+    config.warmupRuns = reader.GetInteger("inference", "warmup_runs", 2);
+    config.pipelineDepth = reader.GetInteger("inference", "pipeline_depth", 3);
+    config.inferRegions = loadInferRegionsConfig(reader);
+    config.configWatch = reader.GetBoolean("runtime", "watch", true);
 
 
     std::cout << "Pull Stream URL: " << config.pullStream << std::endl;
@@ -105,6 +342,14 @@ Config loadConfig(const std::string& filename) {
         }
     }
 
+    std::cout << "Detect Stream Codec: " << (config.detectEncoder.codec == H265 ? "h265" : "h264")
+            << ", bitrate: " << config.detectEncoder.bitrate
+            << ", gop: " << config.detectEncoder.gop << std::endl;
+    for (const auto& profile : config.profiles) {
+        std::cout << "Detect Profile " << profile.name << ": rtsp://localhost:" << config.pushServer.port
+                << "/" << profile.stream.app << "/" << profile.stream.stream
+                << " " << profile.width << "x" << profile.height << " fps/" << profile.fps_div << std::endl;
+    }
     std::cout << "Inference Threads: " << config.inference_threads << std::endl;
     
     return config;
@@ -121,17 +366,42 @@ static MppCodingType ConvertCodecType(int mk_codec) {
     return MPP_VIDEO_CodingUnused;
 }
 
-void deal_coded_frame(uint8_t* data, uint32_t size, uint64_t pts, void* userdata) {
-    if(server_detect != nullptr) {
-        mk_media pMedia = server_detect->getZlmMediaHandle();
-        if(pMedia != nullptr) {
-            mk_media_input_h264(pMedia, data, size, pts, pts);
+// frame_seq 为编码器透传回来的输入帧序号, 同一帧的各个slice相同
+void deal_coded_frame(FrameContext *ctx, uint64_t frame_seq, uint8_t* data, uint32_t size, uint64_t pts) {
+    if(server_detect == nullptr) {
+        return;
+    }
+    // 每帧第一个包之前单独送入该帧的检测结果SEI(同一pts), 不拷贝编码数据
+    if(ctx->sei_enable && frame_seq != ctx->sei_last_seq) {
+        ctx->sei_last_seq = frame_seq;
+        std::vector<uint8_t> sei;
+        {
+            std::lock_guard<std::mutex> lock(ctx->sei_mutex);
+            auto it = ctx->sei_pending.find(frame_seq);
+            if(it != ctx->sei_pending.end()) {
+                sei.swap(it->second);
+                ++it;
+            }
+            // 之前的帧没有输出(编码器丢弃)时连同本帧一并清除
+            ctx->sei_pending.erase(ctx->sei_pending.begin(), it);
+        }
+        if(!sei.empty()) {
+            server_detect->inputFrame(sei.data(), sei.size(), pts, pts);
         }
     }
+    server_detect->inputFrame(data, size, pts, pts);
 }
 
 // 编码回调函数（从推理线程调用）
 void inference_encode_callback(FrameContext* ctx, std::shared_ptr<code_frame_t> frame) {
+    {
+        // 供按间隔跳过/门控的帧沿用; 多个推理实例乱序完成, 只保留最新一帧的结果
+        std::lock_guard<std::mutex> lock(ctx->last_detect_mutex);
+        if(frame->frame_seq >= ctx->last_detect_seq) {
+            ctx->last_detects = frame->detects;
+            ctx->last_detect_seq = frame->frame_seq;
+        }
+    }
     std::unique_lock<std::mutex> lock(ctx->pending_mutex);
     // 将处理完的帧加入待编码队列
     ctx->pending_frames[frame->frame_seq] = frame;
@@ -166,8 +436,32 @@ void encode_thread_func(FrameContext* ctx) {
             }
         }
         
+        // 启动后第一帧推理结果
+        if(frame_to_encode && frame_to_encode->annotated && !ctx->first_detect_logged.load()) {
+            ctx->first_detect_logged = true;
+            printf("startup: first detect frame %.1f ms after start\n", (get_time_us() - ctx->startup_us) / 1000.0);
+        }
+
+        // 重连后第一帧推理结果
+        if(frame_to_encode && frame_to_encode->annotated && ctx->reconnect_us.load() != 0) {
+            int64_t now_us = get_time_us();
+            int64_t reconnect_us = ctx->reconnect_us.exchange(0);
+            int64_t outage_us = ctx->outage_begin_us.exchange(0);
+            if(reconnect_us != 0) {
+                printf("stream recovered: reconnect to first annotated frame %.1f ms, outage %.1f ms\n",
+                       (now_us - reconnect_us) / 1000.0, outage_us ? (now_us - outage_us) / 1000.0 : 0.0);
+            }
+        }
+
+        // 检测结果导出, 写端不等待读端
+        if(frame_to_encode && ctx->detect_ring) {
+            ctx->detect_ring->publish(*frame_to_encode);
+        }
+
+        std::shared_ptr<const RuntimeConfig> rt = RuntimeConfigManager::getInstance().get();
+
         // 渲染FPS
-        if(frame_to_encode && frame_to_encode->frame) {
+        if(frame_to_encode && frame_to_encode->frame && rt->overlay) {
             YUVLabelRenderer::getInstance().drawFPS(frame_to_encode->frame, 
                                   frame_to_encode->width, 
                                   frame_to_encode->height, 
@@ -175,8 +469,48 @@ void encode_thread_func(FrameContext* ctx) {
         }
         
         // 编码帧
-        if(frame_to_encode && frame_to_encode->frame && ctx->encoder != nullptr) {
-            ctx->encoder->WriteData(frame_to_encode->frame, frame_to_encode->size);
+        RKEncodeVideo *encoder = ctx->encoder.load();
+        if(frame_to_encode && frame_to_encode->frame && encoder != nullptr) {
+            // 码率变化在编码线程中生效, 与送帧串行
+            if(rt->detect_bitrate > 0) {
+                encoder->SetBitrate(rt->detect_bitrate);
+            }
+            std::vector<EncRoiRect> rois;
+            if(ctx->enc_config.roi_enable) {
+                for(const auto& det : frame_to_encode->detects) {
+                    rois.push_back({det.box.left, det.box.top,
+                                    det.box.right - det.box.left, det.box.bottom - det.box.top});
+                }
+            }
+            // SEI 先按 frame_seq 登记再送编码器, 编码输出回调按透传回来的 frame_seq 取出
+            if(ctx->sei_enable) {
+                detect_sei_t sei;
+                sei.frame_seq = frame_to_encode->frame_seq;
+                sei.width = frame_to_encode->valid_width > 0 ? frame_to_encode->valid_width : frame_to_encode->width;
+                sei.height = frame_to_encode->valid_height > 0 ? frame_to_encode->valid_height : frame_to_encode->height;
+                sei.detects = frame_to_encode->detects;
+                std::vector<uint8_t> nal;
+                detect_sei_build(ctx->enc_config.codec == H265 ? NAL_CODEC_H265 : NAL_CODEC_H264, sei, nal);
+                std::lock_guard<std::mutex> lock(ctx->sei_mutex);
+                ctx->sei_pending[sei.frame_seq] = std::move(nal);
+            }
+            int ret = encoder->WriteData(frame_to_encode->frame, frame_to_encode->size, rois, frame_to_encode->frame_seq);
+            if(ret != 0 && ctx->sei_enable) {
+                std::lock_guard<std::mutex> lock(ctx->sei_mutex);
+                ctx->sei_pending.erase(frame_to_encode->frame_seq);
+            }
+        }
+
+        // 额外输出档位共享同一份渲染结果
+        if(frame_to_encode && frame_to_encode->frame) {
+            for(auto& profile : ctx->profiles) {
+                profile->encode_frame(*frame_to_encode, ctx->fps);
+            }
+        }
+
+        // 抓拍只在这里入队, JPEG 编码和写文件都在抓拍线程池中完成
+        if(frame_to_encode && frame_to_encode->frame && ctx->snapshot) {
+            ctx->snapshot->on_frame(frame_to_encode);
         }
     }
 }
@@ -194,40 +528,69 @@ void mpp_decoder_frame_callback(void *userdata, int width_stride, int height_str
         info.height = height;
         info.fps = ctx->fps;
         info.format = eFormatType::YUV420SP;
-        int ret = rk_encoder->Initencoder(info, 0, deal_coded_frame, ctx);
+        apply_encoder_config(info, ctx->enc_config);
+        int ret = rk_encoder->Initencoder(info, 0, [ctx, rk_encoder](uint8_t* data, uint32_t size, uint64_t pts, void*) {
+            deal_coded_frame(ctx, rk_encoder->GetOutputTag(), data, size, pts);
+        }, ctx);
         if(ret != 0) {
             delete rk_encoder;
             return;
         }
         if(server_detect != nullptr) {
-            mk_media pMedia = server_detect->getZlmMediaHandle();
-            if(pMedia != nullptr) {
-                mk_media_input_h264(pMedia, info.data, info.size, 0, 0);
-            }
+            server_detect->inputFrame(info.data, info.size, 0, 0);
         }
-        ctx->encoder = rk_encoder;
+        ctx->encoder.store(rk_encoder);
+        ctx->enc_buffer_bytes = rk_encoder->GetBufferBytes();
         
         // 启动编码线程
         ctx->encoding_running = true;
         ctx->encode_thread = std::thread(encode_thread_func, ctx);
     }
     
+    // 等待编码的帧过多(编码跟不上或内存压力下限深), 不分配序列号直接丢弃
+    int max_pending = ctx->max_pending.load();
+    if(max_pending > 0) {
+        std::unique_lock<std::mutex> lock(ctx->pending_mutex);
+        if((int)ctx->pending_frames.size() >= max_pending) {
+            lock.unlock();
+            ctx->pending_dropped++;
+            ctx->encoder.load()->SkipFrames(1);
+            return;
+        }
+    }
+
     // 分配序列号
     uint64_t frame_seq = ctx->frame_seq_counter++;
+    int64_t frame_pts = ctx->decoder ? ctx->decoder->GetFramePts() : 0;
+
+    // 导出给本机其他进程, 没有客户端时直接返回
+    if(ctx->frame_export && format == MPP_FMT_YUV420SP) {
+        ctx->frame_export->publish(data, width, height, width_stride, height_stride, frame_seq, frame_pts);
+    }
     
-    // 负载均衡：尝试找到空闲的推理线程
-    int thread_count = ctx->inferences.size();
+    // 按推理间隔只送部分帧推理, 参与调度的线程数可运行时调整
+    std::shared_ptr<const RuntimeConfig> rt = RuntimeConfigManager::getInstance().get();
+    bool want_inference = rt->infer_stride <= 1 || frame_seq % rt->infer_stride == 0;
+    // 按间隔跳过的帧沿用最近一次的结果, 避免叠加框/SEI/ROI隔帧闪烁
+    bool reuse_detects = !want_inference;
+    // 画面静止或冻结时跳过推理, 同样沿用最近一次的结果
+    if(want_inference && ctx->motion_gate && format == MPP_FMT_YUV420SP) {
+        bool gated = ctx->motion_gate->check((const uint8_t *)data, width, height, width_stride) != GATE_INFER;
+        want_inference = !gated;
+        reuse_detects = gated;
+    }
+    int thread_count = std::min<int>(ctx->inferences.size(), rt->inference_threads);
     bool pushed = false;
     
-    // 轮询所有推理线程
-    for(int i = 0; i < thread_count; i++) {
+    // 负载均衡：轮询参与调度的推理线程, 找到空闲的
+    for(int i = 0; want_inference && i < thread_count; i++) {
         int idx = (ctx->next_inference_idx.fetch_add(1) % thread_count);
         
-        // 检查是否空闲（原子操作，无需锁）
+        // 检查是否有空闲槽位（原子操作，无需锁）
         if(!ctx->inferences[idx]->is_busy()) {
             Inference* inf = ctx->inferences[idx].get();
             
-            // 直接访问 src_frame（因为此时 is_busy == false，推理线程不会访问）
+            // 直接访问空闲槽位的 src_frame（此时流水线各阶段都不会访问它）
             dma_data_t& src_frame = inf->get_src_frame();
             
             int yuv_size = width_stride * height_stride * 3 / 2;
@@ -237,8 +600,7 @@ void mpp_decoder_frame_callback(void *userdata, int width_stride, int height_str
                 
                 // printf("Thread %d: Reallocating source frame buffer: %dx%d\n", idx, width_stride, height_stride);
                 
-                src_frame.release();
-                int ret = src_frame.make_dma(width_stride, height_stride, RK_FORMAT_YCbCr_420_SP, yuv_size);
+                int ret = src_frame.make_dma(width_stride, height_stride, RK_FORMAT_YCbCr_420_SP, yuv_size, "src_frame");
                 if(ret < 0) {
                     printf("src_frame make_dma error\n");
                     continue;
@@ -252,8 +614,12 @@ void mpp_decoder_frame_callback(void *userdata, int width_stride, int height_str
             src_frame.height_stride = height_stride;
             src_frame.format = RK_FORMAT_YCbCr_420_SP;
             src_frame.frame_seq = frame_seq;
+            src_frame.pts = frame_pts;
             
-            memcpy(src_frame.buf, data, yuv_size);
+            {
+                auto guard = src_frame.cpu_access();
+                memcpy(src_frame.buf, data, yuv_size);
+            }
             
             // 触发推理（设置 is_busy = true 后，推理线程才会访问 src_frame）
             inf->trigger_inference(frame_seq);
@@ -262,19 +628,48 @@ void mpp_decoder_frame_callback(void *userdata, int width_stride, int height_str
         }
     }
     
-    // 如果所有线程都忙，直接编码（保持顺序）
+    if(ctx->dropper && want_inference) {
+        ctx->dropper->report_load(!pushed);
+    }
+    // 确实送入推理后才以本帧作为门控参考帧
+    if(pushed && ctx->motion_gate && format == MPP_FMT_YUV420SP) {
+        ctx->motion_gate->commit_reference();
+    }
+
+    // 不推理的帧或所有线程都忙，直接编码（保持顺序）
     if(!pushed) {
-        printf("All inference threads busy, encoding frame %lu directly\n", frame_seq);
+        if(want_inference) {
+            printf("All inference threads busy, encoding frame %lu directly\n", frame_seq);
+        }
         int yuv_size = width_stride * height_stride * 3 / 2;
     
         auto direct_frame = std::make_shared<code_frame_t>();
         direct_frame->frame_seq = frame_seq;
-        direct_frame->size = yuv_size;
-        direct_frame->frame = (u_char*)malloc(yuv_size);
+        direct_frame->pts = frame_pts;
         direct_frame->width = width_stride;
         direct_frame->height = height_stride;
+        direct_frame->valid_width = width;
+        direct_frame->valid_height = height;
             
-        memcpy(direct_frame->frame, data, yuv_size);
+        if(direct_frame->alloc(yuv_size)) {
+            memcpy(direct_frame->frame, data, yuv_size);
+        }
+        if(reuse_detects) {
+            {
+                std::lock_guard<std::mutex> lock(ctx->last_detect_mutex);
+                direct_frame->detects = ctx->last_detects;
+            }
+            direct_frame->reused = true;
+            // 推理线程的 RGA 叠加不经过这里, 框和标签由CPU画
+            if(rt->overlay && direct_frame->frame) {
+                for(const auto& det : direct_frame->detects) {
+                    YUVLabelRenderer::getInstance().drawBox(direct_frame->frame, width_stride, height_stride,
+                                                            det.box.left, det.box.top, det.box.right, det.box.bottom);
+                    YUVLabelRenderer::getInstance().drawDetection(direct_frame->frame, width_stride, height_stride,
+                                                                  det.cls_id, det.prop, std::max(0, det.box.left), std::max(0, det.box.top));
+                }
+            }
+        }
         std::unique_lock<std::mutex> lock(ctx->pending_mutex);
         ctx->pending_frames[frame_seq] = direct_frame;
         lock.unlock();
@@ -284,18 +679,54 @@ void mpp_decoder_frame_callback(void *userdata, int width_stride, int height_str
 
 
 
-void API_CALL on_track_frame_out(void *user_data, mk_frame frame) {
-    FrameContext *ctx = (FrameContext *)user_data;
-    if(ctx == nullptr) {
-        return;
+static void on_pulled_packet(FrameContext *ctx, int code, const char *data, size_t size, uint64_t dts, uint64_t pts) {
+    // 不解码直接统计拉流的码率/帧率/GOP
+    if(ctx->pull_stats_interval > 0 && (code == MKCodecH264 || code == MKCodecH265)) {
+        eNalCodec nal_codec = code == MKCodecH265 ? NAL_CODEC_H265 : NAL_CODEC_H264;
+        if(ctx->pull_stats == nullptr || ctx->pull_stats->get_codec() != nal_codec) {
+            ctx->pull_stats = std::make_unique<NalStreamAnalyzer>(nal_codec);
+            ctx->pull_stats_pts = pts;
+        }
+        ctx->pull_stats->input((const uint8_t *)data, size, pts);
+        if(pts - ctx->pull_stats_pts >= (uint64_t)ctx->pull_stats_interval * 1000) {
+            nal_stream_stats_t stats = ctx->pull_stats->take_stats();
+            printf("pull stream: %.0f kbps, %.1f fps, gop %d (avg %.1f), keyframes %lu, non-ref %lu, sei %lu\n",
+                   stats.bitrate_kbps, stats.fps, stats.last_gop, stats.avg_gop,
+                   stats.total_keyframes, stats.window_non_ref, stats.window_sei);
+            if(ctx->decoder) {
+                size_t usage, max_usage;
+                int limit;
+                ctx->decoder->GetBufferUsage(&usage, &max_usage, &limit);
+                printf("decoder buffers: limit %d, usage %.1f MB, max usage %.1f MB\n",
+                       limit, usage / (1024.0 * 1024.0), max_usage / (1024.0 * 1024.0));
+            }
+            // 归还长时间空闲的DMA缓冲
+            DmaPool::getInstance().trim(30000);
+            DmaPool::getInstance().dump_stats();
+            FramePool::getInstance().report();
+            MemoryGovernor::getInstance().dump();
+            if(ctx->pending_dropped.load() > 0) {
+                printf("pending frames dropped: %lu (max pending %d)\n",
+                       ctx->pending_dropped.load(), ctx->max_pending.load());
+            }
+            if(ctx->frame_export) {
+                frame_export_stats_t exp = ctx->frame_export->get_stats();
+                printf("frame export: exported %lu, delivered %lu, dropped %lu, no buffer %lu, leased %lu\n",
+                       exp.exported, exp.delivered, exp.dropped, exp.no_buffer, exp.leased);
+            }
+            if(ctx->motion_gate) {
+                motion_gate_stats_t gate = ctx->motion_gate->get_stats();
+                printf("motion gate: analysed %lu, static %lu, duplicate %lu, forced %lu, %.0f us/frame\n",
+                       gate.analysed, gate.skipped_static, gate.skipped_duplicate, gate.forced, gate.avg_cost_us);
+            }
+            if(ctx->dropper) {
+                drop_stats_t drop = ctx->dropper->get_stats();
+                printf("pull stream drop: level %d, total %lu, non-ref %lu, key-only %lu, wait-key %lu\n",
+                       ctx->dropper->get_level(), drop.total, drop.non_ref, drop.key_only, drop.wait_key);
+            }
+            ctx->pull_stats_pts = pts;
+        }
     }
-    int code = mk_frame_codec_id(frame);    
-    
-    const char *data = mk_frame_get_data(frame);
-    size_t size = mk_frame_get_data_size(frame);
-
-    uint64_t pts = mk_frame_get_pts(frame);
-    uint64_t dts = mk_frame_get_dts(frame);
 
     // 推送原始编码流到 server_raw
     if(server_raw != nullptr) {
@@ -309,6 +740,16 @@ void API_CALL on_track_frame_out(void *user_data, mk_frame frame) {
         }
     }
     
+    // 过载时在送入解码器前丢弃可丢弃的帧
+    if(ctx->dropper && (code == MKCodecH264 || code == MKCodecH265) &&
+       ctx->dropper->should_drop(code == MKCodecH265 ? NAL_CODEC_H265 : NAL_CODEC_H264, (const uint8_t *)data, size)) {
+        RKEncodeVideo *encoder = ctx->encoder.load();
+        if(encoder != nullptr) {
+            encoder->SkipFrames(1);
+        }
+        return;
+    }
+
     if (ctx->decoder == NULL) {
         MppDecoder *decoder = new MppDecoder();
         MppCodingType video_type = ConvertCodecType(code);
@@ -324,111 +765,484 @@ void API_CALL on_track_frame_out(void *user_data, mk_frame frame) {
             return;
         }
         decoder->SetCallback(mpp_decoder_frame_callback);
+        decoder->SetBufferConfig(ctx->dec_buffer_count, ctx->dec_extra_buffers);
         ctx->decoder = decoder;
     }
-    ctx->decoder->Decode((uint8_t *)data, size, 0);
+    ctx->decoder->Decode((uint8_t *)data, size, 0, pts);
+
+    size_t usage, max_usage;
+    int limit;
+    ctx->decoder->GetBufferUsage(&usage, &max_usage, &limit);
+    ctx->dec_buffer_bytes = usage;
+}
+
+// 流水线就绪前缓存最近一个GOP(从参数集/关键帧开始), 就绪后先送入缓存再处理新包,
+// 拉流连接可以与模型加载并行, 不用等下一个关键帧
+static void cache_startup_packet(FrameContext *ctx, int code, const char *data, size_t size,
+                                 uint64_t dts, uint64_t pts, uint32_t flags) {
+    bool gop_start = flags & (MK_FRAME_FLAG_IS_KEY | MK_FRAME_FLAG_IS_CONFIG);
+    // 参数集和紧随其后的关键帧属于同一个GOP起点
+    if(gop_start && !ctx->startup_gop_start) {
+        ctx->startup_packets.clear();
+        ctx->startup_bytes = 0;
+    }
+    ctx->startup_gop_start = gop_start;
+    if(ctx->startup_packets.empty() && !gop_start) {
+        return;
+    }
+    if(ctx->startup_bytes + size > STARTUP_CACHE_MAX_BYTES) {
+        // GOP过长, 放弃缓存, 等待下一个关键帧
+        ctx->startup_packets.clear();
+        ctx->startup_bytes = 0;
+        return;
+    }
+    startup_packet_t packet;
+    packet.codec = code;
+    packet.data.assign((const uint8_t *)data, (const uint8_t *)data + size);
+    packet.dts = dts;
+    packet.pts = pts;
+    ctx->startup_packets.push_back(std::move(packet));
+    ctx->startup_bytes += size;
+    ctx->startup_pending = true;
+}
+
+void API_CALL on_track_frame_out(void *user_data, mk_frame frame) {
+    FrameContext *ctx = (FrameContext *)user_data;
+    if(ctx == nullptr) {
+        return;
+    }
+    int code = mk_frame_codec_id(frame);    
+    
+    const char *data = mk_frame_get_data(frame);
+    size_t size = mk_frame_get_data_size(frame);
+
+    uint64_t pts = mk_frame_get_pts(frame);
+    uint64_t dts = mk_frame_get_dts(frame);
+
+    if(!ctx->pipeline_ready.load() || ctx->startup_pending.load()) {
+        std::vector<startup_packet_t> packets;
+        {
+            std::lock_guard<std::mutex> lock(ctx->startup_mutex);
+            if(!ctx->pipeline_ready.load()) {
+                cache_startup_packet(ctx, code, data, size, dts, pts, mk_frame_get_flags(frame));
+                return;
+            }
+            packets.swap(ctx->startup_packets);
+            ctx->startup_bytes = 0;
+            ctx->startup_pending = false;
+        }
+        if(!packets.empty()) {
+            printf("startup: replay %zu cached packets\n", packets.size());
+        }
+        for(const auto& packet : packets) {
+            on_pulled_packet(ctx, packet.codec, (const char *)packet.data.data(), packet.data.size(),
+                             packet.dts, packet.pts);
+        }
+    }
+    on_pulled_packet(ctx, code, data, size, dts, pts);
+}
+
+static void schedule_reconnect(FrameContext *ctx) {
+    int64_t expected = 0;
+    ctx->outage_begin_us.compare_exchange_strong(expected, get_time_us());
+    ctx->reconnect_us = 0;
+
+    std::lock_guard<std::mutex> lock(pull_session.mutex);
+    if(pull_session.exiting) {
+        return;
+    }
+    pull_session.need_reconnect = true;
+    pull_session.cv.notify_all();
 }
 
 void API_CALL on_mk_play_event_func(void *user_data, int err_code, const char *err_msg, 
                                     mk_track tracks[], int track_count)
 {
+    FrameContext *ctx = (FrameContext *)user_data;
     if (err_code == 0) {
         printf("play success!\n");
+        {
+            std::lock_guard<std::mutex> lock(pull_session.mutex);
+            pull_session.delay_ms = pull_session.min_delay_ms;
+            pull_session.retry = 0;
+        }
         for (int i = 0; i < track_count; ++i) {
             if (mk_track_is_video(tracks[i])) {
                 log_info("got video track: %s", mk_track_codec_name(tracks[i]));
-                mk_track_add_delegate(tracks[i], on_track_frame_out, user_data);
-                auto ptr = (FrameContext*)user_data;
-                if(ptr != nullptr) {
-                    ptr->fps = mk_track_video_fps(tracks[i]);
+                if(ctx != nullptr) {
+                    ctx->fps = mk_track_video_fps(tracks[i]);
+                    int codec = mk_track_codec_id(tracks[i]);
+                    // 重连: 编码器/推理/DMA缓冲保持不变, 解码器只复位, 编码格式变化时才重建
+                    if(ctx->decoder != nullptr) {
+                        if(ctx->pull_codec == codec) {
+                            ctx->decoder->Reset();
+                        } else {
+                            delete ctx->decoder;
+                            ctx->decoder = nullptr;
+                        }
+                    }
+                    ctx->pull_codec = codec;
+                    ctx->pull_stats.reset();
+                    if(ctx->outage_begin_us.load() != 0) {
+                        ctx->reconnect_us = get_time_us();
+                    }
                 }
+                mk_track_add_delegate(tracks[i], on_track_frame_out, user_data);
             }
         }
     } else {
         printf("play failed: %d %s\n", err_code, err_msg);
+        if(ctx != nullptr) {
+            schedule_reconnect(ctx);
+        }
     }
 }
 
 void API_CALL on_mk_shutdown_func(void *user_data, int err_code, const char *err_msg, 
                                   mk_track tracks[], int track_count) {
     printf("play interrupted: %d %s\n", err_code, err_msg);
+    FrameContext *ctx = (FrameContext *)user_data;
+    if(ctx != nullptr) {
+        schedule_reconnect(ctx);
+    }
 }
 
-int process_video_rtsp(FrameContext *ctx, const char *url) {
-    mk_config config;
-    memset(&config, 0, sizeof(mk_config));
-    config.log_mask = LOG_CONSOLE;
-    mk_env_init(&config);
-    
+static mk_player create_player(FrameContext *ctx, const char *url) {
     mk_player player = mk_player_create();
     mk_player_set_option(player, "rtp_type", "tcp");
     mk_player_set_on_result(player, on_mk_play_event_func, ctx);
     mk_player_set_on_shutdown(player, on_mk_shutdown_func, ctx);
     mk_player_play(player, url);
+    return player;
+}
 
-    sem_init(&exit_sem, 0, 0);
-    signal(SIGINT, sigint_handler);
-    printf("Press Ctrl+C to exit\n");
+// 重连线程, 不在 ZLM 回调线程中释放/创建播放器
+static void pull_reconnect_func(PullSession *session) {
+    std::unique_lock<std::mutex> lock(session->mutex);
+    while(!session->exiting) {
+        session->cv.wait(lock, [session]() {
+            return session->need_reconnect || session->exiting;
+        });
+        if(session->exiting) {
+            break;
+        }
+        session->need_reconnect = false;
+
+        int delay_ms = session->delay_ms;
+        session->cv.wait_for(lock, std::chrono::milliseconds(delay_ms), [session]() {
+            return session->exiting;
+        });
+        if(session->exiting) {
+            break;
+        }
+        session->retry++;
+        session->delay_ms = std::min(delay_ms * 2, session->max_delay_ms);
+        printf("reconnect %s (retry %d, delay %d ms)\n", session->url.c_str(), session->retry, delay_ms);
+
+        mk_player old_player = session->player;
+        session->player = nullptr;
+        lock.unlock();
+        if(old_player) {
+            mk_player_release(old_player);
+        }
+        mk_player player = create_player(session->ctx, session->url.c_str());
+        lock.lock();
+        session->player = player;
+    }
+}
+
+// 开始拉流, 之后由重连线程维持连接
+static void start_pull_stream(FrameContext *ctx, const char *url, int reconnect_min_ms, int reconnect_max_ms) {
+    pull_session.url = url;
+    pull_session.ctx = ctx;
+    pull_session.min_delay_ms = reconnect_min_ms > 0 ? reconnect_min_ms : 500;
+    pull_session.max_delay_ms = std::max(reconnect_max_ms, pull_session.min_delay_ms);
+    pull_session.delay_ms = pull_session.min_delay_ms;
+    {
+        std::lock_guard<std::mutex> lock(pull_session.mutex);
+        pull_session.player = create_player(ctx, url);
+    }
+    pull_session.thread = std::thread(pull_reconnect_func, &pull_session);
+}
+
+// 等待 Ctrl+C 后停止拉流
+static void wait_exit_and_stop_pull() {
     sem_wait(&exit_sem);
     sem_destroy(&exit_sem);
 
-    if (player) {
-        mk_player_release(player);
+    {
+        std::lock_guard<std::mutex> lock(pull_session.mutex);
+        pull_session.exiting = true;
     }
-    return 0;
+    pull_session.cv.notify_all();
+    if (pull_session.thread.joinable()) {
+        pull_session.thread.join();
+    }
+    if (pull_session.player) {
+        mk_player_release(pull_session.player);
+        pull_session.player = nullptr;
+    }
+}
+
+// 启动阶段耗时
+static void log_startup_phase(const char *phase, int64_t begin_us, int64_t startup_us) {
+    int64_t now_us = get_time_us();
+    printf("startup: %-16s %7.1f ms (at %.1f ms)\n", phase, (now_us - begin_us) / 1000.0, (now_us - startup_us) / 1000.0);
 }
 
 int main(int argc, char **argv) {
+    int64_t startup_us = get_time_us();
     Config config = loadConfig("config.ini");
 
-    int ret = init_post_process();
+    int ret = init_post_process(config.label_path.c_str());
     if(ret < 0) {
         return ret;
     }
     
-    YUVLabelRenderer::Config font_config;
-    font_config.font_size = 18;
-    font_config.font_path = "/usr/share/fonts/truetype/dejavu/DejaVuSans-Bold.ttf";
-    font_config.font_color_r = 255;
-    font_config.font_color_g = 255;
-    font_config.font_color_b = 0;
-    font_config.bg_color_r = 0;
-    font_config.bg_color_g = 0;
-    font_config.bg_color_b = 0;
-    font_config.bg_alpha = 255;
-    extern char* labels[OBJ_CLASS_NUM];
-    ret = YUVLabelRenderer::getInstance().initialize(labels, font_config);
-    if(!ret) {
-        return -2;
-    }
+    // 阈值/推理间隔/线程数/叠加样式/码率可热更新
+    RuntimeConfigManager& runtime_config = RuntimeConfigManager::getInstance();
+    runtime_config.load("config.ini");
+
+    // 在创建工作线程之前初始化, 缺页/TLB 计数覆盖之后的所有线程
+    FramePool::getInstance().configure(ParseFramePages(config.framePages), config.framePoolFree);
+    DmaPool::getInstance().set_default_heap("/dev/dma_heap/" + config.dmaHeap);
+    DmaPool::getInstance().configure((size_t)config.dmaPoolMaxFreeMB * 1024 * 1024, config.dmaPoolForceMemfd);
 
     FrameContext frame_ctx;
-    for(int i = 0; i < config.inference_threads; i++) {
-        auto inference = std::make_unique<Inference>();
-        ret = inference->initialize(config.model_path.c_str(), i == 0 ? true : false);
-        if(ret != 0) {
-            printf("initialize inference %d error ret=%d\n", i, ret);
-            return 1;
+    frame_ctx.startup_us = startup_us;
+    frame_ctx.max_pending = config.memory.max_pending;
+    frame_ctx.sei_enable = config.detectSei;
+
+    // 内存预算: 各组件注册用量和压力回调
+    MemoryGovernor& governor = MemoryGovernor::getInstance();
+    governor.configure(config.memory);
+    governor.register_component("dma_pool", []() {
+        return DmaPool::getInstance().get_total_bytes();
+    }, [](eMemPressure pressure) {
+        if(pressure != MEM_PRESSURE_NORMAL) {
+            DmaPool::getInstance().trim(0);
         }
-        
+    });
+    int frame_pool_free = config.framePoolFree;
+    governor.register_component("frame_pool", []() {
+        return FramePool::getInstance().get_total_bytes();
+    }, [frame_pool_free](eMemPressure pressure) {
+        int keep = pressure == MEM_PRESSURE_NORMAL ? frame_pool_free : (pressure == MEM_PRESSURE_HIGH ? 2 : 0);
+        FramePool::getInstance().trim(keep);
+    });
+    governor.register_component("decoder", [&frame_ctx]() {
+        return frame_ctx.dec_buffer_bytes.load();
+    });
+    governor.register_component("encoder", [&frame_ctx]() {
+        return frame_ctx.enc_buffer_bytes.load();
+    });
+    int max_pending = config.memory.max_pending;
+    governor.register_component("pending", nullptr, [&frame_ctx, max_pending](eMemPressure pressure) {
+        int limit = max_pending;
+        if(pressure == MEM_PRESSURE_HIGH) {
+            limit = max_pending > 0 ? std::max(max_pending / 2, 2) : 4;
+        } else if(pressure == MEM_PRESSURE_CRITICAL) {
+            limit = 2;
+        }
+        frame_ctx.max_pending = limit;
+    });
+    governor.start();
+
+    // 内存监控和配置监视线程引用栈上的 frame_ctx, 任何返回路径上都先停止并注销
+    struct ServiceStopper {
+        ~ServiceStopper() {
+            stop();
+        }
+        void stop() {
+            MemoryGovernor& governor = MemoryGovernor::getInstance();
+            governor.stop();
+            for(const char *name : {"dma_pool", "frame_pool", "decoder", "encoder", "pending", "profiles", "snapshot"}) {
+                governor.unregister_component(name);
+            }
+            RuntimeConfigManager::getInstance().stop();
+        }
+    } service_stopper;
+
+    frame_ctx.enc_config = config.detectEncoder;
+    frame_ctx.pull_stats_interval = config.pullStatsInterval;
+    frame_ctx.dec_buffer_count = config.decoderBuffers;
+    frame_ctx.dec_extra_buffers = config.decoderExtraBuffers;
+    if(config.overload.mode != DROP_OFF) {
+        frame_ctx.dropper = std::make_unique<FrameDropper>(config.overload);
+    }
+    if(config.motionGate.enable) {
+        frame_ctx.motion_gate = std::make_unique<MotionGate>(config.motionGate);
+    }
+
+    sem_init(&exit_sem, 0, 0);
+    signal(SIGINT, sigint_handler);
+
+    // 最先建立拉流连接, RTSP握手与下面的初始化并行; 流水线就绪前收到的包按GOP缓存
+    mk_config zlm_config = {
+        .thread_num = 0,
+        .log_level = 0,
+        .log_mask = LOG_CONSOLE,
+        .log_file_path = NULL,
+        .log_file_days = 0,
+        .ini_is_path = 0,
+        .ini = NULL,
+        .ssl_is_path = 0,
+        .ssl = NULL,
+        .ssl_pwd = NULL
+    };
+    mk_env_init(&zlm_config);
+    start_pull_stream(&frame_ctx, config.pullStream.c_str(), config.pullReconnectMinMs, config.pullReconnectMaxMs);
+    log_startup_phase("pull started", startup_us, startup_us);
+
+    // 字体加载 / 推流服务与输出档位 / 模型加载与预热 相互独立, 并行执行
+    auto render_task = std::async(std::launch::async, [&runtime_config, startup_us]() {
+        int64_t begin_us = get_time_us();
+        YUVLabelRenderer::Config font_config;
+        font_config.font_path = "/usr/share/fonts/truetype/dejavu/DejaVuSans-Bold.ttf";
+        apply_label_style(font_config, *runtime_config.get());
+        extern char* labels[OBJ_CLASS_MAX];
+        bool ok = YUVLabelRenderer::getInstance().initialize(labels, font_config);
+        log_startup_phase("label renderer", begin_us, startup_us);
+        return ok;
+    });
+
+    auto server_task = std::async(std::launch::async, [&config, &frame_ctx, &governor, startup_us]() {
+        int64_t begin_us = get_time_us();
+        PushServer m_server_config = config.pushServer;
+
+        m_server_config.stream_conifg = config.detectStream;
+        server_detect = std::make_unique<RtspServer>(m_server_config);
+        server_detect->initZlmMedia(config.detectEncoder.codec == H265 ? MKCodecH265 : MKCodecH264);
+        if(config.detectEncoder.idr_on_play) {
+            // 新观众连接时立即出IDR, gop 可以配置得更长以节省码率
+            server_detect->setOnPlayerAttach([&frame_ctx]() {
+                RKEncodeVideo *encoder = frame_ctx.encoder.load();
+                if(encoder != nullptr) {
+                    printf("detect stream player attached, request IDR\n");
+                    encoder->RequestIDR();
+                }
+            });
+        }
+
+        m_server_config.stream_conifg = config.originStream;
+        server_raw = std::make_unique<RtspServer>(m_server_config);
+        server_raw->initZlmMedia();
+
+        for(const auto& profile_config : config.profiles) {
+            // 编码缓冲 + 缩放缓冲的估算, 未配置尺寸时按1080p估算
+            int est_width = profile_config.width > 0 ? profile_config.width : 1920;
+            int est_height = profile_config.height > 0 ? profile_config.height : est_width * 9 / 16;
+            size_t profile_bytes = (size_t)est_width * est_height * 3 / 2 * (profile_config.encoder.buffers * 2 + 1);
+            if(!governor.admit("profile " + profile_config.name, profile_bytes)) {
+                continue;
+            }
+            auto profile = std::make_unique<OutputProfile>(profile_config, config.pushServer);
+            profile->initialize();
+            frame_ctx.profiles.push_back(std::move(profile));
+        }
+        log_startup_phase("servers", begin_us, startup_us);
+    });
+
+    InferRegionPlanner::getInstance().configure(config.inferRegions);
+
+    // 模型文件只读一次, 各实例的 rknn_init 和预热并行
+    int64_t model_begin_us = get_time_us();
+    std::vector<unsigned char> model_data;
+    if(!Inference::read_model(config.model_path.c_str(), model_data)) {
+        ret = 1;
+    }
+    std::vector<std::unique_ptr<Inference>> inferences;
+    std::vector<std::future<int>> model_tasks;
+    for(int i = 0; ret == 0 && i < config.inference_threads; i++) {
+        inferences.push_back(std::make_unique<Inference>());
+        Inference *inference = inferences.back().get();
+        inference->set_pipeline_depth(config.pipelineDepth);
+        int warmup_runs = config.warmupRuns;
+        model_tasks.push_back(std::async(std::launch::async, [inference, &model_data, i, warmup_runs]() {
+            int init_ret = inference->initialize(model_data, i == 0 ? true : false);
+            if(init_ret != 0) {
+                printf("initialize inference %d error ret=%d\n", i, init_ret);
+                return init_ret;
+            }
+            return inference->warmup(warmup_runs);
+        }));
+    }
+    for(auto& task : model_tasks) {
+        int task_ret = task.get();
+        if(task_ret != 0 && ret == 0) {
+            ret = task_ret;
+        }
+    }
+    model_data.clear();
+    model_data.shrink_to_fit();
+    log_startup_phase("model", model_begin_us, startup_us);
+    // [detect] classes/class_thresh 中的类别号按模型实际类别数校验, 热更新时同样检查
+    if(ret == 0 && !inferences.empty() && !runtime_config.set_num_classes(inferences[0]->get_num_classes())) {
+        ret = 1;
+    }
+
+    bool render_ok = render_task.get();
+    server_task.get();
+    // 档位列表此后不再变化, 编码器在首帧时创建, 用量随之更新
+    governor.register_component("profiles", [&frame_ctx]() {
+        size_t bytes = 0;
+        for(const auto& profile : frame_ctx.profiles) {
+            bytes += profile->get_buffer_bytes();
+        }
+        return bytes;
+    });
+    if(ret != 0 || !render_ok) {
+        sem_post(&exit_sem);
+        wait_exit_and_stop_pull();
+        return ret != 0 ? 1 : -2;
+    }
+
+    for(auto& inference : inferences) {
         inference->set_encode_callback([&frame_ctx](std::shared_ptr<code_frame_t> frame) {
             inference_encode_callback(&frame_ctx, frame);
         });
-        
         frame_ctx.inferences.push_back(std::move(inference));
     }
 
-    PushServer m_server_config = config.pushServer;
+    runtime_config.subscribe([](const RuntimeConfig& old_config, const RuntimeConfig& new_config) {
+        YUVLabelRenderer::Config style = YUVLabelRenderer::getInstance().getConfig();
+        apply_label_style(style, new_config);
+        YUVLabelRenderer::getInstance().updateConfig(style);
+    });
+    runtime_config.start(config.configWatch);
+
+    if(config.snapshot.enable) {
+        frame_ctx.snapshot = std::make_unique<SnapshotService>();
+        frame_ctx.snapshot->initialize(config.snapshot);
+        SnapshotService *snapshot = frame_ctx.snapshot.get();
+        governor.register_component("snapshot", [snapshot]() {
+            return snapshot->get_buffer_bytes();
+        });
+    }
+
+    if(config.frameExport.enable) {
+        frame_ctx.frame_export = std::make_unique<FrameExporter>();
+        if(frame_ctx.frame_export->initialize(config.frameExport) != 0) {
+            frame_ctx.frame_export.reset();
+        }
+    }
 
-    m_server_config.stream_conifg = config.detectStream;
-    server_detect = std::make_unique<RtspServer>(m_server_config);
-    server_detect->initZlmMedia();
+    if(config.detectRing.enable) {
+        frame_ctx.detect_ring = std::make_unique<DetectRingWriter>();
+        if(frame_ctx.detect_ring->initialize(config.detectRing) != 0) {
+            frame_ctx.detect_ring.reset();
+        }
+    }
 
-    m_server_config.stream_conifg = config.originStream;
-    server_raw = std::make_unique<RtspServer>(m_server_config);
-    server_raw->initZlmMedia();
+    {
+        // 放行缓存的启动包, 下一个拉流包到达时回放
+        std::lock_guard<std::mutex> lock(frame_ctx.startup_mutex);
+        frame_ctx.pipeline_ready = true;
+    }
+    log_startup_phase("pipeline ready", startup_us, startup_us);
+    printf("Press Ctrl+C to exit\n");
 
-    process_video_rtsp(&frame_ctx, config.pullStream.c_str());
+    wait_exit_and_stop_pull();
 
     deinit_post_process();
 
@@ -443,13 +1257,20 @@ int main(int argc, char **argv) {
         delete frame_ctx.decoder;
         frame_ctx.decoder = nullptr;
     }
-    if (frame_ctx.encoder != nullptr) {
-        delete frame_ctx.encoder;
-        frame_ctx.encoder = nullptr;
+    // 观众接入回调在 ZLM 线程中使用编码器, 先摘除回调并停止检测流服务再释放
+    server_detect->setOnPlayerAttach(nullptr);
+    server_detect->stopServer();
+    RKEncodeVideo *encoder = frame_ctx.encoder.exchange(nullptr);
+    if (encoder != nullptr) {
+        delete encoder;
     }
 
+    service_stopper.stop();
+    frame_ctx.snapshot.reset();
+    frame_ctx.detect_ring.reset();
+    frame_ctx.frame_export.reset();
+    frame_ctx.profiles.clear();
     frame_ctx.inferences.clear();
-    server_detect->stopServer();
     server_raw->stopServer();
 
     return 0;
@@ -0,0 +1,173 @@
+#include "mem_governor.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <unistd.h>
+
+// /proc/meminfo 中的 MemAvailable(字节), 读取失败返回0
+static size_t get_mem_available() {
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    char line[128];
+    size_t available_kb = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "MemAvailable: %zu kB", &available_kb) == 1) {
+            break;
+        }
+    }
+    fclose(fp);
+    return available_kb * 1024;
+}
+
+static size_t get_process_rss() {
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    size_t pages = 0, rss_pages = 0;
+    if (fscanf(fp, "%zu %zu", &pages, &rss_pages) != 2) {
+        rss_pages = 0;
+    }
+    fclose(fp);
+    return rss_pages * sysconf(_SC_PAGESIZE);
+}
+
+void MemoryGovernor::configure(const MemoryConfig& config) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_config = config;
+}
+
+void MemoryGovernor::register_component(const std::string& name, UsageProbe probe, PressureHandler handler) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_components.push_back({name, probe, handler});
+}
+
+void MemoryGovernor::unregister_component(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_components.begin(); it != m_components.end(); ++it) {
+        if (it->name == name) {
+            m_components.erase(it);
+            break;
+        }
+    }
+}
+
+size_t MemoryGovernor::total_usage_locked() {
+    size_t used = 0;
+    for (const auto& component : m_components) {
+        if (component.probe) {
+            used += component.probe();
+        }
+    }
+    return used;
+}
+
+eMemPressure MemoryGovernor::calc_pressure(size_t used, size_t available) {
+    eMemPressure pressure = MEM_PRESSURE_NORMAL;
+    size_t budget = (size_t)m_config.budget_mb * 1024 * 1024;
+    if (budget > 0) {
+        if (used >= budget * m_config.critical_ratio) {
+            pressure = MEM_PRESSURE_CRITICAL;
+        } else if (used >= budget * m_config.high_ratio) {
+            pressure = MEM_PRESSURE_HIGH;
+        }
+    }
+    // 预算之外的内存(模型/其他进程)同样会导致 OOM, 按系统可用内存兜底
+    size_t reserve = (size_t)m_config.min_available_mb * 1024 * 1024;
+    if (available > 0 && reserve > 0) {
+        if (available < reserve) {
+            pressure = MEM_PRESSURE_CRITICAL;
+        } else if (available < reserve * 2 && pressure < MEM_PRESSURE_HIGH) {
+            pressure = MEM_PRESSURE_HIGH;
+        }
+    }
+    return pressure;
+}
+
+bool MemoryGovernor::admit(const std::string& name, size_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t used = total_usage_locked();
+    size_t budget = (size_t)m_config.budget_mb * 1024 * 1024;
+    bool ok = m_pressure.load() == MEM_PRESSURE_NORMAL &&
+              (budget == 0 || used + bytes < budget * m_config.high_ratio);
+    if (!ok) {
+        printf("memory governor: reject %s (%.1f MB), used %.1f MB, budget %d MB, pressure %d\n",
+               name.c_str(), bytes / (1024.0 * 1024.0), used / (1024.0 * 1024.0),
+               m_config.budget_mb, m_pressure.load());
+    }
+    return ok;
+}
+
+void MemoryGovernor::start() {
+    std::lock_guard<std::mutex> lock(m_thread_mutex);
+    if (m_running) {
+        return;
+    }
+    m_running = true;
+    m_thread = std::thread(&MemoryGovernor::poll_func, this);
+}
+
+void MemoryGovernor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_thread_mutex);
+        m_running = false;
+    }
+    m_thread_cv.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void MemoryGovernor::poll_func() {
+    std::unique_lock<std::mutex> thread_lock(m_thread_mutex);
+    while (m_running) {
+        m_thread_cv.wait_for(thread_lock, std::chrono::milliseconds(m_config.poll_ms), [this]() {
+            return !m_running;
+        });
+        if (!m_running) {
+            break;
+        }
+
+        std::vector<PressureHandler> handlers;
+        eMemPressure pressure;
+        size_t used;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            used = total_usage_locked();
+            pressure = calc_pressure(used, get_mem_available());
+            if (pressure == m_pressure.load()) {
+                continue;
+            }
+            m_pressure = pressure;
+            for (const auto& component : m_components) {
+                if (component.handler) {
+                    handlers.push_back(component.handler);
+                }
+            }
+        }
+
+        printf("memory governor: pressure -> %d, used %.1f MB\n", pressure, used / (1024.0 * 1024.0));
+        // 回调中可能会调用各组件的锁, 不持有 m_mutex
+        for (auto& handler : handlers) {
+            handler(pressure);
+        }
+    }
+}
+
+void MemoryGovernor::dump() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t used = 0;
+    printf("memory:");
+    for (const auto& component : m_components) {
+        if (component.probe) {
+            size_t bytes = component.probe();
+            used += bytes;
+            printf(" %s %.1f MB,", component.name.c_str(), bytes / (1024.0 * 1024.0));
+        }
+    }
+    printf(" total %.1f MB / budget %d MB, rss %.1f MB, available %.1f MB, pressure %d\n",
+           used / (1024.0 * 1024.0), m_config.budget_mb, get_process_rss() / (1024.0 * 1024.0),
+           get_mem_available() / (1024.0 * 1024.0), m_pressure.load());
+}
@@ -0,0 +1,195 @@
+#include "motion_gate.h"
+
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static int64_t monotonic_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline uint64_t hash_mix(uint64_t h, uint64_t v) {
+    h ^= v;
+    h *= 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+}
+
+// 整行哈希, 每次处理8字节
+static uint64_t hash_row(uint64_t h, const uint8_t *p, int n) {
+    int x = 0;
+    for(; x + 8 <= n; x += 8) {
+        uint64_t v;
+        memcpy(&v, p + x, 8);
+        h = hash_mix(h, v);
+    }
+    for(; x < n; x++) {
+        h = hash_mix(h, p[x]);
+    }
+    return h;
+}
+
+// 水平每4个像素取平均, 输出 n 个
+static void decimate_row(const uint8_t *src, uint8_t *dst, int n) {
+    int x = 0;
+#if defined(__ARM_NEON)
+    for(; x + 16 <= n; x += 16) {
+        uint8x16x4_t p = vld4q_u8(src + x * 4);
+        uint8x16_t a = vrhaddq_u8(p.val[0], p.val[1]);
+        uint8x16_t b = vrhaddq_u8(p.val[2], p.val[3]);
+        vst1q_u8(dst + x, vrhaddq_u8(a, b));
+    }
+#elif defined(__SSE2__)
+    const __m128i mask16 = _mm_set1_epi16(0x00ff);
+    const __m128i mask32 = _mm_set1_epi32(0x0000ffff);
+    for(; x + 16 <= n; x += 16) {
+        __m128i quad[4];
+        for(int i = 0; i < 4; i++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + x * 4 + i * 16));
+            __m128i pair = _mm_avg_epu16(_mm_and_si128(v, mask16), _mm_srli_epi16(v, 8));
+            quad[i] = _mm_avg_epu16(_mm_and_si128(pair, mask32), _mm_srli_epi32(pair, 16));
+        }
+        __m128i lo = _mm_packs_epi32(quad[0], quad[1]);
+        __m128i hi = _mm_packs_epi32(quad[2], quad[3]);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for(; x < n; x++) {
+        const uint8_t *p = src + x * 4;
+        dst[x] = (uint8_t)((p[0] + p[1] + p[2] + p[3] + 2) >> 2);
+    }
+}
+
+static uint32_t sad_row(const uint8_t *a, const uint8_t *b, int n) {
+    uint32_t sum = 0;
+    int x = 0;
+#if defined(__ARM_NEON)
+    uint16x8_t acc = vdupq_n_u16(0);
+    for(; x + 16 <= n; x += 16) {
+        acc = vpadalq_u8(acc, vabdq_u8(vld1q_u8(a + x), vld1q_u8(b + x)));
+    }
+    for(; x + 8 <= n; x += 8) {
+        acc = vaddw_u8(acc, vabd_u8(vld1_u8(a + x), vld1_u8(b + x)));
+    }
+    uint32x4_t acc32 = vpaddlq_u16(acc);
+    uint64x2_t acc64 = vpaddlq_u32(acc32);
+    sum = (uint32_t)(vgetq_lane_u64(acc64, 0) + vgetq_lane_u64(acc64, 1));
+#elif defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for(; x + 16 <= n; x += 16) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(a + x)),
+                                              _mm_loadu_si128((const __m128i *)(b + x))));
+    }
+    for(; x + 8 <= n; x += 8) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadl_epi64((const __m128i *)(a + x)),
+                                              _mm_loadl_epi64((const __m128i *)(b + x))));
+    }
+    sum = (uint32_t)(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+#endif
+    for(; x < n; x++) {
+        sum += a[x] > b[x] ? a[x] - b[x] : b[x] - a[x];
+    }
+    return sum;
+}
+
+MotionGate::MotionGate(const MotionGateConfig& config) : m_config(config) {
+    m_config.block_size = std::max(4, m_config.block_size);
+    m_config.min_blocks = std::max(1, m_config.min_blocks);
+    m_config.max_skip = std::max(0, m_config.max_skip);
+}
+
+// 抽样的同时对抽样行整行做哈希
+void MotionGate::decimate(const uint8_t *y_plane, int width, int height, int stride) {
+    m_width = width / 4;
+    m_height = height / 4;
+    m_current.resize((size_t)m_width * m_height);
+    uint64_t h = 0;
+    for(int y = 0; y < m_height; y++) {
+        const uint8_t *row = y_plane + (size_t)y * 4 * stride;
+        decimate_row(row, m_current.data() + (size_t)y * m_width, m_width);
+        h = hash_row(h, row, width);
+    }
+    m_hash = h;
+}
+
+int MotionGate::count_changed_blocks() const {
+    int bs = m_config.block_size;
+    int blocks_x = (m_width + bs - 1) / bs;
+    int blocks_y = (m_height + bs - 1) / bs;
+    int changed = 0;
+    for(int by = 0; by < blocks_y; by++) {
+        int y0 = by * bs;
+        int y1 = std::min(y0 + bs, m_height);
+        for(int bx = 0; bx < blocks_x; bx++) {
+            int x0 = bx * bs;
+            int n = std::min(x0 + bs, m_width) - x0;
+            uint32_t sad = 0;
+            for(int y = y0; y < y1; y++) {
+                size_t offset = (size_t)y * m_width + x0;
+                sad += sad_row(m_current.data() + offset, m_reference.data() + offset, n);
+            }
+            // 块内平均每像素绝对差
+            if(sad > (uint32_t)(m_config.block_thresh * n * (y1 - y0))) {
+                if(++changed >= m_config.min_blocks) {
+                    return changed;
+                }
+            }
+        }
+    }
+    return changed;
+}
+
+eGateResult MotionGate::check(const uint8_t *y_plane, int width, int height, int stride) {
+    int64_t start = monotonic_us();
+    decimate(y_plane, width, height, stride);
+
+    eGateResult result;
+    if(!m_has_reference || m_reference.size() != m_current.size()) {
+        result = GATE_INFER;
+    } else if(m_hash == m_last_hash) {
+        result = GATE_DUPLICATE;
+    } else if(count_changed_blocks() >= m_config.min_blocks) {
+        result = GATE_INFER;
+    } else {
+        result = GATE_STATIC;
+    }
+    m_last_hash = m_hash;
+
+    // 静止画面也定期推理, 兼顾缓慢变化和门控漏检
+    if(result != GATE_INFER && ++m_skipped > m_config.max_skip) {
+        result = GATE_INFER;
+        m_forced++;
+    }
+    if(result == GATE_STATIC) {
+        m_static++;
+    } else if(result == GATE_DUPLICATE) {
+        m_duplicate++;
+    }
+    m_analysed++;
+    m_cost_us += monotonic_us() - start;
+    return result;
+}
+
+void MotionGate::commit_reference() {
+    // 参考帧只在推理时更新, 缓慢变化累积到阈值后也会触发推理
+    m_reference.swap(m_current);
+    m_has_reference = true;
+    m_skipped = 0;
+}
+
+motion_gate_stats_t MotionGate::get_stats() const {
+    motion_gate_stats_t stats;
+    stats.analysed = m_analysed.load();
+    stats.skipped_static = m_static.load();
+    stats.skipped_duplicate = m_duplicate.load();
+    stats.forced = m_forced.load();
+    stats.avg_cost_us = stats.analysed > 0 ? (double)m_cost_us.load() / stats.analysed : 0.0;
+    return stats;
+}
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <sys/time.h>
 #include "mpp_decoder.h"
+#include "nal_parser.h"
 #include <unistd.h>
 #include <pthread.h>
 #include <sys/syscall.h>
@@ -101,6 +102,117 @@ int MppDecoder::Init(MppCodingType video_type, int fps, void* userdata)
     return 1;
 }
 
+int MppDecoder::SetBufferConfig(int buffer_count, int extra_buffers) {
+    this->buffer_count = buffer_count;
+    this->extra_buffers = extra_buffers < 0 ? 0 : extra_buffers;
+    return 0;
+}
+
+void MppDecoder::GetBufferUsage(size_t *usage, size_t *max_usage, int *limit) {
+    *usage = loop_data.frm_grp ? mpp_buffer_group_usage(loop_data.frm_grp) : 0;
+    *max_usage = loop_data.max_usage;
+    *limit = buffer_limit;
+}
+
+// 从SPS中取出 level_idc, 只需要NAL开头的少量字节, 去掉防竞争字节后读取
+void MppDecoder::ParseStreamLevel(const uint8_t* pkt_data, int pkt_size) {
+    eNalCodec codec;
+    if (mpp_type == MPP_VIDEO_CodingAVC) {
+        codec = NAL_CODEC_H264;
+    } else if (mpp_type == MPP_VIDEO_CodingHEVC) {
+        codec = NAL_CODEC_H265;
+    } else {
+        level_idc = 0;
+        return;
+    }
+
+    NalIterator it(pkt_data, pkt_size, codec);
+    nal_unit_t nal;
+    while (it.next(nal)) {
+        bool is_sps = (codec == NAL_CODEC_H264) ? nal.type == 7 : nal.type == 33;
+        if (!is_sps) {
+            continue;
+        }
+        uint8_t rbsp[16];
+        int len = 0;
+        int zeros = 0;
+        for (size_t i = 0; i < nal.size && len < (int)sizeof(rbsp); i++) {
+            if (zeros >= 2 && nal.data[i] == 0x03) {
+                zeros = 0;
+                continue;
+            }
+            zeros = nal.data[i] == 0 ? zeros + 1 : 0;
+            rbsp[len++] = nal.data[i];
+        }
+        // H.264: nal头(1) profile_idc(1) constraint(1) level_idc
+        // H.265: nal头(2) vps_id/max_sub_layers(1) profile(1) compat(4) constraint(6) level_idc
+        int pos = (codec == NAL_CODEC_H264) ? 3 : 14;
+        if (len > pos) {
+            level_idc = rbsp[pos];
+            LOGD("stream level_idc %d ", level_idc);
+        }
+        return;
+    }
+}
+
+// 帧缓冲数 = 按等级计算的最大DPB帧数 + 当前解码帧 + 下游占用
+int MppDecoder::CalcBufferCount(RK_U32 width, RK_U32 height) {
+    if (buffer_count > 0) {
+        return buffer_count;
+    }
+
+    int dpb_frames = 16;
+    if (level_idc > 0 && mpp_type == MPP_VIDEO_CodingAVC) {
+        // H.264 表 A-1 MaxDpbMbs
+        static const struct { int level; int max_dpb_mbs; } avc_levels[] = {
+            {10, 396}, {11, 900}, {12, 2376}, {13, 2376}, {20, 2376}, {21, 4752},
+            {22, 8100}, {30, 8100}, {31, 18000}, {32, 20480}, {40, 32768}, {41, 32768},
+            {42, 34816}, {50, 110400}, {51, 184320}, {52, 184320},
+        };
+        int max_dpb_mbs = 696320;
+        for (const auto& l : avc_levels) {
+            if (level_idc <= l.level) {
+                max_dpb_mbs = l.max_dpb_mbs;
+                break;
+            }
+        }
+        int frame_mbs = ((width + 15) / 16) * ((height + 15) / 16);
+        if (frame_mbs > 0) {
+            dpb_frames = max_dpb_mbs / frame_mbs;
+        }
+    } else if (level_idc > 0 && mpp_type == MPP_VIDEO_CodingHEVC) {
+        // H.265 A.4.2 MaxDpbSize, level_idc = 30 * 等级
+        static const struct { int level; int max_luma_ps; } hevc_levels[] = {
+            {30, 36864}, {60, 122880}, {63, 245760}, {90, 552960}, {93, 983040},
+            {120, 2228224}, {123, 2228224}, {150, 8912896}, {153, 8912896}, {156, 8912896},
+        };
+        long max_luma_ps = 35651584;
+        for (const auto& l : hevc_levels) {
+            if (level_idc <= l.level) {
+                max_luma_ps = l.max_luma_ps;
+                break;
+            }
+        }
+        long pic_size = (long)width * height;
+        if (pic_size <= max_luma_ps / 4) {
+            dpb_frames = 16;
+        } else if (pic_size <= max_luma_ps / 2) {
+            dpb_frames = 12;
+        } else if (pic_size <= max_luma_ps * 3 / 4) {
+            dpb_frames = 8;
+        } else {
+            dpb_frames = 6;
+        }
+    }
+    if (dpb_frames > 16) {
+        dpb_frames = 16;
+    }
+    if (dpb_frames < 1) {
+        dpb_frames = 1;
+    }
+    return dpb_frames + 1 + extra_buffers;
+}
+
 int MppDecoder::Reset() {
     if (mpp_mpi != NULL) {
         mpp_mpi->reset(mpp_ctx);
@@ -108,7 +220,7 @@ int MppDecoder::Reset() {
     return 0;
 }
 
-int MppDecoder::Decode(uint8_t* pkt_data, int pkt_size, int pkt_eos) {
+int MppDecoder::Decode(uint8_t* pkt_data, int pkt_size, int pkt_eos, int64_t pts) {
     MpiDecLoopData *data=&loop_data;
     RK_U32 pkt_done = 0;
     RK_U32 err_info = 0;
@@ -121,6 +233,11 @@ int MppDecoder::Decode(uint8_t* pkt_data, int pkt_size, int pkt_eos) {
 
     // LOGD("receive packet size=%d ", pkt_size);
 
+    // 帧缓冲分配前从SPS取得码流等级, 用于计算DPB大小
+    if (level_idc < 0 && data->frm_grp == NULL) {
+        ParseStreamLevel(pkt_data, pkt_size);
+    }
+
     if (packet == NULL) {
         ret = mpp_packet_init(&packet, NULL, 0);
     }
@@ -129,6 +246,7 @@ int MppDecoder::Decode(uint8_t* pkt_data, int pkt_size, int pkt_eos) {
     mpp_packet_set_size(packet, pkt_size);
     mpp_packet_set_pos(packet, pkt_data);
     mpp_packet_set_length(packet, pkt_size);
+    mpp_packet_set_pts(packet, pts);
     // setup eos flag
     if (pkt_eos)
         mpp_packet_set_eos(packet);
@@ -200,12 +318,16 @@ int MppDecoder::Decode(uint8_t* pkt_data, int pkt_size, int pkt_eos) {
                         }
                     }
 
-                    /* Use limit config to limit buffer count to 24 with buf_size */
-                    ret = mpp_buffer_group_limit_config(data->frm_grp, buf_size, 24);
+                    /* Limit buffer count to DPB size plus frames held downstream */
+                    buffer_limit = CalcBufferCount(hor_width, ver_height);
+                    ret = mpp_buffer_group_limit_config(data->frm_grp, buf_size, buffer_limit);
                     if (ret) {
                         LOGD("%p limit buffer group failed ret %d ", ctx, ret);
                         break;
                     }
+                    data->max_usage = 0;
+                    LOGD("decoder buffer group %dx%d: %d buffers x %u bytes (%.1f MB) ", hor_width, ver_height,
+                            buffer_limit, buf_size, buffer_limit * (double)buf_size / (1024 * 1024));
 
                     /*
                      * All buffer group config done. Set info change ready to let
@@ -235,6 +357,8 @@ int MppDecoder::Decode(uint8_t* pkt_data, int pkt_size, int pkt_eos) {
                         char *data_vir =(char *) mpp_buffer_get_ptr(mpp_frame_get_buffer(frame));
                         int fd = mpp_buffer_get_fd(mpp_frame_get_buffer(frame));
                         // LOGD("data_vir=%p fd=%d ", data_vir, fd);
+                        // 解码有延迟/B帧重排, 输出帧不一定对应刚送入的包, pts 取自帧本身(MPP 由送入包的 pts 带出)
+                        frame_pts = mpp_frame_get_pts(frame);
                         callback(this->userdata, hor_stride, ver_stride, hor_width, ver_height, format, fd, data_vir);
                     }
                     unsigned long cur_time_ms = GetCurrentTimeMS();
@@ -0,0 +1,202 @@
+#include "nal_parser.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 标量查找, 利用 p[2] 的取值一次跳过 1~3 字节
+static inline const uint8_t *find_start_code_scalar(const uint8_t *p, const uint8_t *end) {
+    while(p + 3 <= end) {
+        if(p[2] > 1) {
+            p += 3;
+        } else if(p[2] == 1) {
+            if(p[1] == 0 && p[0] == 0) {
+                return p;
+            }
+            p += 3;
+        } else {
+            p++;
+        }
+    }
+    return end;
+}
+
+const uint8_t *nal_find_start_code(const uint8_t *p, const uint8_t *end) {
+    // 起始码至少包含一个0字节, 16字节块内没有0时这16个位置都不可能是起始码
+#if defined(__ARM_NEON)
+    const uint8x16_t zero = vdupq_n_u8(0);
+    while(p + 18 <= end) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(p), zero);
+#if defined(__aarch64__)
+        bool has_zero = vmaxvq_u8(eq) != 0;
+#else
+        uint8x8_t m = vorr_u8(vget_low_u8(eq), vget_high_u8(eq));
+        bool has_zero = vget_lane_u64(vreinterpret_u64_u8(m), 0) != 0;
+#endif
+        if(has_zero) {
+            for(int i = 0; i < 16; i++) {
+                if(p[i] == 0 && p[i + 1] == 0 && p[i + 2] == 1) {
+                    return p + i;
+                }
+            }
+        }
+        p += 16;
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    while(p + 18 <= end) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), zero));
+        while(mask) {
+            int i = __builtin_ctz(mask);
+            if(p[i + 1] == 0 && p[i + 2] == 1) {
+                return p + i;
+            }
+            mask &= mask - 1;
+        }
+        p += 16;
+    }
+#endif
+    return find_start_code_scalar(p, end);
+}
+
+void nal_classify(eNalCodec codec, nal_unit_t& nal) {
+    nal.type = -1;
+    nal.is_vcl = nal.is_keyframe = nal.is_idr = false;
+    nal.is_param_set = nal.is_sei = nal.is_reference = nal.is_first_slice = false;
+    nal.temporal_id = 0;
+    if(nal.data == nullptr || nal.size < 1) {
+        return;
+    }
+
+    const uint8_t *d = nal.data;
+    if(codec == NAL_CODEC_H264) {
+        int type = d[0] & 0x1f;
+        nal.type = type;
+        nal.is_vcl = type >= 1 && type <= 5;
+        nal.is_idr = type == 5;
+        nal.is_keyframe = nal.is_idr;
+        nal.is_param_set = type == 7 || type == 8;
+        nal.is_sei = type == 6;
+        nal.is_reference = nal.is_vcl && ((d[0] >> 5) & 0x03) != 0;
+        // first_mb_in_slice 为 ue(v), 值为0时编码为单个1比特
+        nal.is_first_slice = nal.is_vcl && nal.size > 1 && (d[1] & 0x80);
+    } else {
+        if(nal.size < 2) {
+            return;
+        }
+        int type = (d[0] >> 1) & 0x3f;
+        nal.type = type;
+        nal.is_vcl = type <= 31;
+        nal.is_idr = type == 19 || type == 20;
+        nal.is_keyframe = type >= 16 && type <= 23;
+        nal.is_param_set = type >= 32 && type <= 34;
+        nal.is_sei = type == 39 || type == 40;
+        // TRAIL_N/TSA_N/STSA_N/RADL_N/RASL_N 及保留的偶数类型为子层非参考帧
+        nal.is_reference = nal.is_vcl && !(type <= 14 && (type & 1) == 0);
+        // first_slice_segment_in_pic_flag
+        nal.is_first_slice = nal.is_vcl && nal.size > 2 && (d[2] & 0x80);
+        nal.temporal_id = (d[1] & 0x07) > 0 ? (d[1] & 0x07) - 1 : 0;
+    }
+}
+
+NalIterator::NalIterator(const uint8_t *data, size_t size, eNalCodec codec)
+    : m_pos(data), m_end(data + size), m_codec(codec) {
+    m_pos = nal_find_start_code(m_pos, m_end);
+}
+
+bool NalIterator::next(nal_unit_t& nal) {
+    if(m_pos + 3 >= m_end) {
+        return false;
+    }
+    const uint8_t *start = m_pos + 3;
+    const uint8_t *next = nal_find_start_code(start, m_end);
+    m_pos = next;
+
+    // 去掉尾部的0(4字节起始码的首字节或 trailing_zero_8bits)
+    const uint8_t *last = next;
+    while(last > start && last[-1] == 0) {
+        last--;
+    }
+    nal.data = start;
+    nal.size = last - start;
+    nal_classify(m_codec, nal);
+    return true;
+}
+
+nal_packet_info_t nal_inspect_packet(eNalCodec codec, const uint8_t *data, size_t size) {
+    nal_packet_info_t info;
+    NalIterator it(data, size, codec);
+    nal_unit_t nal;
+    while(it.next(nal)) {
+        if(!nal.is_vcl) {
+            continue;
+        }
+        if(!info.has_vcl) {
+            info.temporal_id = nal.temporal_id;
+        }
+        info.has_vcl = true;
+        info.is_keyframe |= nal.is_keyframe;
+        info.is_reference |= nal.is_reference;
+    }
+    return info;
+}
+
+void NalStreamAnalyzer::input(const uint8_t *data, size_t size, uint64_t pts) {
+    if(!m_window_started) {
+        m_window_start_pts = pts;
+        m_window_started = true;
+    }
+    m_last_pts = pts;
+    m_window_bytes += size;
+    m_stats.total_bytes += size;
+
+    NalIterator it(data, size, m_codec);
+    nal_unit_t nal;
+    while(it.next(nal)) {
+        if(nal.is_param_set) {
+            m_stats.window_param_sets++;
+        } else if(nal.is_sei) {
+            m_stats.window_sei++;
+        }
+        if(!nal.is_first_slice) {
+            continue;
+        }
+
+        m_window_frames++;
+        m_stats.total_frames++;
+        if(!nal.is_reference) {
+            m_stats.window_non_ref++;
+        }
+        if(nal.is_keyframe) {
+            m_stats.total_keyframes++;
+            if(m_seen_keyframe) {
+                m_stats.last_gop = m_frames_since_key;
+                m_gop_count++;
+                m_gop_frames += m_frames_since_key;
+                m_stats.avg_gop = (double)m_gop_frames / m_gop_count;
+            }
+            m_seen_keyframe = true;
+            m_frames_since_key = 0;
+        }
+        m_frames_since_key++;
+    }
+}
+
+nal_stream_stats_t NalStreamAnalyzer::take_stats() {
+    uint64_t duration_ms = m_last_pts > m_window_start_pts ? m_last_pts - m_window_start_pts : 0;
+    if(duration_ms > 0) {
+        m_stats.bitrate_kbps = m_window_bytes * 8.0 / duration_ms;
+        m_stats.fps = m_window_frames * 1000.0 / duration_ms;
+    }
+    nal_stream_stats_t stats = m_stats;
+
+    m_window_bytes = 0;
+    m_window_frames = 0;
+    m_window_start_pts = m_last_pts;
+    m_stats.window_non_ref = 0;
+    m_stats.window_sei = 0;
+    m_stats.window_param_sets = 0;
+    return stats;
+}
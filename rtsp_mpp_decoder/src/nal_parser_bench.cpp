@@ -0,0 +1,168 @@
+// NAL 解析吞吐压测: 在录制的或合成的 Annex-B 码流上反复做 NAL 迭代和逐帧 nal_inspect_packet,
+// 输出 GB/s. 吞吐低于目标值时返回2.
+//
+//   nal_parser_bench [秒数=3] [目标GB/s=1.0] [h264|h265=h264] [Annex-B 文件, 缺省时合成]
+#include "nal_parser.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void put_start_code(std::vector<uint8_t>& out) {
+    out.insert(out.end(), {0, 0, 0, 1});
+}
+
+// 随机条带数据, 按 Annex-B 规则插入防竞争字节
+static void put_payload(std::mt19937& rng, std::vector<uint8_t>& out, size_t size) {
+    int zeros = 0;
+    for(size_t i = 0; i < size; i++) {
+        // 压缩数据中的0字节比均匀分布略多
+        uint8_t b = (rng() % 64 == 0) ? 0 : (rng() & 0xff);
+        if(zeros >= 2 && b <= 3) {
+            out.push_back(3);
+            zeros = 0;
+        }
+        out.push_back(b);
+        zeros = b == 0 ? zeros + 1 : 0;
+    }
+    if(out.back() == 0) {
+        out.push_back(0x80);    // rbsp_stop_one_bit
+    }
+}
+
+// 合成约 4Mbps/25fps 的码流: 每50帧一个关键帧(带参数集), 关键帧约 60KB, 其余约 15KB
+static void make_stream(eNalCodec codec, std::vector<uint8_t>& stream, std::vector<size_t>& frame_offsets) {
+    std::mt19937 rng(1);
+    for(int i = 0; i < 250; i++) {
+        frame_offsets.push_back(stream.size());
+        bool key = i % 50 == 0;
+        if(codec == NAL_CODEC_H264) {
+            if(key) {
+                put_start_code(stream);
+                stream.push_back(0x67);
+                put_payload(rng, stream, 16);
+                put_start_code(stream);
+                stream.push_back(0x68);
+                put_payload(rng, stream, 4);
+            }
+            put_start_code(stream);
+            stream.push_back(key ? 0x65 : 0x41);
+            stream.push_back(0x88);
+        } else {
+            if(key) {
+                for(int type : {32, 33, 34}) {
+                    put_start_code(stream);
+                    stream.insert(stream.end(), {(uint8_t)(type << 1), 1});
+                    put_payload(rng, stream, 16);
+                }
+            }
+            put_start_code(stream);
+            stream.insert(stream.end(), {(uint8_t)((key ? 19 : 1) << 1), 1, 0x80});
+        }
+        put_payload(rng, stream, key ? 60000 + rng() % 8000 : 12000 + rng() % 6000);
+    }
+    frame_offsets.push_back(stream.size());
+}
+
+static bool load_stream(const char *path, eNalCodec codec, std::vector<uint8_t>& stream,
+                        std::vector<size_t>& frame_offsets) {
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL) {
+        printf("open %s failed\n", path);
+        return false;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        stream.insert(stream.end(), buf, buf + n);
+    }
+    fclose(fp);
+    // 按每帧第一个条带切分为帧, 参数集/SEI 归到后面的帧
+    NalIterator it(stream.data(), stream.size(), codec);
+    nal_unit_t nal;
+    size_t frame_start = 0;
+    bool has_vcl = false;
+    const uint8_t *prev_end = stream.data();
+    while(it.next(nal)) {
+        if(!nal.is_vcl || nal.is_first_slice) {
+            if(has_vcl) {
+                frame_offsets.push_back(frame_start);
+                frame_start = prev_end - stream.data();
+                has_vcl = false;
+            }
+        }
+        has_vcl |= nal.is_vcl;
+        prev_end = nal.data + nal.size;
+    }
+    frame_offsets.push_back(frame_start);
+    frame_offsets.push_back(stream.size());
+    return !stream.empty();
+}
+
+int main(int argc, char **argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 3;
+    double target = argc > 2 ? atof(argv[2]) : 1.0;
+    eNalCodec codec = (argc > 3 && strcmp(argv[3], "h265") == 0) ? NAL_CODEC_H265 : NAL_CODEC_H264;
+    if(seconds < 1) {
+        printf("usage: %s [seconds] [target_gbps] [h264|h265] [annexb_file]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<uint8_t> stream;
+    std::vector<size_t> frame_offsets;
+    if(argc > 4) {
+        if(!load_stream(argv[4], codec, stream, frame_offsets)) {
+            return 1;
+        }
+    } else {
+        make_stream(codec, stream, frame_offsets);
+    }
+    printf("stream: %s, %zu bytes, %zu frames\n", argc > 4 ? argv[4] : "synthetic", stream.size(),
+           frame_offsets.size() - 1);
+
+    // 整段码流的 NAL 迭代
+    uint64_t bytes = 0;
+    uint64_t nals = 0;
+    int64_t begin_us = now_us();
+    int64_t end_us = begin_us + (int64_t)seconds * 1000000;
+    while(now_us() < end_us) {
+        NalIterator it(stream.data(), stream.size(), codec);
+        nal_unit_t nal;
+        while(it.next(nal)) {
+            nals++;
+        }
+        bytes += stream.size();
+    }
+    double iterate_gbps = bytes / ((now_us() - begin_us) / 1e6) / 1e9;
+
+    // 逐帧检查(拉流丢帧判断的用法)
+    uint64_t frames = 0;
+    uint64_t keyframes = 0;
+    bytes = 0;
+    begin_us = now_us();
+    end_us = begin_us + (int64_t)seconds * 1000000;
+    while(now_us() < end_us) {
+        for(size_t i = 0; i + 1 < frame_offsets.size(); i++) {
+            size_t size = frame_offsets[i + 1] - frame_offsets[i];
+            nal_packet_info_t info = nal_inspect_packet(codec, stream.data() + frame_offsets[i], size);
+            keyframes += info.is_keyframe;
+            bytes += size;
+            frames++;
+        }
+    }
+    double inspect_gbps = bytes / ((now_us() - begin_us) / 1e6) / 1e9;
+
+    printf("iterate: %.2f GB/s (%lu NALs)\n", iterate_gbps, nals);
+    printf("inspect: %.2f GB/s (%lu frames, %lu keyframes)\n", inspect_gbps, frames, keyframes);
+    bool ok = iterate_gbps >= target && inspect_gbps >= target;
+    printf("target %.2f GB/s: %s\n", target, ok ? "ok" : "below target");
+    return ok ? 0 : 2;
+}
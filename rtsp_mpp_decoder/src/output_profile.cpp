@@ -0,0 +1,238 @@
+#include "output_profile.h"
+#include <chrono>
+
+#define PROFILE_ALIGN(x, a) (((x) + (a)-1) & ~((a)-1))
+
+static int64_t get_time_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+OutputProfile::OutputProfile(const ProfileConfig& config, const PushServer& server)
+    : m_config(config)
+    , m_server_config(server) {
+    m_server_config.stream_conifg = config.stream;
+    if(m_config.fps_div < 1) {
+        m_config.fps_div = 1;
+    }
+}
+
+int OutputProfile::initialize() {
+    m_server = std::make_unique<RtspServer>(m_server_config);
+    m_server->initZlmMedia(m_config.encoder.codec == H265 ? MKCodecH265 : MKCodecH264);
+    if(m_config.encoder.idr_on_play) {
+        m_server->setOnPlayerAttach([this]() {
+            RKEncodeVideo *encoder = m_idr_encoder.load();
+            if(encoder != nullptr) {
+                encoder->RequestIDR();
+            }
+        });
+    }
+    return 0;
+}
+
+int OutputProfile::init_encoder(int src_width, int src_height, int src_fps) {
+    // 未配置的边按源比例计算, 宽高取偶数以满足 NV12
+    m_out_width = m_config.width > 0 ? m_config.width : src_width;
+    m_out_height = m_config.height > 0 ? m_config.height : src_height * m_out_width / src_width;
+    m_out_width &= ~1;
+    m_out_height &= ~1;
+    m_out_wstride = PROFILE_ALIGN(m_out_width, 16);
+    m_out_hstride = PROFILE_ALIGN(m_out_height, 16);
+    m_scaled.clear();
+
+    int out_fps = src_fps / m_config.fps_div;
+    if(out_fps < 1) {
+        out_fps = 1;
+    }
+
+    InputInfo info;
+    info.width = m_out_width;
+    info.height = m_out_height;
+    info.fps = out_fps;
+    info.format = eFormatType::YUV420SP;
+    apply_encoder_config(info, m_config.encoder);
+
+    auto encoder = std::make_unique<RKEncodeVideo>();
+    RtspServer *server = m_server.get();
+    int ret = encoder->Initencoder(info, 0, [server](uint8_t* data, uint32_t size, uint64_t pts, void*) {
+        if(server != nullptr) {
+            server->inputFrame(data, size, pts, pts);
+        }
+    }, this);
+    if(ret != 0) {
+        printf("profile %s: init encoder failed ret=%d\n", m_config.name.c_str(), ret);
+        return -1;
+    }
+    if(server != nullptr) {
+        server->inputFrame(info.data, info.size, 0, 0);
+    }
+    m_encoder = std::move(encoder);
+    m_idr_encoder.store(m_encoder.get());
+    // DMA输入缓冲计入 dma_pool, 这里只统计编码器自身的缓冲
+    m_buffer_bytes = m_encoder->GetBufferBytes();
+    printf("profile %s: %dx%d@%d -> %s/%s\n", m_config.name.c_str(), m_out_width, m_out_height, out_fps,
+           m_config.stream.app.c_str(), m_config.stream.stream.c_str());
+    return 0;
+}
+
+void OutputProfile::scale_frame_cpu(const code_frame_t& frame, u_char *dst) {
+    // 最近邻缩放, RGA 不可用时的兜底路径
+    int src_w = frame.valid_width > 0 ? frame.valid_width : frame.width;
+    int src_h = frame.valid_height > 0 ? frame.valid_height : frame.height;
+    const u_char *src_y = frame.frame;
+    const u_char *src_uv = frame.frame + frame.width * frame.height;
+    u_char *dst_y = dst;
+    u_char *dst_uv = dst + m_out_wstride * m_out_hstride;
+
+    std::vector<int> x_map(m_out_width);
+    for(int x = 0; x < m_out_width; x++) {
+        x_map[x] = x * src_w / m_out_width;
+    }
+    for(int y = 0; y < m_out_height; y++) {
+        const u_char *s = src_y + (y * src_h / m_out_height) * frame.width;
+        u_char *d = dst_y + y * m_out_wstride;
+        for(int x = 0; x < m_out_width; x++) {
+            d[x] = s[x_map[x]];
+        }
+    }
+    for(int y = 0; y < m_out_height / 2; y++) {
+        const u_char *s = src_uv + (y * src_h / m_out_height) * frame.width;
+        u_char *d = dst_uv + y * m_out_wstride;
+        for(int x = 0; x < m_out_width / 2; x++) {
+            int sx = (x_map[x * 2] / 2) * 2;
+            d[x * 2] = s[sx];
+            d[x * 2 + 1] = s[sx + 1];
+        }
+    }
+}
+
+bool OutputProfile::scale_frame_rga(const code_frame_t& frame, u_char *dst, int dst_fd) {
+    int src_w = frame.valid_width > 0 ? frame.valid_width : frame.width;
+    int src_h = frame.valid_height > 0 ? frame.valid_height : frame.height;
+    rga_buffer_t src = wrapbuffer_virtualaddr(frame.frame, src_w, src_h, RK_FORMAT_YCbCr_420_SP,
+                                              frame.width, frame.height);
+    rga_buffer_t out = dst_fd > 0
+        ? wrapbuffer_fd(dst_fd, m_out_width, m_out_height, RK_FORMAT_YCbCr_420_SP, m_out_wstride, m_out_hstride)
+        : wrapbuffer_virtualaddr(dst, m_out_width, m_out_height, RK_FORMAT_YCbCr_420_SP,
+                                 m_out_wstride, m_out_hstride);
+    int ret = imresize(src, out);
+    if(ret == IM_STATUS_SUCCESS) {
+        return true;
+    }
+    printf("profile %s: imresize failed: %s, fallback to cpu\n", m_config.name.c_str(), imStrError((IM_STATUS)ret));
+    m_config.use_rga = false;
+    return false;
+}
+
+bool OutputProfile::encode_dma(const code_frame_t& frame, const std::vector<EncRoiRect>& rois, int64_t *scale_us) {
+    // 每帧从DMA池取一块缓冲, 编码完成后由编码线程的归还回调放回池中, 在途数量受编码缓冲环限制
+    auto out = std::make_shared<dma_data_t>();
+    int size = m_out_wstride * m_out_hstride * 3 / 2;
+    if(out->make_dma(m_out_width, m_out_height, RK_FORMAT_YCbCr_420_SP, size, "profile") != 0) {
+        return false;
+    }
+    out->width_stride = m_out_wstride;
+    out->height_stride = m_out_hstride;
+    int64_t t0 = get_time_us();
+    if(!m_config.use_rga || !scale_frame_rga(frame, out->buf, out->fd)) {
+        auto guard = out->cpu_access();
+        scale_frame_cpu(frame, out->buf);
+    }
+    *scale_us = get_time_us() - t0;
+    int fd = out->fd;
+    int ret = m_encoder->WriteDmaData(fd, size, rois, [out]() mutable {
+        out.reset();
+    });
+    if(ret == 2) {
+        // 缓冲不能导入编码器(如 memfd 后端), 之后改走拷贝路径
+        printf("profile %s: dma-buf import failed, fallback to copy\n", m_config.name.c_str());
+        m_dma_input = false;
+        return false;
+    }
+    return true;
+}
+
+void OutputProfile::encode_frame(const code_frame_t& frame, int src_fps) {
+    if(m_encoder_failed || frame.frame == nullptr || frame.size == 0) {
+        return;
+    }
+    // 时间上降帧
+    uint64_t index = m_src_frames++;
+    if(index % m_config.fps_div != 0) {
+        return;
+    }
+
+    if(m_encoder == nullptr) {
+        int src_w = frame.valid_width > 0 ? frame.valid_width : frame.width;
+        int src_h = frame.valid_height > 0 ? frame.valid_height : frame.height;
+        if(init_encoder(src_w, src_h, src_fps) != 0) {
+            m_encoder_failed = true;
+            return;
+        }
+    }
+
+    // 检测框映射到输出分辨率, 用于ROI编码
+    std::vector<EncRoiRect> rois;
+    if(m_config.encoder.roi_enable) {
+        int src_w = frame.valid_width > 0 ? frame.valid_width : frame.width;
+        int src_h = frame.valid_height > 0 ? frame.valid_height : frame.height;
+        for(const auto& det : frame.detects) {
+            rois.push_back({det.box.left * m_out_width / src_w, det.box.top * m_out_height / src_h,
+                            (det.box.right - det.box.left) * m_out_width / src_w,
+                            (det.box.bottom - det.box.top) * m_out_height / src_h});
+        }
+    }
+    // 缩放输出优先以 dma-buf 交给编码器, 省去送编码时的整帧拷贝
+    int64_t t0 = get_time_us();
+    int64_t scale_us = 0;
+    if(!m_dma_input || !encode_dma(frame, rois, &scale_us)) {
+        if(m_scaled.empty()) {
+            m_scaled.assign(m_out_wstride * m_out_hstride * 3 / 2, 0);
+            m_buffer_bytes = m_encoder->GetBufferBytes() + m_scaled.size();
+        }
+        t0 = get_time_us();
+        if(!m_config.use_rga || !scale_frame_rga(frame, m_scaled.data(), -1)) {
+            scale_frame_cpu(frame, m_scaled.data());
+        }
+        scale_us = get_time_us() - t0;
+        m_encoder->WriteData(m_scaled.data(), m_scaled.size(), rois);
+    }
+    int64_t t2 = get_time_us();
+
+    m_scale_us += scale_us;
+    m_encode_us += t2 - t0 - scale_us;
+    m_out_frames++;
+    report_cost(src_fps);
+}
+
+void OutputProfile::report_cost(int src_fps) {
+    // 每10秒输出一次本档位的缩放/送编码耗时
+    uint64_t report_frames = (src_fps > 0 ? src_fps : 30) * 10 / m_config.fps_div;
+    if(m_out_frames < report_frames || m_out_frames == 0) {
+        return;
+    }
+    printf("profile %s: %lu frames, scale(%s) %.2f ms/frame, encode put %.2f ms/frame\n",
+           m_config.name.c_str(), m_out_frames, m_config.use_rga ? "rga" : "cpu",
+           m_scale_us / 1000.0 / m_out_frames, m_encode_us / 1000.0 / m_out_frames);
+    m_out_frames = 0;
+    m_scale_us = 0;
+    m_encode_us = 0;
+}
+
+void OutputProfile::release() {
+    // 回调与 setOnPlayerAttach 在同一把锁下执行, 摘除后不会再有 IDR 请求进入
+    if(m_server) {
+        m_server->setOnPlayerAttach(nullptr);
+    }
+    m_idr_encoder.store(nullptr);
+    if(m_encoder) {
+        m_encoder->EndEncode();
+        m_encoder.reset();
+    }
+    m_buffer_bytes = 0;
+    if(m_server) {
+        m_server->stopServer();
+        m_server.reset();
+    }
+}
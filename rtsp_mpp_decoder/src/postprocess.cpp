@@ -14,10 +14,14 @@
 
 #include "inference.h"
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
 #include <set>
-#define LABEL_NALE_TXT_PATH "./model/coco_80_labels_list.txt"
-
-char *labels[OBJ_CLASS_NUM];
+#include <type_traits>
+char *labels[OBJ_CLASS_MAX];
+static int label_count = 0;
 
 inline static int clamp(float val, int min, int max) { return val > min ? (val < max ? val : max) : min; }
 
@@ -84,8 +88,12 @@ static int readLines(const char *fileName, char *lines[], int max_line)
 static int loadLabelName(const char *locationFilename, char *label[])
 {
     printf("load lable %s\n", locationFilename);
-    readLines(locationFilename, label, OBJ_CLASS_NUM);
-    return 0;
+    int count = readLines(locationFilename, label, OBJ_CLASS_MAX);
+    if (count > 0)
+    {
+        printf("%d labels loaded\n", count);
+    }
+    return count;
 }
 
 static float CalculateOverlap(float xmin0, float ymin0, float xmax0, float ymax0, float xmin1, float ymin1, float xmax1,
@@ -193,309 +201,331 @@ static uint8_t qnt_f32_to_affine_u8(float f32, int32_t zp, float scale)
     return res;
 }
 
-static float deqnt_affine_to_f32(int8_t qnt, int32_t zp, float scale) { return ((float)qnt - (float)zp) * scale; }
+template <typename T>
+static inline float deqnt_affine(T qnt, int32_t zp, float scale) { return ((float)qnt - (float)zp) * scale; }
 
-static float deqnt_affine_u8_to_f32(uint8_t qnt, int32_t zp, float scale) { return ((float)qnt - (float)zp) * scale; }
+// 量化输出直接比较原始整数值, 浮点输出比较浮点阈值
+template <typename T>
+struct score_thresh
+{
+    typedef int32_t type;
+    static const int32_t *classes(const class_filter_t *filter, int branch) { return filter->qnt_thresh[branch]; }
+    static int32_t sum(const class_filter_t *filter, int branch) { return filter->qnt_sum_thresh[branch]; }
+};
 
-static void compute_dfl(float* tensor, int dfl_len, float* box){
-    for (int b=0; b<4; b++){
-        float exp_t[dfl_len];
-        float exp_sum=0;
-        float acc_sum=0;
-        for (int i=0; i< dfl_len; i++){
-            exp_t[i] = exp(tensor[i+b*dfl_len]);
+template <>
+struct score_thresh<float>
+{
+    typedef float type;
+    static const float *classes(const class_filter_t *filter, int) { return filter->thresh; }
+    static float sum(const class_filter_t *filter, int) { return filter->min_thresh; }
+};
+
+// DFL_LEN 为 0 时使用运行时长度
+template <int DFL_LEN>
+static void compute_dfl(const float *tensor, int dfl_len, float *box)
+{
+    const int len = DFL_LEN > 0 ? DFL_LEN : dfl_len;
+    for (int b = 0; b < 4; b++)
+    {
+        float exp_t[MODEL_DFL_MAX];
+        float exp_sum = 0;
+        float acc_sum = 0;
+        for (int i = 0; i < len; i++)
+        {
+            exp_t[i] = expf(tensor[i + b * len]);
             exp_sum += exp_t[i];
         }
-        
-        for (int i=0; i< dfl_len; i++){
-            acc_sum += exp_t[i]/exp_sum *i;
+        for (int i = 0; i < len; i++)
+        {
+            acc_sum += exp_t[i] * i;
         }
-        box[b] = acc_sum;
+        box[b] = acc_sum / exp_sum;
     }
 }
 
-static int process_u8(uint8_t *box_tensor, int32_t box_zp, float box_scale,
-                      uint8_t *score_tensor, int32_t score_zp, float score_scale,
-                      uint8_t *score_sum_tensor, int32_t score_sum_zp, float score_sum_scale,
-                      int grid_h, int grid_w, int stride, int dfl_len,
-                      std::vector<float> &boxes,
-                      std::vector<float> &objProbs,
-                      std::vector<int> &classId,
-                      float threshold)
+// 求一行各格点得分最高的启用类别, 没有超过阈值的类别时 max_class 为 -1.
+// 按通道分平面且通过预筛的格点较多时逐类别扫描整行, 访问连续且内层循环可向量化;
+// 格点较少或 NHWC 时只对通过的格点逐个扫描各类别
+template <typename T, int NUM_CLASS, bool NHWC>
+static void scan_row(const T *score_row, int grid_len, int grid_w, int num_class, const int *cols, int pass,
+                     const class_filter_t *filter, const typename score_thresh<T>::type *score_thres,
+                     T *max_score, int *max_class)
 {
-    int validCount = 0;
-    int grid_len = grid_h * grid_w;
-    uint8_t score_thres_u8 = qnt_f32_to_affine_u8(threshold, score_zp, score_scale);
-    uint8_t score_sum_thres_u8 = qnt_f32_to_affine_u8(threshold, score_sum_zp, score_sum_scale);
-
-    for (int i = 0; i < grid_h; i++)
+    // 全部类别启用时 cls_ids[k] == k, 按编译期类别数展开
+    const bool all_classes = filter->count == num_class;
+    const int count = all_classes && NUM_CLASS > 0 ? NUM_CLASS : filter->count;
+    if (NHWC || pass * 4 < grid_w)
     {
-        for (int j = 0; j < grid_w; j++)
+        const int class_step = NHWC ? 1 : grid_len;
+        for (int n = 0; n < pass; n++)
         {
-            int offset = i * grid_w + j;
-            int max_class_id = -1;
-
-            // Use score sum to quickly filter
-            if (score_sum_tensor != nullptr)
-            {
-                if (score_sum_tensor[offset] < score_sum_thres_u8)
-                {
-                    continue;
-                }
-            }
-
-            uint8_t max_score = -score_zp;
-            for (int c = 0; c < OBJ_CLASS_NUM; c++)
-            {
-                if ((score_tensor[offset] > score_thres_u8) && (score_tensor[offset] > max_score))
-                {
-                    max_score = score_tensor[offset];
-                    max_class_id = c;
-                }
-                offset += grid_len;
-            }
-
-            // compute box
-            if (max_score > score_thres_u8)
+            int j = cols[n];
+            const T *score = NHWC ? score_row + j * num_class : score_row + j;
+            T best = std::numeric_limits<T>::lowest();
+            int best_class = -1;
+            for (int k = 0; k < count; k++)
             {
-                offset = i * grid_w + j;
-                float box[4];
-                float before_dfl[dfl_len * 4];
-                for (int k = 0; k < dfl_len * 4; k++)
+                int c = all_classes ? k : filter->cls_ids[k];
+                T value = score[c * class_step];
+                if ((value > score_thres[k]) && (value > best))
                 {
-                    before_dfl[k] = deqnt_affine_u8_to_f32(box_tensor[offset], box_zp, box_scale);
-                    offset += grid_len;
+                    best = value;
+                    best_class = c;
                 }
-                compute_dfl(before_dfl, dfl_len, box);
-
-                float x1, y1, x2, y2, w, h;
-                x1 = (-box[0] + j + 0.5) * stride;
-                y1 = (-box[1] + i + 0.5) * stride;
-                x2 = (box[2] + j + 0.5) * stride;
-                y2 = (box[3] + i + 0.5) * stride;
-                w = x2 - x1;
-                h = y2 - y1;
-                boxes.push_back(x1);
-                boxes.push_back(y1);
-                boxes.push_back(w);
-                boxes.push_back(h);
-
-                objProbs.push_back(deqnt_affine_u8_to_f32(max_score, score_zp, score_scale));
-                classId.push_back(max_class_id);
-                validCount++;
             }
+            max_score[j] = best;
+            max_class[j] = best_class;
+        }
+        return;
+    }
+    for (int j = 0; j < grid_w; j++)
+    {
+        max_score[j] = std::numeric_limits<T>::lowest();
+        max_class[j] = -1;
+    }
+    for (int k = 0; k < count; k++)
+    {
+        int c = all_classes ? k : filter->cls_ids[k];
+        const T *score = score_row + c * grid_len;
+        const auto thres = score_thres[k];
+        for (int j = 0; j < grid_w; j++)
+        {
+            bool better = (score[j] > thres) && (score[j] > max_score[j]);
+            max_score[j] = better ? score[j] : max_score[j];
+            max_class[j] = better ? c : max_class[j];
         }
     }
-    return validCount;
 }
 
-static int process_i8(int8_t *box_tensor, int32_t box_zp, float box_scale,
-                      int8_t *score_tensor, int32_t score_zp, float score_scale,
-                      int8_t *score_sum_tensor, int32_t score_sum_zp, float score_sum_scale,
-                      int grid_h, int grid_w, int stride, int dfl_len,
-                      std::vector<float> &boxes, 
-                      std::vector<float> &objProbs, 
-                      std::vector<int> &classId, 
-                      float threshold)
+// 解码一个分支. NUM_CLASS/DFL_LEN 为 0 时使用描述中的运行时值;
+// NHWC 时一个格点的各类别得分/各 DFL 值连续存放, 否则按通道分平面
+template <typename T, int NUM_CLASS, int DFL_LEN, bool NHWC>
+static int process_branch(const model_desc_t *desc, int branch, const void *box_data, const void *score_data,
+                          const void *score_sum_data, const class_filter_t *filter, std::vector<float> &boxes,
+                          std::vector<float> &objProbs, std::vector<int> &classId)
 {
+    typedef typename score_thresh<T>::type thresh_t;
+    const model_branch_t &br = desc->branches[branch];
+    const T *box_tensor = (const T *)box_data;
+    const T *score_tensor = (const T *)score_data;
+    const T *score_sum_tensor = (const T *)score_sum_data;
+    const int num_class = NUM_CLASS > 0 ? NUM_CLASS : desc->num_classes;
+    const int dfl_len = DFL_LEN > 0 ? DFL_LEN : desc->dfl_len;
+    const int grid_h = br.grid_h;
+    const int grid_w = br.grid_w;
+    const int grid_len = grid_h * grid_w;
+    const int stride = br.stride;
+    const thresh_t *score_thres = score_thresh<T>::classes(filter, branch);
+    const thresh_t score_sum_thres = score_thresh<T>::sum(filter, branch);
+    std::vector<int> cols(grid_w);
+    std::vector<T> max_score(grid_w);
+    std::vector<int> max_class(grid_w);
     int validCount = 0;
-    int grid_len = grid_h * grid_w;
-    int8_t score_thres_i8 = qnt_f32_to_affine(threshold, score_zp, score_scale);
-    int8_t score_sum_thres_i8 = qnt_f32_to_affine(threshold, score_sum_zp, score_sum_scale);
 
     for (int i = 0; i < grid_h; i++)
     {
+        // 通过 score sum 起到快速过滤的作用, 记下本行通过的格点, 整行都不通过时跳过
+        int pass = 0;
         for (int j = 0; j < grid_w; j++)
         {
-            int offset = i* grid_w + j;
-            int max_class_id = -1;
-
-            // 通过 score sum 起到快速过滤的作用
-            if (score_sum_tensor != nullptr){
-                if (score_sum_tensor[offset] < score_sum_thres_i8){
-                    continue;
-                }
-            }
-
-            int8_t max_score = -score_zp;
-            for (int c= 0; c< OBJ_CLASS_NUM; c++){
-                if ((score_tensor[offset] > score_thres_i8) && (score_tensor[offset] > max_score))
-                {
-                    max_score = score_tensor[offset];
-                    max_class_id = c;
-                }
-                offset += grid_len;
-            }
+            cols[pass] = j;
+            pass += score_sum_tensor == nullptr || !(score_sum_tensor[i * grid_w + j] < score_sum_thres);
+        }
+        if (pass == 0)
+        {
+            continue;
+        }
+        const T *score_row = NHWC ? score_tensor + i * grid_w * num_class : score_tensor + i * grid_w;
+        scan_row<T, NUM_CLASS, NHWC>(score_row, grid_len, grid_w, num_class, cols.data(), pass, filter, score_thres,
+                                     max_score.data(), max_class.data());
 
+        for (int n = 0; n < pass; n++)
+        {
             // compute box
-            if (max_score> score_thres_i8){
-                offset = i* grid_w + j;
-                float box[4];
-                float before_dfl[dfl_len*4];
-                for (int k=0; k< dfl_len*4; k++){
-                    before_dfl[k] = deqnt_affine_to_f32(box_tensor[offset], box_zp, box_scale);
-                    offset += grid_len;
-                }
-                compute_dfl(before_dfl, dfl_len, box);
-
-                float x1,y1,x2,y2,w,h;
-                x1 = (-box[0] + j + 0.5)*stride;
-                y1 = (-box[1] + i + 0.5)*stride;
-                x2 = (box[2] + j + 0.5)*stride;
-                y2 = (box[3] + i + 0.5)*stride;
-                w = x2 - x1;
-                h = y2 - y1;
-                boxes.push_back(x1);
-                boxes.push_back(y1);
-                boxes.push_back(w);
-                boxes.push_back(h);
-
-                objProbs.push_back(deqnt_affine_to_f32(max_score, score_zp, score_scale));
-                classId.push_back(max_class_id);
-                validCount ++;
+            int j = cols[n];
+            if (max_class[j] < 0)
+            {
+                continue;
             }
+            int offset = i * grid_w + j;
+            float box[4];
+            float before_dfl[MODEL_DFL_MAX * 4];
+            for (int k = 0; k < dfl_len * 4; k++)
+            {
+                T value = NHWC ? box_tensor[offset * 4 * dfl_len + k] : box_tensor[k * grid_len + offset];
+                before_dfl[k] = deqnt_affine(value, br.box_zp, br.box_scale);
+            }
+            compute_dfl<DFL_LEN>(before_dfl, dfl_len, box);
+
+            float x1, y1, x2, y2, w, h;
+            x1 = (-box[0] + j + 0.5) * stride;
+            y1 = (-box[1] + i + 0.5) * stride;
+            x2 = (box[2] + j + 0.5) * stride;
+            y2 = (box[3] + i + 0.5) * stride;
+            w = x2 - x1;
+            h = y2 - y1;
+            boxes.push_back(x1);
+            boxes.push_back(y1);
+            boxes.push_back(w);
+            boxes.push_back(h);
+
+            objProbs.push_back(deqnt_affine(max_score[j], br.score_zp, br.score_scale));
+            classId.push_back(max_class[j]);
+            validCount++;
         }
     }
     return validCount;
 }
 
-static int process_fp32(float *box_tensor, float *score_tensor, float *score_sum_tensor, 
-                        int grid_h, int grid_w, int stride, int dfl_len,
-                        std::vector<float> &boxes, 
-                        std::vector<float> &objProbs, 
-                        std::vector<int> &classId, 
-                        float threshold)
+// 常见组合: COCO 80类/DFL 16, 以及任意类别数/DFL 16; 其余走通用实现
+template <typename T, bool NHWC>
+static branch_kernel_t select_kernel(int num_classes, int dfl_len, const char **name)
 {
-    int validCount = 0;
-    int grid_len = grid_h * grid_w;
-    for (int i = 0; i < grid_h; i++)
+    if (dfl_len == 16 && num_classes == 80)
     {
-        for (int j = 0; j < grid_w; j++)
-        {
-            int offset = i* grid_w + j;
-            int max_class_id = -1;
-
-            // 通过 score sum 起到快速过滤的作用
-            if (score_sum_tensor != nullptr){
-                if (score_sum_tensor[offset] < threshold){
-                    continue;
-                }
-            }
-
-            float max_score = 0;
-            for (int c= 0; c< OBJ_CLASS_NUM; c++){
-                if ((score_tensor[offset] > threshold) && (score_tensor[offset] > max_score))
-                {
-                    max_score = score_tensor[offset];
-                    max_class_id = c;
-                }
-                offset += grid_len;
-            }
-
-            // compute box
-            if (max_score> threshold){
-                offset = i* grid_w + j;
-                float box[4];
-                float before_dfl[dfl_len*4];
-                for (int k=0; k< dfl_len*4; k++){
-                    before_dfl[k] = box_tensor[offset];
-                    offset += grid_len;
-                }
-                compute_dfl(before_dfl, dfl_len, box);
-
-                float x1,y1,x2,y2,w,h;
-                x1 = (-box[0] + j + 0.5)*stride;
-                y1 = (-box[1] + i + 0.5)*stride;
-                x2 = (box[2] + j + 0.5)*stride;
-                y2 = (box[3] + i + 0.5)*stride;
-                w = x2 - x1;
-                h = y2 - y1;
-                boxes.push_back(x1);
-                boxes.push_back(y1);
-                boxes.push_back(w);
-                boxes.push_back(h);
-
-                objProbs.push_back(max_score);
-                classId.push_back(max_class_id);
-                validCount ++;
-            }
-        }
+        *name = "80 classes, dfl 16";
+        return process_branch<T, 80, 16, NHWC>;
     }
-    return validCount;
+    if (dfl_len == 16)
+    {
+        *name = "dfl 16";
+        return process_branch<T, 0, 16, NHWC>;
+    }
+    *name = "generic";
+    return process_branch<T, 0, 0, NHWC>;
 }
 
+template <typename T>
+static branch_kernel_t select_kernel(const model_desc_t *desc, const char **name)
+{
+    return desc->nhwc ? select_kernel<T, true>(desc->num_classes, desc->dfl_len, name)
+                      : select_kernel<T, false>(desc->num_classes, desc->dfl_len, name);
+}
 
-#if defined(RV1106_1103)
-static int process_i8_rv1106(int8_t *box_tensor, int32_t box_zp, float box_scale,
-                             int8_t *score_tensor, int32_t score_zp, float score_scale,
-                             int8_t *score_sum_tensor, int32_t score_sum_zp, float score_sum_scale,
-                             int grid_h, int grid_w, int stride, int dfl_len,
-                             std::vector<float> &boxes,
-                             std::vector<float> &objProbs,
-                             std::vector<int> &classId,
-                             float threshold) {
-    int validCount = 0;
-    int grid_len = grid_h * grid_w;
-    int8_t score_thres_i8 = qnt_f32_to_affine(threshold, score_zp, score_scale);
-    int8_t score_sum_thres_i8 = qnt_f32_to_affine(threshold, score_sum_zp, score_sum_scale);
+// 输出张量的 通道/高/宽
+static void tensor_chw(const rknn_tensor_attr *attr, bool nhwc, int *c, int *h, int *w)
+{
+#ifdef RKNPU1
+    // RKNPU1 的维度顺序与 RKNPU2 相反
+    *w = attr->dims[0];
+    *h = attr->dims[1];
+    *c = attr->dims[2];
+#else
+    if (nhwc)
+    {
+        *h = attr->dims[1];
+        *w = attr->dims[2];
+        *c = attr->dims[3];
+    }
+    else
+    {
+        *c = attr->dims[1];
+        *h = attr->dims[2];
+        *w = attr->dims[3];
+    }
+#endif
+}
 
-    for (int i = 0; i < grid_h; i++) {
-        for (int j = 0; j < grid_w; j++) {
-            int offset = i * grid_w + j;
-            int max_class_id = -1;
+int model_desc_init(rknn_app_context_t *app_ctx, model_desc_t *desc)
+{
+    memset(desc, 0, sizeof(model_desc_t));
+    desc->model_width = app_ctx->model_width;
+    desc->model_height = app_ctx->model_height;
 
-            // 通过 score sum 起到快速过滤的作用
-            if (score_sum_tensor != nullptr) {
-                //score_sum_tensor [1, 1, 80, 80]
-                if (score_sum_tensor[offset] < score_sum_thres_i8) {
-                    continue;
-                }
-            }
+    int n_output = app_ctx->io_num.n_output;
+    if (n_output < 2)
+    {
+        printf("model has %d outputs, not a yolov8 detection head\n", n_output);
+        return -1;
+    }
+    desc->nhwc = app_ctx->output_attrs[0].fmt == RKNN_TENSOR_NHWC;
+    if (!app_ctx->is_quant)
+    {
+        desc->qnt = OUTPUT_FP32;
+    }
+    else
+    {
+        desc->qnt = app_ctx->output_attrs[0].type == RKNN_TENSOR_UINT8 ? OUTPUT_QNT_U8 : OUTPUT_QNT_I8;
+    }
 
-            int8_t max_score = -score_zp;
-            offset = offset * OBJ_CLASS_NUM;
-            for (int c = 0; c < OBJ_CLASS_NUM; c++) {
-                if ((score_tensor[offset + c] > score_thres_i8) && (score_tensor[offset + c] > max_score)) {
-                    max_score = score_tensor[offset + c]; //80类 [1, 80, 80, 80] 3588NCHW 1106NHWC
-                    max_class_id = c;
-                }
-            }
+    // 每个分支 box/score 后面可能跟一个单通道的 score_sum
+    int c, h, w;
+    desc->output_per_branch = 2;
+    if (n_output >= 3)
+    {
+        tensor_chw(&app_ctx->output_attrs[2], desc->nhwc, &c, &h, &w);
+        if (c == 1)
+        {
+            desc->output_per_branch = 3;
+        }
+    }
+    desc->num_branches = n_output / desc->output_per_branch;
+    if (n_output % desc->output_per_branch != 0 || desc->num_branches > MODEL_BRANCH_MAX)
+    {
+        printf("model has %d outputs, not a yolov8 detection head\n", n_output);
+        return -1;
+    }
 
-            // compute box
-            if (max_score > score_thres_i8) {
-                offset = (i * grid_w + j) * 4 * dfl_len;
-                float box[4];
-                float before_dfl[dfl_len*4];
-                for (int k=0; k< dfl_len*4; k++){
-                    before_dfl[k] = deqnt_affine_to_f32(box_tensor[offset + k], box_zp, box_scale);
-                }
-                compute_dfl(before_dfl, dfl_len, box);
-
-                float x1, y1, x2, y2, w, h;
-                x1 = (-box[0] + j + 0.5) * stride;
-                y1 = (-box[1] + i + 0.5) * stride;
-                x2 = (box[2] + j + 0.5) * stride;
-                y2 = (box[3] + i + 0.5) * stride;
-                w = x2 - x1;
-                h = y2 - y1;
-                boxes.push_back(x1);
-                boxes.push_back(y1);
-                boxes.push_back(w);
-                boxes.push_back(h);
-
-                objProbs.push_back(deqnt_affine_to_f32(max_score, score_zp, score_scale));
-                classId.push_back(max_class_id);
-                validCount ++;
-            }
+    for (int i = 0; i < desc->num_branches; i++)
+    {
+        model_branch_t &br = desc->branches[i];
+        br.box_idx = i * desc->output_per_branch;
+        br.score_idx = br.box_idx + 1;
+        br.sum_idx = desc->output_per_branch == 3 ? br.box_idx + 2 : -1;
+
+        int box_c, score_c;
+        tensor_chw(&app_ctx->output_attrs[br.box_idx], desc->nhwc, &box_c, &br.grid_h, &br.grid_w);
+        tensor_chw(&app_ctx->output_attrs[br.score_idx], desc->nhwc, &score_c, &h, &w);
+        if (i == 0)
+        {
+            desc->num_classes = score_c;
+            desc->dfl_len = box_c / 4;
         }
+        if (box_c % 4 != 0 || box_c / 4 != desc->dfl_len || score_c != desc->num_classes ||
+            h != br.grid_h || w != br.grid_w || br.grid_h <= 0)
+        {
+            printf("model output %d/%d shape mismatch: box %d, score %d, grid %dx%d / %dx%d\n",
+                   br.box_idx, br.score_idx, box_c, score_c, br.grid_w, br.grid_h, w, h);
+            return -1;
+        }
+        br.stride = desc->model_height / br.grid_h;
+
+        // 浮点输出按 zp=0 scale=1 反量化, 与量化输出共用解码函数
+        const rknn_tensor_attr *box_attr = &app_ctx->output_attrs[br.box_idx];
+        const rknn_tensor_attr *score_attr = &app_ctx->output_attrs[br.score_idx];
+        const rknn_tensor_attr *sum_attr = br.sum_idx >= 0 ? &app_ctx->output_attrs[br.sum_idx] : score_attr;
+        bool quant = desc->qnt != OUTPUT_FP32;
+        br.box_zp = quant ? box_attr->zp : 0;
+        br.box_scale = quant ? box_attr->scale : 1.0f;
+        br.score_zp = quant ? score_attr->zp : 0;
+        br.score_scale = quant ? score_attr->scale : 1.0f;
+        br.sum_zp = quant ? sum_attr->zp : 0;
+        br.sum_scale = quant ? sum_attr->scale : 1.0f;
     }
-    printf("validCount=%d\n", validCount);
-    printf("grid h-%d, w-%d, stride %d\n", grid_h, grid_w, stride);
-    return validCount;
+    if (desc->num_classes < 1 || desc->num_classes > OBJ_CLASS_MAX || desc->dfl_len < 1 || desc->dfl_len > MODEL_DFL_MAX)
+    {
+        printf("model has %d classes, dfl length %d, supported up to %d classes, dfl length %d\n",
+               desc->num_classes, desc->dfl_len, OBJ_CLASS_MAX, MODEL_DFL_MAX);
+        return -1;
+    }
+
+    switch (desc->qnt)
+    {
+    case OUTPUT_QNT_I8:
+        desc->kernel = select_kernel<int8_t>(desc, &desc->kernel_name);
+        break;
+    case OUTPUT_QNT_U8:
+        desc->kernel = select_kernel<uint8_t>(desc, &desc->kernel_name);
+        break;
+    default:
+        desc->kernel = select_kernel<float>(desc, &desc->kernel_name);
+        break;
+    }
+    return 0;
 }
-#endif
 
-int post_process(rknn_app_context_t *app_ctx, void *outputs, letterbox_t *letter_box, float conf_threshold, float nms_threshold, object_detect_result_list *od_results)
+int post_process(const model_desc_t *desc, void *outputs, letterbox_t *letter_box, const class_filter_t *filter, float nms_threshold, object_detect_result_list *od_results)
 {
 #if defined(RV1106_1103) 
     rknn_tensor_mem **_outputs = (rknn_tensor_mem **)outputs;
@@ -506,95 +536,24 @@ int post_process(rknn_app_context_t *app_ctx, void *outputs, letterbox_t *letter
     std::vector<float> objProbs;
     std::vector<int> classId;
     int validCount = 0;
-    int stride = 0;
-    int grid_h = 0;
-    int grid_w = 0;
-    int model_in_w = app_ctx->model_width;
-    int model_in_h = app_ctx->model_height;
+    int model_in_w = desc->model_width;
+    int model_in_h = desc->model_height;
 
     memset(od_results, 0, sizeof(object_detect_result_list));
 
-    // default 3 branch
-#ifdef RKNPU1
-    int dfl_len = app_ctx->output_attrs[0].dims[2] / 4;
-#else
-    int dfl_len = app_ctx->output_attrs[0].dims[1] /4;
-#endif
-    int output_per_branch = app_ctx->io_num.n_output / 3;
-    for (int i = 0; i < 3; i++)
+    for (int i = 0; i < desc->num_branches; i++)
     {
+        const model_branch_t &br = desc->branches[i];
 #if defined(RV1106_1103)
-        dfl_len = app_ctx->output_attrs[0].dims[3] /4;
-        void *score_sum = nullptr;
-        int32_t score_sum_zp = 0;
-        float score_sum_scale = 1.0;
-        if (output_per_branch == 3) {
-            score_sum = _outputs[i * output_per_branch + 2]->virt_addr;
-            score_sum_zp = app_ctx->output_attrs[i * output_per_branch + 2].zp;
-            score_sum_scale = app_ctx->output_attrs[i * output_per_branch + 2].scale;
-        }
-        int box_idx = i * output_per_branch;
-        int score_idx = i * output_per_branch + 1;
-        grid_h = app_ctx->output_attrs[box_idx].dims[1];
-        grid_w = app_ctx->output_attrs[box_idx].dims[2];
-        stride = model_in_h / grid_h;
-        
-        if (app_ctx->is_quant) {
-            validCount += process_i8_rv1106((int8_t *)_outputs[box_idx]->virt_addr, app_ctx->output_attrs[box_idx].zp, app_ctx->output_attrs[box_idx].scale,
-                                (int8_t *)_outputs[score_idx]->virt_addr, app_ctx->output_attrs[score_idx].zp,
-                                app_ctx->output_attrs[score_idx].scale, (int8_t *)score_sum, score_sum_zp, score_sum_scale,
-                                grid_h, grid_w, stride, dfl_len, filterBoxes, objProbs, classId, conf_threshold);
-        }
-        else
-        {
-            printf("RV1106/1103 only support quantization mode\n", LABEL_NALE_TXT_PATH);
-            return -1;
-        }
-
+        void *box = _outputs[br.box_idx]->virt_addr;
+        void *score = _outputs[br.score_idx]->virt_addr;
+        void *score_sum = br.sum_idx >= 0 ? _outputs[br.sum_idx]->virt_addr : nullptr;
 #else
-        void *score_sum = nullptr;
-        int32_t score_sum_zp = 0;
-        float score_sum_scale = 1.0;
-        if (output_per_branch == 3){
-            score_sum = _outputs[i*output_per_branch + 2].buf;
-            score_sum_zp = app_ctx->output_attrs[i*output_per_branch + 2].zp;
-            score_sum_scale = app_ctx->output_attrs[i*output_per_branch + 2].scale;
-        }
-        int box_idx = i*output_per_branch;
-        int score_idx = i*output_per_branch + 1;
-
-#ifdef RKNPU1
-        grid_h = app_ctx->output_attrs[box_idx].dims[1];
-        grid_w = app_ctx->output_attrs[box_idx].dims[0];
-#else
-        grid_h = app_ctx->output_attrs[box_idx].dims[2];
-        grid_w = app_ctx->output_attrs[box_idx].dims[3];
-#endif
-        stride = model_in_h / grid_h;
-
-        if (app_ctx->is_quant)
-        {
-#ifdef RKNPU1
-            validCount += process_u8((uint8_t *)_outputs[box_idx].buf, app_ctx->output_attrs[box_idx].zp, app_ctx->output_attrs[box_idx].scale,
-                                     (uint8_t *)_outputs[score_idx].buf, app_ctx->output_attrs[score_idx].zp, app_ctx->output_attrs[score_idx].scale,
-                                     (uint8_t *)score_sum, score_sum_zp, score_sum_scale,
-                                     grid_h, grid_w, stride, dfl_len,
-                                     filterBoxes, objProbs, classId, conf_threshold);
-#else
-            validCount += process_i8((int8_t *)_outputs[box_idx].buf, app_ctx->output_attrs[box_idx].zp, app_ctx->output_attrs[box_idx].scale,
-                                     (int8_t *)_outputs[score_idx].buf, app_ctx->output_attrs[score_idx].zp, app_ctx->output_attrs[score_idx].scale,
-                                     (int8_t *)score_sum, score_sum_zp, score_sum_scale,
-                                     grid_h, grid_w, stride, dfl_len, 
-                                     filterBoxes, objProbs, classId, conf_threshold);
-#endif
-        }
-        else
-        {
-            validCount += process_fp32((float *)_outputs[box_idx].buf, (float *)_outputs[score_idx].buf, (float *)score_sum,
-                                       grid_h, grid_w, stride, dfl_len, 
-                                       filterBoxes, objProbs, classId, conf_threshold);
-        }
+        void *box = _outputs[br.box_idx].buf;
+        void *score = _outputs[br.score_idx].buf;
+        void *score_sum = br.sum_idx >= 0 ? _outputs[br.sum_idx].buf : nullptr;
 #endif
+        validCount += desc->kernel(desc, i, box, score, score_sum, filter, filterBoxes, objProbs, classId);
     }
 
     // no object detect
@@ -647,22 +606,93 @@ int post_process(rknn_app_context_t *app_ctx, void *outputs, letterbox_t *letter
     return 0;
 }
 
-int init_post_process()
+// 所有类别使用同一阈值
+int post_process(const model_desc_t *desc, void *outputs, letterbox_t *letter_box, float conf_threshold, float nms_threshold, object_detect_result_list *od_results)
+{
+    class_filter_t filter;
+    class_filter_init(desc, std::vector<float>(), conf_threshold, &filter);
+    return post_process(desc, outputs, letter_box, &filter, nms_threshold, od_results);
+}
+
+void class_filter_init(const model_desc_t *desc, const std::vector<float>& class_thresh, float default_thresh,
+                       class_filter_t *filter)
+{
+    memset(filter, 0, sizeof(class_filter_t));
+    for (int c = 0; c < desc->num_classes; c++)
+    {
+        float thresh = class_thresh.empty() ? default_thresh : (c < (int)class_thresh.size() ? class_thresh[c] : 0.0f);
+        if (thresh > 0)
+        {
+            filter->cls_ids[filter->count] = c;
+            filter->thresh[filter->count] = thresh;
+            filter->count++;
+        }
+    }
+    filter->min_thresh = 1.0f;
+    for (int k = 0; k < filter->count; k++)
+    {
+        filter->min_thresh = std::min(filter->min_thresh, filter->thresh[k]);
+    }
+
+    if (desc->qnt == OUTPUT_FP32)
+    {
+        return;
+    }
+    for (int i = 0; i < desc->num_branches; i++)
+    {
+        const model_branch_t &br = desc->branches[i];
+        for (int k = 0; k < filter->count; k++)
+        {
+            filter->qnt_thresh[i][k] = desc->qnt == OUTPUT_QNT_U8 ?
+                qnt_f32_to_affine_u8(filter->thresh[k], br.score_zp, br.score_scale) :
+                qnt_f32_to_affine(filter->thresh[k], br.score_zp, br.score_scale);
+        }
+        filter->qnt_sum_thresh[i] = desc->qnt == OUTPUT_QNT_U8 ?
+            qnt_f32_to_affine_u8(filter->min_thresh, br.sum_zp, br.sum_scale) :
+            qnt_f32_to_affine(filter->min_thresh, br.sum_zp, br.sum_scale);
+    }
+}
+
+int coco_name_to_cls(const char *name)
+{
+    char *end = nullptr;
+    long id = strtol(name, &end, 10);
+    if (end != name && *end == '\0')
+    {
+        return (id >= 0 && id < OBJ_CLASS_MAX) ? (int)id : -1;
+    }
+    for (int c = 0; c < OBJ_CLASS_MAX; c++)
+    {
+        if (labels[c] && strcmp(labels[c], name) == 0)
+        {
+            return c;
+        }
+    }
+    return -1;
+}
+
+int init_post_process(const char *label_path)
 {
     int ret = 0;
-    ret = loadLabelName(LABEL_NALE_TXT_PATH, labels);
+    ret = loadLabelName(label_path, labels);
     if (ret < 0)
     {
-        printf("Load %s failed!\n", LABEL_NALE_TXT_PATH);
+        printf("Load %s failed!\n", label_path);
         return -1;
     }
+    label_count = ret;
     return 0;
 }
 
+int get_label_count()
+{
+    return label_count;
+}
+
 char *coco_cls_to_name(int cls_id)
 {
 
-    if (cls_id >= OBJ_CLASS_NUM)
+    if (cls_id >= OBJ_CLASS_MAX)
     {
         return "null";
     }
@@ -677,7 +707,7 @@ char *coco_cls_to_name(int cls_id)
 
 void deinit_post_process()
 {
-    for (int i = 0; i < OBJ_CLASS_NUM; i++)
+    for (int i = 0; i < OBJ_CLASS_MAX; i++)
     {
         if (labels[i] != nullptr)
         {
@@ -685,4 +715,5 @@ void deinit_post_process()
             labels[i] = nullptr;
         }
     }
+    label_count = 0;
 }
\ No newline at end of file
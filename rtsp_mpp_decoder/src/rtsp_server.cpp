@@ -2,14 +2,17 @@
 #include "rtsp_server.h"
 #include <chrono>
 #include <thread>
+#include <cstring>
 
 std::mutex RtspServer::s_mutex;
 int RtspServer::s_instanceCount = 0;
 bool RtspServer::s_serverInitialized = false;
+std::vector<RtspServer*> RtspServer::s_instances;
 
 RtspServer::RtspServer(const PushServer& config) 
     : m_mediaHandle(nullptr)
     , m_pusherHandle(nullptr)
+    , m_codecId(MKCodecH264)
     , m_config(config)
     , m_isActive(true)
     , m_isDestroying(false)
@@ -18,6 +21,7 @@ RtspServer::RtspServer(const PushServer& config)
     
     std::lock_guard<std::mutex> lock(s_mutex);
     s_instanceCount++;
+    s_instances.push_back(this);
     printf("RtspServer instance created, count: %d\n", s_instanceCount);
 }
 
@@ -27,6 +31,17 @@ RtspServer::~RtspServer() {
 }
 
 void RtspServer::cleanup() {
+    {
+        // 不再接收播放事件
+        std::lock_guard<std::mutex> lock(s_mutex);
+        for (auto it = s_instances.begin(); it != s_instances.end(); ++it) {
+            if (*it == this) {
+                s_instances.erase(it);
+                break;
+            }
+        }
+    }
+
     // 先停止推流，避免回调继续执行
     if (m_pusherHandle) {
         mk_pusher_release(m_pusherHandle);
@@ -84,6 +99,11 @@ int RtspServer::initServer() {
     };
 
     mk_env_init(&config);
+
+    mk_events events;
+    memset(&events, 0, sizeof(events));
+    events.on_mk_media_play = mediaPlayCallback;
+    mk_events_listen(&events);
     
     if (m_config.type == "rtsp") {
         mk_rtsp_server_start(m_config.port, 0);
@@ -100,8 +120,9 @@ int RtspServer::stopServer() {
     return 0;
 }
 
-int RtspServer::initZlmMedia() {
+int RtspServer::initZlmMedia(int codec_id) {
     initServer();
+    m_codecId = codec_id;
     
     const char *vhost  = m_config.stream_conifg.vhost.c_str();
     const char *app    = m_config.stream_conifg.app.c_str();
@@ -111,7 +132,7 @@ int RtspServer::initZlmMedia() {
     mk_media_init_video(m_mediaHandle, 0, 0, 0, 0, 0);
     
     codec_args v_args = {0};
-    mk_track v_track = mk_track_create(MKCodecH264, &v_args);
+    mk_track v_track = mk_track_create(m_codecId, &v_args);
     mk_media_init_track(m_mediaHandle, v_track);
     mk_media_set_on_regist(m_mediaHandle, mediasourceRegistCallback, this);
     mk_media_init_complete(m_mediaHandle);
@@ -159,6 +180,43 @@ void API_CALL RtspServer::mediasourceRegistCallback(void *user_data, mk_media_so
     }
 }
 
+void API_CALL RtspServer::mediaPlayCallback(const mk_media_info url_info, const mk_auth_invoker invoker,
+                                            const mk_sock_info sender) {
+    // 不做播放鉴权, 直接放行
+    mk_auth_invoker_do(invoker, "");
+
+    const char *app = mk_media_info_get_app(url_info);
+    const char *stream = mk_media_info_get_stream(url_info);
+    if (!app || !stream) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (auto server : s_instances) {
+        if (server->m_isDestroying || !server->m_onPlayerAttach) {
+            continue;
+        }
+        if (server->m_config.stream_conifg.app == app && server->m_config.stream_conifg.stream == stream) {
+            server->m_onPlayerAttach();
+        }
+    }
+}
+
+void RtspServer::setOnPlayerAttach(PlayerAttachCallback callback) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    m_onPlayerAttach = callback;
+}
+
 mk_media RtspServer::getZlmMediaHandle() const {
     return m_mediaHandle;
 }
+
+int RtspServer::inputFrame(const void *data, int len, uint64_t dts, uint64_t pts) {
+    if (m_mediaHandle == nullptr || m_isDestroying) {
+        return -1;
+    }
+    if (m_codecId == MKCodecH265) {
+        return mk_media_input_h265(m_mediaHandle, data, len, dts, pts);
+    }
+    return mk_media_input_h264(m_mediaHandle, data, len, dts, pts);
+}
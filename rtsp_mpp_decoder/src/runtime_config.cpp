@@ -0,0 +1,368 @@
+#include "runtime_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "INIReader.h"
+#include "postprocess.h"
+
+// SIGHUP 处理函数只能做异步信号安全的操作, 通过管道唤醒监视线程
+static int s_sighup_fd = -1;
+
+static void sighup_handler(int) {
+    int saved_errno = errno;
+    char c = 'h';
+    if (s_sighup_fd >= 0 && write(s_sighup_fd, &c, 1) < 0) {
+        // 管道满时已有待处理的重新加载
+    }
+    errno = saved_errno;
+}
+
+// 颜色写作 RRGGBB 十六进制
+static bool parse_color(const std::string& text, uint32_t *color) {
+    std::string value = text;
+    if (!value.empty() && value[0] == '#') {
+        value = value.substr(1);
+    }
+    if (value.size() != 6) {
+        return false;
+    }
+    char *end = nullptr;
+    unsigned long parsed = strtoul(value.c_str(), &end, 16);
+    if (end == nullptr || *end != '\0') {
+        return false;
+    }
+    *color = (uint32_t)parsed;
+    return true;
+}
+
+// 逗号分隔的列表, 去掉空白和空项
+static std::vector<std::string> split_list(const std::string& text) {
+    std::vector<std::string> result;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string item = text.substr(start, end - start);
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        start = end + 1;
+        if (!item.empty()) {
+            result.push_back(item);
+        }
+    }
+    return result;
+}
+
+// classes = person,car,... 限定输出类别; class_thresh = person:0.4,car:0.5 单独设置类别阈值,
+// 其余类别使用 box_thresh. 两者都未配置时 class_thresh 为空, 表示全部类别.
+// 类别号必须小于模型类别数(模型加载前按上限 OBJ_CLASS_MAX 检查)
+static bool parse_classes(const INIReader& reader, int num_classes, RuntimeConfig& config, std::string& error) {
+    std::vector<std::string> classes = split_list(reader.Get("detect", "classes", ""));
+    std::vector<std::string> overrides = split_list(reader.Get("detect", "class_thresh", ""));
+    if (classes.empty() && overrides.empty()) {
+        return true;
+    }
+    config.class_thresh.assign(num_classes, classes.empty() ? config.box_thresh : 0.0f);
+    for (const std::string& name : classes) {
+        int cls_id = coco_name_to_cls(name.c_str());
+        if (cls_id < 0) {
+            error = "unknown class " + name;
+            return false;
+        }
+        if (cls_id >= num_classes) {
+            error = "class " + name + " out of range, model has " + std::to_string(num_classes) + " classes";
+            return false;
+        }
+        config.class_thresh[cls_id] = config.box_thresh;
+    }
+    for (const std::string& item : overrides) {
+        size_t pos = item.rfind(':');
+        if (pos == std::string::npos) {
+            error = "class_thresh entries must be name:thresh";
+            return false;
+        }
+        std::string name = item.substr(0, pos);
+        name.erase(name.find_last_not_of(" \t") + 1);
+        int cls_id = coco_name_to_cls(name.c_str());
+        if (cls_id < 0) {
+            error = "unknown class " + name;
+            return false;
+        }
+        if (cls_id >= num_classes) {
+            error = "class " + name + " out of range, model has " + std::to_string(num_classes) + " classes";
+            return false;
+        }
+        if (config.class_thresh[cls_id] <= 0) {
+            error = "class_thresh for disabled class " + name;
+            return false;
+        }
+        char *end = nullptr;
+        float value = strtof(item.c_str() + pos + 1, &end);
+        if (end == item.c_str() + pos + 1 || value <= 0 || value >= 1) {
+            error = "class_thresh for " + name + " must be in (0, 1)";
+            return false;
+        }
+        config.class_thresh[cls_id] = value;
+    }
+    return true;
+}
+
+RuntimeConfigManager::RuntimeConfigManager() {
+    // 未加载配置文件时也保证 get() 非空
+    publish(std::make_unique<RuntimeConfig>());
+}
+
+RuntimeConfigManager::~RuntimeConfigManager() {
+    stop();
+}
+
+bool RuntimeConfigManager::parse(const INIReader& reader, int num_classes, RuntimeConfig& config, std::string& error) {
+    if (reader.ParseError() != 0) {
+        error = reader.ParseError() < 0 ? "cannot open file" :
+                "syntax error at line " + std::to_string(reader.ParseError());
+        return false;
+    }
+
+    config.box_thresh = reader.GetReal("detect", "box_thresh", BOX_THRESH);
+    config.nms_thresh = reader.GetReal("detect", "nms_thresh", NMS_THRESH);
+    config.max_objects = reader.GetInteger("detect", "max_objects", OBJ_NUMB_MAX_SIZE);
+    config.infer_stride = reader.GetInteger("detect", "stride", 1);
+    config.inference_threads = reader.GetInteger("inference", "threads", 2);
+    config.overlay = reader.GetBoolean("detect_stream", "overlay", true);
+    config.detect_bitrate = reader.GetInteger("detect_stream", "bitrate", 0);
+    config.font_size = reader.GetInteger("overlay", "font_size", 18);
+    config.bg_alpha = reader.GetInteger("overlay", "bg_alpha", 255);
+    config.box_thickness = reader.GetInteger("overlay", "box_thickness", 2);
+
+    if (!parse_color(reader.Get("overlay", "font_color", "ffff00"), &config.font_color) ||
+        !parse_color(reader.Get("overlay", "bg_color", "000000"), &config.bg_color) ||
+        !parse_color(reader.Get("overlay", "box_color", "ff6464"), &config.box_color)) {
+        error = "overlay colors must be RRGGBB";
+        return false;
+    }
+    if (config.box_thresh <= 0 || config.box_thresh >= 1 || config.nms_thresh <= 0 || config.nms_thresh > 1) {
+        error = "box_thresh must be in (0, 1), nms_thresh in (0, 1]";
+        return false;
+    }
+    if (!parse_classes(reader, num_classes, config, error)) {
+        return false;
+    }
+    if (config.max_objects < 1 || config.max_objects > OBJ_NUMB_MAX_SIZE) {
+        error = "max_objects must be in [1, " + std::to_string(OBJ_NUMB_MAX_SIZE) + "]";
+        return false;
+    }
+    if (config.infer_stride < 1 || config.infer_stride > 100) {
+        error = "stride must be in [1, 100]";
+        return false;
+    }
+    if (config.inference_threads < 1) {
+        error = "inference threads must be >= 1";
+        return false;
+    }
+    if (config.detect_bitrate < 0) {
+        error = "bitrate must be >= 0";
+        return false;
+    }
+    if (config.font_size < 8 || config.font_size > 128 || config.bg_alpha < 0 || config.bg_alpha > 255 ||
+        config.box_thickness < 1 || config.box_thickness > 16) {
+        error = "font_size must be in [8, 128], bg_alpha in [0, 255], box_thickness in [1, 16]";
+        return false;
+    }
+    return true;
+}
+
+bool RuntimeConfigManager::load(const std::string& path) {
+    m_path = path;
+    INIReader reader(path);
+    auto config = std::make_unique<RuntimeConfig>();
+    std::string error;
+    if (!parse(reader, m_num_classes.load(), *config, error)) {
+        printf("runtime config: %s: %s, using defaults\n", path.c_str(), error.c_str());
+        return false;
+    }
+    publish(std::move(config));
+    return true;
+}
+
+bool RuntimeConfigManager::set_num_classes(int num_classes) {
+    m_num_classes = num_classes;
+    if (m_path.empty()) {
+        return true;
+    }
+    // 启动时加载的快照只按上限检查过类别号, 按实际类别数重新校验
+    INIReader reader(m_path);
+    auto config = std::make_unique<RuntimeConfig>();
+    std::string error;
+    if (!parse(reader, num_classes, *config, error)) {
+        printf("runtime config: %s: %s\n", m_path.c_str(), error.c_str());
+        return false;
+    }
+    publish(std::move(config));
+    return true;
+}
+
+void RuntimeConfigManager::publish(std::unique_ptr<RuntimeConfig> config) {
+    std::shared_ptr<const RuntimeConfig> snapshot(std::move(config));
+    std::atomic_store_explicit(&m_current, snapshot, std::memory_order_release);
+}
+
+void RuntimeConfigManager::subscribe(Listener listener) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_listeners.push_back(listener);
+}
+
+bool RuntimeConfigManager::reload() {
+    INIReader reader(m_path);
+    auto config = std::make_unique<RuntimeConfig>();
+    std::string error;
+    if (!parse(reader, m_num_classes.load(), *config, error)) {
+        m_rejects++;
+        printf("runtime config: reload %s rejected: %s, keep current config\n", m_path.c_str(), error.c_str());
+        return false;
+    }
+
+    std::shared_ptr<const RuntimeConfig> old_config = get();
+    const RuntimeConfig *new_config = config.get();
+    publish(std::move(config));
+    m_reloads++;
+    int class_count = 0;
+    for (float thresh : new_config->class_thresh) {
+        class_count += thresh > 0;
+    }
+    printf("runtime config: reloaded (#%lu), box_thresh=%.2f nms_thresh=%.2f classes=%s max_objects=%d stride=%d "
+           "threads=%d overlay=%d bitrate=%d\n", m_reloads, new_config->box_thresh, new_config->nms_thresh,
+           new_config->class_thresh.empty() ? "all" : std::to_string(class_count).c_str(),
+           new_config->max_objects, new_config->infer_stride, new_config->inference_threads,
+           new_config->overlay, new_config->detect_bitrate);
+
+    std::vector<Listener> listeners;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        listeners = m_listeners;
+    }
+    for (auto& listener : listeners) {
+        listener(*old_config, *new_config);
+    }
+    return true;
+}
+
+void RuntimeConfigManager::start(bool watch) {
+    if (m_is_running || pipe2(m_wake_fd, O_CLOEXEC | O_NONBLOCK) != 0) {
+        return;
+    }
+
+    if (watch) {
+        // 监视所在目录: 编辑器通常写临时文件后 rename 覆盖, 直接监视文件会丢失
+        std::string dir = ".";
+        size_t pos = m_path.rfind('/');
+        if (pos != std::string::npos) {
+            dir = pos == 0 ? "/" : m_path.substr(0, pos);
+        }
+        m_inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        if (m_inotify_fd < 0 || inotify_add_watch(m_inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            printf("runtime config: inotify on %s failed: %s, only SIGHUP reloads\n", dir.c_str(), strerror(errno));
+            if (m_inotify_fd >= 0) {
+                close(m_inotify_fd);
+                m_inotify_fd = -1;
+            }
+        }
+    }
+
+    s_sighup_fd = m_wake_fd[1];
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sighup_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, NULL);
+
+    m_is_running = true;
+    m_watch_thread = std::thread(&RuntimeConfigManager::watch_func, this);
+    printf("runtime config: watching %s%s\n", m_path.c_str(), m_inotify_fd >= 0 ? " (inotify + SIGHUP)" : " (SIGHUP)");
+}
+
+void RuntimeConfigManager::stop() {
+    if (!m_is_running.exchange(false)) {
+        return;
+    }
+    signal(SIGHUP, SIG_IGN);
+    s_sighup_fd = -1;
+    char c = 'q';
+    if (write(m_wake_fd[1], &c, 1) < 0) {
+        printf("runtime config: wake watch thread failed\n");
+    }
+    if (m_watch_thread.joinable()) {
+        m_watch_thread.join();
+    }
+    if (m_inotify_fd >= 0) {
+        close(m_inotify_fd);
+        m_inotify_fd = -1;
+    }
+    for (int& fd : m_wake_fd) {
+        close(fd);
+        fd = -1;
+    }
+    printf("runtime config: %lu reloads, %lu rejected\n", m_reloads, m_rejects);
+}
+
+void RuntimeConfigManager::watch_func() {
+    std::string name = m_path.substr(m_path.rfind('/') == std::string::npos ? 0 : m_path.rfind('/') + 1);
+    struct pollfd fds[2] = {
+        {m_wake_fd[0], POLLIN, 0},
+        {m_inotify_fd, POLLIN, 0},
+    };
+    int nfds = m_inotify_fd >= 0 ? 2 : 1;
+
+    while (m_is_running) {
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        bool changed = false;
+        if (fds[0].revents & POLLIN) {
+            char buf[16];
+            ssize_t len = read(m_wake_fd[0], buf, sizeof(buf));
+            for (ssize_t i = 0; i < len; i++) {
+                changed |= buf[i] == 'h';
+            }
+            if (!m_is_running) {
+                break;
+            }
+        }
+        if (nfds > 1 && (fds[1].revents & POLLIN)) {
+            char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t len;
+            while ((len = read(m_inotify_fd, buf, sizeof(buf))) > 0) {
+                for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+                    struct inotify_event *event = (struct inotify_event *)p;
+                    changed |= event->len > 0 && name == event->name;
+                }
+            }
+        }
+        if (!changed) {
+            continue;
+        }
+
+        // 合并短时间内的连续写入
+        usleep(100 * 1000);
+        if (m_inotify_fd >= 0) {
+            char buf[4096];
+            while (read(m_inotify_fd, buf, sizeof(buf)) > 0) {
+            }
+        }
+        reload();
+    }
+}
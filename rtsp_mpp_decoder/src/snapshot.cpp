@@ -0,0 +1,464 @@
+#include "snapshot.h"
+#include "postprocess.h"
+#include "stb_image_write.h"
+
+#include <rockchip/rk_mpi.h>
+#include <rockchip/mpp_meta.h>
+
+#include <chrono>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define SNAP_ALIGN(x, a) (((x) + (a)-1) & ~((a)-1))
+
+static int64_t get_time_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// MPP MJPEG 硬件编码器, 每个工作线程一个, 分辨率变化时重建
+class MppJpegEncoder {
+public:
+    ~MppJpegEncoder() {
+        release();
+    }
+
+    bool encode(const code_frame_t& frame, int width, int height, int quality, std::vector<uint8_t>& out) {
+        if(m_ctx == nullptr || m_width != width || m_height != height ||
+           m_hor_stride != frame.width || m_ver_stride != frame.height) {
+            release();
+            if(!init(width, height, frame.width, frame.height, quality)) {
+                release();
+                return false;
+            }
+        }
+
+        memcpy(mpp_buffer_get_ptr(m_frame_buf), frame.frame, frame.size);
+
+        MppFrame mpp_frame = nullptr;
+        if(mpp_frame_init(&mpp_frame)) {
+            return false;
+        }
+        mpp_frame_set_width(mpp_frame, m_width);
+        mpp_frame_set_height(mpp_frame, m_height);
+        mpp_frame_set_hor_stride(mpp_frame, m_hor_stride);
+        mpp_frame_set_ver_stride(mpp_frame, m_ver_stride);
+        mpp_frame_set_fmt(mpp_frame, MPP_FMT_YUV420SP);
+        mpp_frame_set_buffer(mpp_frame, m_frame_buf);
+
+        MppPacket packet = nullptr;
+        mpp_packet_init_with_buffer(&packet, m_pkt_buf);
+        mpp_packet_set_length(packet, 0);
+        mpp_meta_set_packet(mpp_frame_get_meta(mpp_frame), KEY_OUTPUT_PACKET, packet);
+
+        MPP_RET ret = m_mpi->encode_put_frame(m_ctx, mpp_frame);
+        mpp_frame_deinit(&mpp_frame);
+        if(ret != MPP_OK) {
+            mpp_packet_deinit(&packet);
+            return false;
+        }
+
+        MppPacket out_packet = nullptr;
+        ret = m_mpi->encode_get_packet(m_ctx, &out_packet);
+        if(ret != MPP_OK || out_packet == nullptr) {
+            // 挂在 KEY_OUTPUT_PACKET 上的输出包没有取回, 由这里释放
+            if(out_packet != nullptr && out_packet != packet) {
+                mpp_packet_deinit(&out_packet);
+            }
+            mpp_packet_deinit(&packet);
+            return false;
+        }
+        uint8_t *data = (uint8_t *)mpp_packet_get_pos(out_packet);
+        size_t len = mpp_packet_get_length(out_packet);
+        out.assign(data, data + len);
+        if(out_packet != packet) {
+            mpp_packet_deinit(&packet);
+        }
+        mpp_packet_deinit(&out_packet);
+        return !out.empty();
+    }
+
+    // 输入帧和输出包缓冲的大小
+    size_t get_buffer_bytes() const {
+        return m_buf_size * 2;
+    }
+
+    void release() {
+        m_buf_size = 0;
+        if(m_ctx) {
+            mpp_destroy(m_ctx);
+            m_ctx = nullptr;
+        }
+        if(m_cfg) {
+            mpp_enc_cfg_deinit(m_cfg);
+            m_cfg = nullptr;
+        }
+        if(m_frame_buf) {
+            mpp_buffer_put(m_frame_buf);
+            m_frame_buf = nullptr;
+        }
+        if(m_pkt_buf) {
+            mpp_buffer_put(m_pkt_buf);
+            m_pkt_buf = nullptr;
+        }
+        if(m_grp) {
+            mpp_buffer_group_put(m_grp);
+            m_grp = nullptr;
+        }
+    }
+
+private:
+    bool init(int width, int height, int hor_stride, int ver_stride, int quality) {
+        m_width = width;
+        m_height = height;
+        m_hor_stride = hor_stride;
+        m_ver_stride = ver_stride;
+        size_t frame_size = SNAP_ALIGN(hor_stride, 16) * SNAP_ALIGN(ver_stride, 16) * 3 / 2;
+
+        if(mpp_buffer_group_get_internal(&m_grp, MPP_BUFFER_TYPE_DRM)) {
+            return false;
+        }
+        if(mpp_buffer_get(m_grp, &m_frame_buf, frame_size) || mpp_buffer_get(m_grp, &m_pkt_buf, frame_size)) {
+            return false;
+        }
+        m_buf_size = frame_size;
+        if(mpp_create(&m_ctx, &m_mpi) != MPP_OK) {
+            return false;
+        }
+        MppPollType timeout = MPP_POLL_BLOCK;
+        m_mpi->control(m_ctx, MPP_SET_INPUT_TIMEOUT, &timeout);
+        m_mpi->control(m_ctx, MPP_SET_OUTPUT_TIMEOUT, &timeout);
+        if(mpp_init(m_ctx, MPP_CTX_ENC, MPP_VIDEO_CodingMJPEG) != MPP_OK) {
+            return false;
+        }
+        if(mpp_enc_cfg_init(&m_cfg) != MPP_OK || m_mpi->control(m_ctx, MPP_ENC_GET_CFG, m_cfg)) {
+            return false;
+        }
+        mpp_enc_cfg_set_s32(m_cfg, "prep:width", width);
+        mpp_enc_cfg_set_s32(m_cfg, "prep:height", height);
+        mpp_enc_cfg_set_s32(m_cfg, "prep:hor_stride", hor_stride);
+        mpp_enc_cfg_set_s32(m_cfg, "prep:ver_stride", ver_stride);
+        mpp_enc_cfg_set_s32(m_cfg, "prep:format", MPP_FMT_YUV420SP);
+        mpp_enc_cfg_set_s32(m_cfg, "rc:mode", MPP_ENC_RC_MODE_FIXQP);
+        /* jpeg use special codec config to control qtable */
+        mpp_enc_cfg_set_s32(m_cfg, "jpeg:q_factor", quality);
+        mpp_enc_cfg_set_s32(m_cfg, "jpeg:qf_max", 99);
+        mpp_enc_cfg_set_s32(m_cfg, "jpeg:qf_min", 1);
+        if(m_mpi->control(m_ctx, MPP_ENC_SET_CFG, m_cfg)) {
+            return false;
+        }
+        return true;
+    }
+
+private:
+    MppCtx m_ctx = nullptr;
+    MppApi *m_mpi = nullptr;
+    MppEncCfg m_cfg = nullptr;
+    MppBufferGroup m_grp = nullptr;
+    MppBuffer m_frame_buf = nullptr;
+    MppBuffer m_pkt_buf = nullptr;
+    int m_width = 0;
+    int m_height = 0;
+    int m_hor_stride = 0;
+    int m_ver_stride = 0;
+    size_t m_buf_size = 0;
+};
+
+// NV12 一行转 RGB888, BT.601 定点系数, NEON 下一次处理 8 个像素
+static void nv12_row_to_rgb(const uint8_t *y_row, const uint8_t *uv_row, uint8_t *rgb, int width) {
+    int x = 0;
+#if defined(__ARM_NEON)
+    const int16x8_t c128 = vdupq_n_s16(128);
+    for(; x + 8 <= width; x += 8) {
+        uint8x8_t y8 = vld1_u8(y_row + x);
+        // 只读本块的 8 字节(4 组 UV, 每组覆盖两个像素), vld2 会读 16 字节, 最后一行越界
+        uint8x8_t uv8 = vld1_u8(uv_row + x);
+        uint8x8x2_t uv = vuzp_u8(uv8, uv8);
+        uint8x8_t u8 = vzip_u8(uv.val[0], uv.val[0]).val[0];
+        uint8x8_t v8 = vzip_u8(uv.val[1], uv.val[1]).val[0];
+        int16x8_t y = vreinterpretq_s16_u16(vshll_n_u8(y8, 6));
+        int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), c128);
+        int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), c128);
+        // r = y + 1.402v, g = y - 0.344u - 0.714v, b = y + 1.772u (系数 * 64)
+        int16x8_t r = vmlaq_n_s16(y, v, 90);
+        int16x8_t g = vmlsq_n_s16(vmlsq_n_s16(y, u, 22), v, 46);
+        int16x8_t b = vmlaq_n_s16(y, u, 113);
+        uint8x8x3_t out;
+        out.val[0] = vqshrun_n_s16(r, 6);
+        out.val[1] = vqshrun_n_s16(g, 6);
+        out.val[2] = vqshrun_n_s16(b, 6);
+        vst3_u8(rgb + x * 3, out);
+    }
+#endif
+    for(; x < width; x++) {
+        int y = y_row[x] << 6;
+        int u = uv_row[(x & ~1)] - 128;
+        int v = uv_row[(x & ~1) + 1] - 128;
+        int r = (y + 90 * v) >> 6;
+        int g = (y - 22 * u - 46 * v) >> 6;
+        int b = (y + 113 * u) >> 6;
+        rgb[x * 3 + 0] = r < 0 ? 0 : (r > 255 ? 255 : r);
+        rgb[x * 3 + 1] = g < 0 ? 0 : (g > 255 ? 255 : g);
+        rgb[x * 3 + 2] = b < 0 ? 0 : (b > 255 ? 255 : b);
+    }
+}
+
+static void stbi_append_func(void *context, void *data, int size) {
+    std::vector<uint8_t> *out = (std::vector<uint8_t> *)context;
+    out->insert(out->end(), (uint8_t *)data, (uint8_t *)data + size);
+}
+
+// CPU 路径: NV12 -> RGB -> stb JPEG
+static bool cpu_encode_jpeg(const code_frame_t& frame, int width, int height, int quality, std::vector<uint8_t>& out) {
+    std::vector<uint8_t> rgb(width * height * 3);
+    const uint8_t *y_plane = frame.frame;
+    const uint8_t *uv_plane = frame.frame + frame.width * frame.height;
+    for(int y = 0; y < height; y++) {
+        nv12_row_to_rgb(y_plane + y * frame.width, uv_plane + (y / 2) * frame.width, rgb.data() + y * width * 3, width);
+    }
+    out.clear();
+    return stbi_write_jpg_to_func(stbi_append_func, &out, width, height, 3, rgb.data(), quality) != 0;
+}
+
+int SnapshotService::initialize(const SnapshotConfig& config) {
+    m_config = config;
+    if(m_config.workers < 1) {
+        m_config.workers = 1;
+    }
+    if(m_config.queue_size < 1) {
+        m_config.queue_size = 1;
+    }
+
+    // 类别名转为类别掩码, 未配置时任意类别都可触发
+    m_class_mask.assign(OBJ_CLASS_MAX, m_config.classes.empty());
+    size_t start = 0;
+    while(start < m_config.classes.size()) {
+        size_t end = m_config.classes.find(',', start);
+        if(end == std::string::npos) {
+            end = m_config.classes.size();
+        }
+        std::string name = m_config.classes.substr(start, end - start);
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        for(int i = 0; i < OBJ_CLASS_MAX; i++) {
+            if(name == coco_cls_to_name(i)) {
+                m_class_mask[i] = true;
+            }
+        }
+        start = end + 1;
+    }
+
+    mkdir(m_config.dir.c_str(), 0755);
+
+    m_is_running = true;
+    for(int i = 0; i < m_config.workers; i++) {
+        m_workers.emplace_back(&SnapshotService::worker_func, this, i);
+    }
+
+    if(m_config.http_port > 0) {
+        m_http_fd = socket(AF_INET, SOCK_STREAM, 0);
+        int opt = 1;
+        setsockopt(m_http_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(m_config.http_port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(m_http_fd < 0 || bind(m_http_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(m_http_fd, 4) < 0) {
+            printf("snapshot http listen on port %d failed\n", m_config.http_port);
+            if(m_http_fd >= 0) {
+                close(m_http_fd);
+                m_http_fd = -1;
+            }
+        } else {
+            m_http_thread = std::thread(&SnapshotService::http_func, this);
+        }
+    }
+
+    printf("snapshot service started: dir=%s workers=%d queue=%d\n", m_config.dir.c_str(),
+           m_config.workers, m_config.queue_size);
+    return 0;
+}
+
+bool SnapshotService::match_rule(const code_frame_t& frame) {
+    for(const auto& det : frame.detects) {
+        if(det.cls_id >= 0 && det.cls_id < OBJ_CLASS_MAX && m_class_mask[det.cls_id] &&
+           det.prop >= m_config.min_score) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SnapshotService::on_frame(const std::shared_ptr<code_frame_t>& frame) {
+    if(!m_is_running || !frame || !frame->frame) {
+        return;
+    }
+
+    std::string reason;
+    {
+        std::lock_guard<std::mutex> lock(m_request_mutex);
+        reason.swap(m_request_reason);
+    }
+    if(reason.empty() && !frame->detects.empty()) {
+        int64_t now_ms = get_time_ms();
+        if(now_ms - m_last_rule_ms >= m_config.min_interval_ms && match_rule(*frame)) {
+            m_last_rule_ms = now_ms;
+            reason = "detect";
+        }
+    }
+    if(!reason.empty()) {
+        submit(frame, reason);
+    }
+}
+
+void SnapshotService::request(const std::string& reason) {
+    std::lock_guard<std::mutex> lock(m_request_mutex);
+    m_request_reason = reason;
+}
+
+bool SnapshotService::submit(const std::shared_ptr<code_frame_t>& frame, const std::string& reason) {
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        if((int)m_queue.size() >= m_config.queue_size) {
+            m_dropped++;
+            return false;
+        }
+        m_queue.push_back({frame, reason});
+    }
+    m_queue_cv.notify_one();
+    return true;
+}
+
+bool SnapshotService::write_file(const std::string& path, const std::vector<uint8_t>& data) {
+    // 先写临时文件再改名, 读取方不会看到写了一半的JPEG
+    std::string tmp_path = path + ".tmp";
+    FILE *fp = fopen(tmp_path.c_str(), "wb");
+    if(fp == NULL) {
+        printf("snapshot open %s failed\n", tmp_path.c_str());
+        return false;
+    }
+    size_t written = fwrite(data.data(), 1, data.size(), fp);
+    fclose(fp);
+    if(written != data.size()) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+void SnapshotService::worker_func(int index) {
+    MppJpegEncoder mpp_encoder;
+    bool use_mpp = m_config.use_mpp;
+    std::vector<uint8_t> jpeg;
+    size_t buffer_bytes = 0;    // 本线程计入 m_buffer_bytes 的量
+
+    while(m_is_running) {
+        snapshot_task_t task;
+        {
+            std::unique_lock<std::mutex> lock(m_queue_mutex);
+            m_queue_cv.wait(lock, [this]() {
+                return !m_queue.empty() || !m_is_running;
+            });
+            if(!m_is_running) {
+                break;
+            }
+            task = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        const code_frame_t& frame = *task.frame;
+        int width = frame.valid_width > 0 ? frame.valid_width : frame.width;
+        int height = frame.valid_height > 0 ? frame.valid_height : frame.height;
+
+        bool ok = false;
+        if(use_mpp) {
+            ok = mpp_encoder.encode(frame, width, height, m_config.quality, jpeg);
+            if(!ok) {
+                printf("snapshot worker %d: mpp jpeg encode failed, fallback to cpu\n", index);
+                mpp_encoder.release();
+                use_mpp = false;
+            }
+        }
+        if(!ok) {
+            ok = cpu_encode_jpeg(frame, width, height, m_config.quality, jpeg);
+        }
+        size_t bytes = mpp_encoder.get_buffer_bytes() + jpeg.capacity();
+        m_buffer_bytes += bytes - buffer_bytes;
+        buffer_bytes = bytes;
+        if(!ok) {
+            continue;
+        }
+
+        char name[128];
+        snprintf(name, sizeof(name), "/snapshot_%lu_%s.jpg", frame.frame_seq, task.reason.c_str());
+        if(write_file(m_config.dir + name, jpeg)) {
+            m_saved++;
+        }
+    }
+    m_buffer_bytes -= buffer_bytes;
+}
+
+void SnapshotService::http_func() {
+    // 极简本地HTTP: GET /snapshot 请求抓拍下一帧
+    while(m_is_running) {
+        int client = accept(m_http_fd, NULL, NULL);
+        if(client < 0) {
+            if(!m_is_running) {
+                break;
+            }
+            continue;
+        }
+        char buf[512];
+        int len = recv(client, buf, sizeof(buf) - 1, 0);
+        buf[len > 0 ? len : 0] = '\0';
+
+        const char *resp;
+        if(strncmp(buf, "GET /snapshot", 13) == 0) {
+            request("http");
+            resp = "HTTP/1.1 202 Accepted\r\nContent-Type: application/json\r\nConnection: close\r\n\r\n";
+        } else {
+            resp = "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n";
+        }
+        send(client, resp, strlen(resp), 0);
+        if(strncmp(buf, "GET /snapshot", 13) == 0) {
+            char body[128];
+            snprintf(body, sizeof(body), "{\"saved\":%lu,\"dropped\":%lu}\n", m_saved.load(), m_dropped.load());
+            send(client, body, strlen(body), 0);
+        }
+        close(client);
+    }
+}
+
+void SnapshotService::release() {
+    if(!m_is_running.exchange(false)) {
+        return;
+    }
+    m_queue_cv.notify_all();
+    for(auto& worker : m_workers) {
+        if(worker.joinable()) {
+            worker.join();
+        }
+    }
+    m_workers.clear();
+
+    if(m_http_fd >= 0) {
+        shutdown(m_http_fd, SHUT_RDWR);
+        close(m_http_fd);
+        m_http_fd = -1;
+    }
+    if(m_http_thread.joinable()) {
+        m_http_thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(m_queue_mutex);
+    m_queue.clear();
+    printf("snapshot service stopped: saved=%lu dropped=%lu\n", m_saved.load(), m_dropped.load());
+}
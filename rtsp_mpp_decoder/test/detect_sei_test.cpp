@@ -0,0 +1,136 @@
+// 检测结果 SEI 自检: 生成 -> 防竞争检查 -> NAL 迭代 -> 解析, 比较往返结果
+// 失败时输出原因并返回非0
+#include "detect_sei.h"
+#include "nal_parser.h"
+
+#include <stdio.h>
+
+static int g_failed = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        g_failed++; \
+    } \
+} while (0)
+
+static frame_detect_t make_detect(int cls_id, float prop, int track_id, int left, int top, int right, int bottom) {
+    frame_detect_t det;
+    det.cls_id = cls_id;
+    det.prop = prop;
+    det.track_id = track_id;
+    det.box.left = left;
+    det.box.top = top;
+    det.box.right = right;
+    det.box.bottom = bottom;
+    return det;
+}
+
+// 起始码之后不能出现 00 00 00/01/02, 00 00 03 之后只能跟 00~03(防竞争字节)
+static bool has_emulation(const std::vector<uint8_t>& nal, size_t begin) {
+    for (size_t i = begin; i + 2 < nal.size(); i++) {
+        if (nal[i] != 0 || nal[i + 1] != 0) {
+            continue;
+        }
+        if (nal[i + 2] <= 0x02 || (nal[i + 2] == 0x03 && i + 3 < nal.size() && nal[i + 3] > 0x03)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void round_trip(eNalCodec codec, const detect_sei_t& in, const char *name) {
+    std::vector<uint8_t> out;
+    detect_sei_build(codec, in, out);
+    CHECK(out.size() > 4 && out[0] == 0 && out[1] == 0 && out[2] == 0 && out[3] == 1, "%s: missing start code", name);
+    CHECK(!has_emulation(out, 4), "%s: emulation prevention missing", name);
+
+    NalIterator it(out.data(), out.size(), codec);
+    nal_unit_t nal;
+    bool found = it.next(nal);
+    CHECK(found, "%s: no NAL found", name);
+    if (!found) {
+        return;
+    }
+    CHECK(nal.is_sei, "%s: NAL type %d is not SEI", name, nal.type);
+    CHECK(!it.next(nal) || nal.size == 0, "%s: extra NAL after SEI", name);
+
+    NalIterator first(out.data(), out.size(), codec);
+    first.next(nal);
+    detect_sei_t parsed;
+    bool ok = detect_sei_parse(codec, nal.data, nal.size, parsed);
+    CHECK(ok, "%s: parse failed", name);
+    if (!ok) {
+        return;
+    }
+
+    size_t expect = in.detects.size() > DETECT_SEI_MAX_OBJECTS ? DETECT_SEI_MAX_OBJECTS : in.detects.size();
+    CHECK(parsed.frame_seq == (in.frame_seq & 0xffffffff), "%s: frame_seq %lu != %lu", name,
+          (unsigned long)parsed.frame_seq, (unsigned long)in.frame_seq);
+    CHECK(parsed.width == in.width && parsed.height == in.height, "%s: size %dx%d != %dx%d", name,
+          parsed.width, parsed.height, in.width, in.height);
+    CHECK(parsed.detects.size() == expect, "%s: count %zu != %zu", name, parsed.detects.size(), expect);
+    for (size_t i = 0; i < parsed.detects.size() && i < expect; i++) {
+        const frame_detect_t& a = in.detects[i];
+        const frame_detect_t& b = parsed.detects[i];
+        float diff = a.prop - b.prop;
+        CHECK(a.cls_id == b.cls_id && a.track_id == b.track_id, "%s: object %zu cls/track mismatch", name, i);
+        CHECK(diff < 0.5f / 255 + 1e-6f && diff > -0.5f / 255 - 1e-6f, "%s: object %zu score %f != %f", name, i, b.prop, a.prop);
+        CHECK(a.box.left == b.box.left && a.box.top == b.box.top &&
+              a.box.right == b.box.right && a.box.bottom == b.box.bottom, "%s: object %zu box mismatch", name, i);
+    }
+}
+
+int main() {
+    const eNalCodec codecs[2] = {NAL_CODEC_H264, NAL_CODEC_H265};
+    const char *codec_names[2] = {"h264", "h265"};
+
+    for (int c = 0; c < 2; c++) {
+        char name[64];
+
+        // 无目标
+        detect_sei_t empty;
+        empty.frame_seq = 0;
+        empty.width = 1920;
+        empty.height = 1080;
+        snprintf(name, sizeof(name), "%s empty", codec_names[c]);
+        round_trip(codecs[c], empty, name);
+
+        // 大量0字节(frame_seq/坐标/跟踪ID为0~3), 必须插入防竞争字节
+        detect_sei_t zeros;
+        zeros.frame_seq = 0x100;
+        zeros.width = 3;
+        zeros.height = 2;
+        zeros.detects.push_back(make_detect(0, 0.0f, 0, 0, 0, 0, 0));
+        zeros.detects.push_back(make_detect(1, 1.0f, 1, 1, 2, 3, 0));
+        zeros.detects.push_back(make_detect(0, 0.5f, -1, 0, 0, 1, 1));
+        snprintf(name, sizeof(name), "%s zeros", codec_names[c]);
+        round_trip(codecs[c], zeros, name);
+
+        // 负载超过255字节, payloadSize 需要 0xff 分段; 超过上限的目标被截断
+        detect_sei_t many;
+        many.frame_seq = 0x123456789ULL;
+        many.width = 3840;
+        many.height = 2160;
+        for (int i = 0; i < 300; i++) {
+            many.detects.push_back(make_detect(i % 80, (i % 100) / 100.0f, i % 7 == 0 ? -1 : i,
+                                               i * 10, i * 5, i * 10 + 64, i * 5 + 128));
+        }
+        snprintf(name, sizeof(name), "%s many", codec_names[c]);
+        round_trip(codecs[c], many, name);
+    }
+
+    // 其他 SEI 不应被识别为检测结果
+    const uint8_t other_sei[] = {0x06, 0x05, 0x10, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0x80};
+    detect_sei_t parsed;
+    CHECK(!detect_sei_parse(NAL_CODEC_H264, other_sei, sizeof(other_sei), parsed), "foreign uuid accepted");
+
+    if (g_failed) {
+        printf("detect_sei_test: %d check(s) failed\n", g_failed);
+        return 1;
+    }
+    printf("detect_sei_test: ok\n");
+    return 0;
+}
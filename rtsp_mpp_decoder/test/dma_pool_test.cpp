@@ -0,0 +1,191 @@
+// DMA缓冲池自检(memfd 后端, 不需要 /dev/dma_heap): 尺寸档边界, 复用/新分配计数,
+// 按空闲上限和空闲时间归还, 各使用方占用/峰值统计. 失败时输出原因并返回非0
+#include "dma_pool.h"
+
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
+
+static int g_failed = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        g_failed++; \
+    } \
+} while (0)
+
+static const char *HEAP = "/dev/dma_heap/pool_test";
+static const size_t PAGE = 4096;
+
+static void test_size_class() {
+    // 8页以内按页对齐
+    CHECK(DmaPool::size_class(1) == PAGE, "size_class(1) = %zu", DmaPool::size_class(1));
+    CHECK(DmaPool::size_class(PAGE) == PAGE, "size_class(4096) = %zu", DmaPool::size_class(PAGE));
+    CHECK(DmaPool::size_class(PAGE + 1) == 2 * PAGE, "size_class(4097) = %zu", DmaPool::size_class(PAGE + 1));
+    CHECK(DmaPool::size_class(8 * PAGE) == 8 * PAGE, "size_class(32K) = %zu", DmaPool::size_class(8 * PAGE));
+    // 超过8页后每个2的幂区间分8档
+    CHECK(DmaPool::size_class(8 * PAGE + 1) == 9 * PAGE, "size_class(32K+1) = %zu", DmaPool::size_class(8 * PAGE + 1));
+    CHECK(DmaPool::size_class(1 << 20) == (1 << 20), "size_class(1M) = %zu", DmaPool::size_class(1 << 20));
+    CHECK(DmaPool::size_class((1 << 20) + 1) == (1 << 20) + (1 << 17), "size_class(1M+1) = %zu",
+          DmaPool::size_class((1 << 20) + 1));
+    // 1080p NV12
+    CHECK(DmaPool::size_class(1920 * 1088 * 3 / 2) == 12 * (1 << 18), "size_class(1080p) = %zu",
+          DmaPool::size_class(1920 * 1088 * 3 / 2));
+
+    // 档位不小于请求, 单调, 自身落在自己的档上, 8页以上浪费不超过 1/8
+    size_t prev = 0;
+    for (size_t size = 1; size < (64 << 20); size = size * 5 / 4 + 1) {
+        size_t cls = DmaPool::size_class(size);
+        CHECK(cls >= size && cls % PAGE == 0, "size_class(%zu) = %zu", size, cls);
+        CHECK(cls >= prev, "size_class not monotonic at %zu", size);
+        CHECK(DmaPool::size_class(cls) == cls, "size_class(%zu) not idempotent", cls);
+        CHECK(size <= 8 * PAGE || cls - size <= cls / 8, "size_class(%zu) = %zu wastes too much", size, cls);
+        prev = cls;
+    }
+}
+
+static void test_reuse() {
+    DmaPool& pool = DmaPool::getInstance();
+    size_t size = 100 * 1024;
+    size_t cls = DmaPool::size_class(size);
+
+    dma_block_t a;
+    CHECK(pool.acquire(HEAP, size, "reuse", &a) == 0, "acquire failed");
+    CHECK(a.fd > 0 && a.va != nullptr && a.size == cls, "block fd=%d va=%p size=%zu", a.fd, a.va, a.size);
+    CHECK(!a.cached, "memfd block must not be marked cached");
+    memset(a.va, 0x5a, a.size);
+    void *va = a.va;
+
+    pool.release(HEAP, &a, "reuse");
+    CHECK(a.va == nullptr && a.fd == -1, "released block not cleared");
+    CHECK(pool.get_free_bytes() == cls, "free bytes %zu != %zu", pool.get_free_bytes(), cls);
+
+    // 同一尺寸档内的不同大小复用同一块
+    dma_block_t b;
+    CHECK(pool.acquire(HEAP, cls - 100, "reuse", &b) == 0, "acquire failed");
+    CHECK(b.va == va, "same size class not reused");
+    // 已在使用中, 再取一块需要新分配
+    dma_block_t c;
+    CHECK(pool.acquire(HEAP, size, "reuse", &c) == 0, "acquire failed");
+    CHECK(c.va != b.va, "in-use block handed out twice");
+    // 其他尺寸档不复用
+    dma_block_t d;
+    CHECK(pool.acquire(HEAP, 2 * cls, "reuse", &d) == 0, "acquire failed");
+
+    dma_owner_stats_t stats = pool.get_owner_stats("reuse");
+    CHECK(stats.allocs == 3 && stats.reuses == 1, "allocs %lu reuses %lu, expect 3/1", stats.allocs, stats.reuses);
+    CHECK(pool.get_total_bytes() == cls * 2 + DmaPool::size_class(2 * cls), "total bytes %zu",
+          pool.get_total_bytes());
+
+    pool.release(HEAP, &b, "reuse");
+    pool.release(HEAP, &c, "reuse");
+    pool.release(HEAP, &d, "reuse");
+    pool.trim(0);
+    CHECK(pool.get_free_bytes() == 0 && pool.get_total_bytes() == 0, "trim(0) left free %zu total %zu",
+          pool.get_free_bytes(), pool.get_total_bytes());
+}
+
+static void test_trim_max_free() {
+    DmaPool& pool = DmaPool::getInstance();
+    size_t cls = DmaPool::size_class(64 * 1024);
+    pool.configure(cls * 2, true);
+
+    dma_block_t blocks[4];
+    for (auto& block : blocks) {
+        CHECK(pool.acquire(HEAP, cls, "trim", &block) == 0, "acquire failed");
+    }
+    CHECK(pool.get_total_bytes() == cls * 4, "total bytes %zu", pool.get_total_bytes());
+    for (auto& block : blocks) {
+        pool.release(HEAP, &block, "trim");
+        CHECK(pool.get_free_bytes() <= cls * 2, "free bytes %zu over limit %zu", pool.get_free_bytes(), cls * 2);
+    }
+    CHECK(pool.get_free_bytes() == cls * 2, "free bytes %zu != %zu", pool.get_free_bytes(), cls * 2);
+    CHECK(pool.get_total_bytes() == cls * 2, "total bytes %zu after release", pool.get_total_bytes());
+
+    pool.trim(0);
+    pool.configure(64 * 1024 * 1024, true);
+}
+
+static void test_trim_idle() {
+    DmaPool& pool = DmaPool::getInstance();
+    size_t cls = DmaPool::size_class(64 * 1024);
+
+    dma_block_t old_block, new_block;
+    CHECK(pool.acquire(HEAP, cls, "idle", &old_block) == 0, "acquire failed");
+    CHECK(pool.acquire(HEAP, cls, "idle", &new_block) == 0, "acquire failed");
+    pool.release(HEAP, &old_block, "idle");
+    std::this_thread::sleep_for(std::chrono::milliseconds(120));
+    pool.release(HEAP, &new_block, "idle");
+
+    // 两块都未空闲到 1 秒
+    pool.trim(1000);
+    CHECK(pool.get_free_bytes() == cls * 2, "trim(1000) freed young blocks, free %zu", pool.get_free_bytes());
+    // 只有先归还的一块空闲超过 100ms
+    pool.trim(100);
+    CHECK(pool.get_free_bytes() == cls, "trim(100) left free %zu, expect %zu", pool.get_free_bytes(), cls);
+    CHECK(pool.get_total_bytes() == cls, "total bytes %zu, expect %zu", pool.get_total_bytes(), cls);
+    pool.trim(0);
+    CHECK(pool.get_free_bytes() == 0 && pool.get_total_bytes() == 0, "trim(0) left free %zu total %zu",
+          pool.get_free_bytes(), pool.get_total_bytes());
+}
+
+static void test_owner_stats() {
+    DmaPool& pool = DmaPool::getInstance();
+    size_t small = DmaPool::size_class(8 * 1024);
+    size_t large = DmaPool::size_class(512 * 1024);
+
+    dma_block_t a1, a2, b1;
+    CHECK(pool.acquire(HEAP, small, "owner_a", &a1) == 0, "acquire failed");
+    CHECK(pool.acquire(HEAP, large, "owner_a", &a2) == 0, "acquire failed");
+    CHECK(pool.acquire(HEAP, small, "owner_b", &b1) == 0, "acquire failed");
+
+    dma_owner_stats_t a = pool.get_owner_stats("owner_a");
+    dma_owner_stats_t b = pool.get_owner_stats("owner_b");
+    CHECK(a.in_use_blocks == 2 && a.in_use_bytes == small + large, "owner_a in use %d blocks %zu bytes",
+          a.in_use_blocks, a.in_use_bytes);
+    CHECK(a.peak_bytes == small + large, "owner_a peak %zu", a.peak_bytes);
+    CHECK(b.in_use_blocks == 1 && b.in_use_bytes == small, "owner_b in use %d blocks %zu bytes",
+          b.in_use_blocks, b.in_use_bytes);
+
+    // owner_b 复用 owner_a 归还的缓冲, 各自计数
+    pool.release(HEAP, &a2, "owner_a");
+    dma_block_t b2;
+    CHECK(pool.acquire(HEAP, large, "owner_b", &b2) == 0, "acquire failed");
+    a = pool.get_owner_stats("owner_a");
+    b = pool.get_owner_stats("owner_b");
+    CHECK(a.in_use_blocks == 1 && a.in_use_bytes == small && a.peak_bytes == small + large,
+          "owner_a after release: %d blocks %zu bytes peak %zu", a.in_use_blocks, a.in_use_bytes, a.peak_bytes);
+    CHECK(b.in_use_bytes == small + large && b.peak_bytes == small + large && b.reuses == 1 && b.allocs == 1,
+          "owner_b: %zu bytes peak %zu reuses %lu allocs %lu", b.in_use_bytes, b.peak_bytes, b.reuses, b.allocs);
+
+    pool.release(HEAP, &a1, "owner_a");
+    pool.release(HEAP, &b1, "owner_b");
+    pool.release(HEAP, &b2, "owner_b");
+    a = pool.get_owner_stats("owner_a");
+    b = pool.get_owner_stats("owner_b");
+    CHECK(a.in_use_blocks == 0 && a.in_use_bytes == 0 && b.in_use_blocks == 0 && b.in_use_bytes == 0,
+          "in use not zero after release");
+    CHECK(pool.get_owner_stats("unknown").allocs == 0, "unknown owner has stats");
+    pool.trim(0);
+}
+
+int main() {
+    DmaPool::getInstance().configure(64 * 1024 * 1024, true);
+
+    test_size_class();
+    test_reuse();
+    test_trim_max_free();
+    test_trim_idle();
+    test_owner_stats();
+
+    if (g_failed) {
+        printf("dma_pool_test: %d check(s) failed\n", g_failed);
+        return 1;
+    }
+    printf("dma_pool_test: ok\n");
+    return 0;
+}
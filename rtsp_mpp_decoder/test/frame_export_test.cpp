@@ -0,0 +1,348 @@
+// 解码帧导出自检(DMA池强制 memfd 后端, 普通 Linux 主机即可运行):
+// 导出服务与客户端通过临时 Unix 套接字连接, 检查 HELLO/BUFFER/FRAME 消息顺序和描述符内容,
+// 租用中的缓冲不被改写, 租约用满的客户端只丢自己的帧, 断开连接归还该客户端的全部租约.
+// 失败时输出原因并返回非0
+#include "frame_export.h"
+#include "frame_export_client.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <set>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static int g_failed = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        g_failed++; \
+    } \
+} while (0)
+
+static const int WIDTH = 64;
+static const int HEIGHT = 46;
+static const int HOR_STRIDE = 64;
+static const int VER_STRIDE = 48;
+static const size_t FRAME_SIZE = HOR_STRIDE * VER_STRIDE * 3 / 2;
+
+static uint8_t pattern(uint64_t seq, size_t i) {
+    return (uint8_t)(seq * 7 + i * 13 + (i >> 8));
+}
+
+static bool check_pattern(const void *data, uint64_t seq) {
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < FRAME_SIZE; i++) {
+        if (p[i] != pattern(seq, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void publish(FrameExporter& exporter, uint64_t seq) {
+    std::vector<uint8_t> frame(FRAME_SIZE);
+    for (size_t i = 0; i < FRAME_SIZE; i++) {
+        frame[i] = pattern(seq, i);
+    }
+    exporter.publish(frame.data(), WIDTH, HEIGHT, HOR_STRIDE, VER_STRIDE, seq, (int64_t)seq * 40);
+}
+
+// 客户端的连接/断开由导出服务的 IO 线程异步处理
+static bool wait_for(const std::function<bool()>& cond) {
+    for (int i = 0; i < 200; i++) {
+        if (cond()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return false;
+}
+
+// 不经过客户端库的原始连接, 用于检查消息顺序
+struct raw_client_t {
+    int sock = -1;
+    const uint8_t *desc_map = nullptr;
+    size_t desc_size = 0;
+    uint32_t max_buffers = 0;
+    std::vector<const uint8_t *> buffers;
+    std::vector<size_t> buffer_sizes;
+    std::vector<uint32_t> generations;
+
+    const frame_export_desc_t *desc(uint32_t id) const {
+        return (const frame_export_desc_t *)(desc_map + FRAME_EXPORT_HEADER_SIZE + id * sizeof(frame_export_desc_t));
+    }
+};
+
+static int raw_recv(int sock, frame_export_msg_t *msg, int *fd_out) {
+    struct iovec iov;
+    iov.iov_base = msg;
+    iov.iov_len = sizeof(*msg);
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+    *fd_out = -1;
+    struct timeval tv = {1, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ssize_t len = recvmsg(sock, &hdr, MSG_CMSG_CLOEXEC);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    if (len > 0 && cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(fd_out, CMSG_DATA(cmsg), sizeof(int));
+    }
+    return len == sizeof(*msg) ? 0 : -1;
+}
+
+static bool raw_connect(const char *path, raw_client_t& client) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    client.sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (client.sock < 0 || connect(client.sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        return false;
+    }
+    frame_export_msg_t msg;
+    int fd;
+    if (raw_recv(client.sock, &msg, &fd) != 0 || fd < 0) {
+        return false;
+    }
+    CHECK(msg.type == FRAME_EXPORT_MSG_HELLO, "first message type %u is not HELLO", msg.type);
+    void *map = mmap(NULL, msg.size, PROT_READ, MAP_SHARED, fd, 0);
+    // 描述符表 fd 必须是只读的
+    CHECK(mmap(NULL, msg.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) == MAP_FAILED, "desc table fd is writable");
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    const frame_export_header_t *header = (const frame_export_header_t *)map;
+    CHECK(header->magic == FRAME_EXPORT_MAGIC && header->version == FRAME_EXPORT_VERSION &&
+          header->desc_size == sizeof(frame_export_desc_t) && header->max_buffers == msg.buffer_id,
+          "bad desc table header");
+    client.desc_map = (const uint8_t *)map;
+    client.desc_size = msg.size;
+    client.max_buffers = msg.buffer_id;
+    client.buffers.assign(client.max_buffers, nullptr);
+    client.buffer_sizes.assign(client.max_buffers, 0);
+    client.generations.assign(client.max_buffers, 0);
+    return true;
+}
+
+static void raw_release(raw_client_t& client, uint32_t id) {
+    frame_export_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = FRAME_EXPORT_MSG_RELEASE;
+    msg.buffer_id = id;
+    send(client.sock, &msg, sizeof(msg), MSG_NOSIGNAL);
+}
+
+static void raw_close(raw_client_t& client) {
+    for (size_t i = 0; i < client.buffers.size(); i++) {
+        if (client.buffers[i] != nullptr) {
+            munmap((void *)client.buffers[i], client.buffer_sizes[i]);
+        }
+    }
+    if (client.desc_map != nullptr) {
+        munmap((void *)client.desc_map, client.desc_size);
+    }
+    close(client.sock);
+}
+
+// 收下一帧, BUFFER 只能出现在该缓冲(该 generation)首次发送时, 且必须在对应 FRAME 之前
+static bool raw_next(raw_client_t& client, frame_export_msg_t& frame) {
+    for (;;) {
+        frame_export_msg_t msg;
+        int fd;
+        if (raw_recv(client.sock, &msg, &fd) != 0) {
+            return false;
+        }
+        if (msg.buffer_id >= client.max_buffers) {
+            CHECK(false, "buffer id %u out of range", msg.buffer_id);
+            return false;
+        }
+        if (msg.type == FRAME_EXPORT_MSG_BUFFER) {
+            CHECK(fd >= 0, "BUFFER without fd");
+            CHECK(msg.generation != client.generations[msg.buffer_id], "BUFFER %u resent for generation %u",
+                  msg.buffer_id, msg.generation);
+            CHECK(msg.size >= FRAME_SIZE, "buffer size %lu < frame size", (unsigned long)msg.size);
+            if (client.buffers[msg.buffer_id] != nullptr) {
+                munmap((void *)client.buffers[msg.buffer_id], client.buffer_sizes[msg.buffer_id]);
+            }
+            void *va = mmap(NULL, msg.size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            client.buffers[msg.buffer_id] = va == MAP_FAILED ? nullptr : (const uint8_t *)va;
+            client.buffer_sizes[msg.buffer_id] = msg.size;
+            client.generations[msg.buffer_id] = msg.generation;
+            continue;
+        }
+        CHECK(fd < 0, "unexpected fd with message type %u", msg.type);
+        if (fd >= 0) {
+            close(fd);
+        }
+        CHECK(msg.type == FRAME_EXPORT_MSG_FRAME, "unexpected message type %u", msg.type);
+        CHECK(client.buffers[msg.buffer_id] != nullptr && client.generations[msg.buffer_id] == msg.generation,
+              "FRAME for buffer %u generation %u before its BUFFER", msg.buffer_id, msg.generation);
+        frame = msg;
+        return client.buffers[msg.buffer_id] != nullptr;
+    }
+}
+
+// 消息顺序, 描述符内容, 租用中的缓冲不被改写
+static void test_sequence(FrameExporter& exporter, const char *path) {
+    raw_client_t client;
+    CHECK(raw_connect(path, client), "raw connect failed");
+    CHECK(wait_for([&]() { return exporter.consumer_count() == 1; }), "consumer not registered");
+
+    uint32_t held_id = 0;
+    for (uint64_t seq = 1; seq <= 20; seq++) {
+        publish(exporter, seq);
+        frame_export_msg_t frame;
+        if (!raw_next(client, frame)) {
+            CHECK(false, "frame %lu not received", (unsigned long)seq);
+            break;
+        }
+        const frame_export_desc_t *desc = client.desc(frame.buffer_id);
+        CHECK(frame.frame_seq == seq && frame.size == FRAME_SIZE, "FRAME seq %lu size %lu",
+              (unsigned long)frame.frame_seq, (unsigned long)frame.size);
+        CHECK(desc->generation == frame.generation && desc->format == FRAME_EXPORT_FMT_NV12 &&
+              desc->width == WIDTH && desc->height == HEIGHT &&
+              desc->hor_stride == HOR_STRIDE && desc->ver_stride == VER_STRIDE && desc->size == FRAME_SIZE &&
+              desc->frame_seq == seq && desc->pts == (int64_t)seq * 40 && desc->timestamp_us > 0,
+              "desc of frame %lu: %ux%u stride %ux%u size %lu seq %lu pts %ld", (unsigned long)seq,
+              desc->width, desc->height, desc->hor_stride, desc->ver_stride, (unsigned long)desc->size,
+              (unsigned long)desc->frame_seq, (long)desc->pts);
+        CHECK(check_pattern(client.buffers[frame.buffer_id], seq), "frame %lu data mismatch", (unsigned long)seq);
+        // 第一帧一直持有, 其余立即归还
+        if (seq == 1) {
+            held_id = frame.buffer_id;
+        } else {
+            CHECK(frame.buffer_id != held_id, "held buffer %u reused for frame %lu", held_id, (unsigned long)seq);
+            raw_release(client, frame.buffer_id);
+        }
+        // 归还由 IO 线程异步处理, 等处理完再发下一帧, 否则会因租约满被丢帧
+        CHECK(wait_for([&]() { return exporter.get_stats().leased == 1; }), "release not processed");
+    }
+    const frame_export_desc_t *held = client.desc(held_id);
+    CHECK(held->frame_seq == 1 && held->pts == 40, "held buffer desc rewritten: seq %lu", (unsigned long)held->frame_seq);
+    CHECK(check_pattern(client.buffers[held_id], 1), "held buffer data rewritten");
+
+    frame_export_stats_t stats = exporter.get_stats();
+    CHECK(stats.exported == 20 && stats.delivered == 20 && stats.dropped == 0 && stats.no_buffer == 0,
+          "stats exported %lu delivered %lu dropped %lu no_buffer %lu", stats.exported, stats.delivered,
+          stats.dropped, stats.no_buffer);
+    raw_close(client);
+    CHECK(wait_for([&]() { return exporter.consumer_count() == 0; }), "consumer not removed");
+}
+
+// 租约用满的客户端只丢自己的帧; 断开后它的租约全部归还
+static void test_leases(FrameExporter& exporter, const char *path, int max_leases) {
+    frame_export_stats_t before = exporter.get_stats();
+    frame_export_client_t *hoarder = frame_export_connect(path);
+    frame_export_client_t *reader = frame_export_connect(path);
+    CHECK(hoarder != nullptr && reader != nullptr, "client connect failed");
+    if (hoarder == nullptr || reader == nullptr) {
+        frame_export_close(hoarder);
+        frame_export_close(reader);
+        return;
+    }
+    CHECK(wait_for([&]() { return exporter.consumer_count() == 2; }), "consumers not registered");
+
+    // hoarder 从不归还, reader 每帧都归还
+    const int frames = 10;
+    for (uint64_t seq = 100; seq < 100 + frames; seq++) {
+        publish(exporter, seq);
+        frame_export_frame_t frame;
+        int ret = frame_export_next(reader, &frame, 1000);
+        CHECK(ret == 1 && frame.desc.frame_seq == seq, "reader missed frame %lu", (unsigned long)seq);
+        if (ret == 1) {
+            CHECK(check_pattern(frame.data, seq), "reader frame %lu data mismatch", (unsigned long)seq);
+            frame_export_release(reader, &frame);
+        }
+        uint64_t hoarded = std::min<uint64_t>(seq - 100 + 1, max_leases);
+        CHECK(wait_for([&]() { return exporter.get_stats().leased == hoarded; }), "release not processed");
+    }
+    std::set<uint32_t> held_ids;
+    frame_export_frame_t frame;
+    for (int i = 0; i < max_leases; i++) {
+        int ret = frame_export_next(hoarder, &frame, 1000);
+        CHECK(ret == 1 && frame.desc.frame_seq == (uint64_t)(100 + i), "hoarder frame %d missing", i);
+        if (ret == 1) {
+            held_ids.insert(frame.buffer_id);
+        }
+    }
+    CHECK(frame_export_next(hoarder, &frame, 50) == 0, "hoarder got more than %d frames", max_leases);
+
+    frame_export_stats_t stats = exporter.get_stats();
+    CHECK(stats.delivered - before.delivered == (uint64_t)(frames + max_leases), "delivered %lu",
+          stats.delivered - before.delivered);
+    CHECK(stats.dropped - before.dropped == (uint64_t)(frames - max_leases), "dropped %lu",
+          stats.dropped - before.dropped);
+    CHECK(stats.no_buffer == before.no_buffer, "ran out of buffers");
+
+    // 断开后 hoarder 持有的缓冲重新进入轮转
+    CHECK(exporter.get_stats().leased == (uint64_t)max_leases, "leased %lu before disconnect",
+          exporter.get_stats().leased);
+    frame_export_close(hoarder);
+    CHECK(wait_for([&]() { return exporter.consumer_count() == 1; }), "hoarder not removed");
+    CHECK(exporter.get_stats().leased == 0, "leases not returned on disconnect");
+    std::set<uint32_t> seen_ids;
+    for (uint64_t seq = 200; seq < 200 + 4 * (uint64_t)held_ids.size() + 8; seq++) {
+        publish(exporter, seq);
+        int ret = frame_export_next(reader, &frame, 1000);
+        CHECK(ret == 1 && frame.desc.frame_seq == seq, "reader missed frame %lu", (unsigned long)seq);
+        if (ret == 1) {
+            seen_ids.insert(frame.buffer_id);
+            frame_export_release(reader, &frame);
+        }
+        CHECK(wait_for([&]() { return exporter.get_stats().leased == 0; }), "release not processed");
+    }
+    for (uint32_t id : held_ids) {
+        CHECK(seen_ids.count(id) == 1, "buffer %u still leased after hoarder disconnected", id);
+    }
+    frame_export_close(reader);
+    CHECK(wait_for([&]() { return exporter.consumer_count() == 0; }), "reader not removed");
+}
+
+int main() {
+    DmaPool::getInstance().configure(64 * 1024 * 1024, true);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/frame_export_test_%d.sock", (int)getpid());
+    FrameExportConfig config;
+    config.enable = true;
+    config.socket_path = path;
+    config.max_consumers = 2;
+    config.max_leases = 2;
+
+    FrameExporter exporter;
+    if (exporter.initialize(config) != 0) {
+        printf("frame_export_test: initialize failed\n");
+        return 1;
+    }
+    // 没有客户端时不导出
+    publish(exporter, 0);
+    CHECK(exporter.get_stats().exported == 0, "exported without consumers");
+
+    test_sequence(exporter, path);
+    test_leases(exporter, path, config.max_leases);
+    exporter.release();
+
+    if (g_failed) {
+        printf("frame_export_test: %d check(s) failed\n", g_failed);
+        return 1;
+    }
+    printf("frame_export_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,174 @@
+// NAL 解析随机测试: 随机 Annex-B 数据上把 nal_find_start_code / NalIterator / nal_inspect_packet
+// 与逐字节的朴素实现比较, 失败时输出种子和出错的数据并返回非0
+//
+//   nal_parser_fuzz [轮数=20000] [种子=1]
+//
+// 定义 NAL_PARSER_LIBFUZZER 编译时只提供 libFuzzer 入口(-fsanitize=fuzzer), 不含 main
+#include "nal_parser.h"
+
+#include <vector>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 朴素查找 00 00 01
+static const uint8_t *naive_find_start_code(const uint8_t *p, const uint8_t *end) {
+    for(; p + 3 <= end; p++) {
+        if(p[0] == 0 && p[1] == 0 && p[2] == 1) {
+            return p;
+        }
+    }
+    return end;
+}
+
+// 朴素切分: 起始码之后到下一个起始码之前, 去掉尾部的0
+static std::vector<nal_unit_t> naive_split(eNalCodec codec, const uint8_t *data, size_t size) {
+    std::vector<nal_unit_t> nals;
+    const uint8_t *end = data + size;
+    const uint8_t *pos = naive_find_start_code(data, end);
+    while(pos + 3 < end) {
+        const uint8_t *start = pos + 3;
+        const uint8_t *next = naive_find_start_code(start, end);
+        const uint8_t *last = next;
+        while(last > start && last[-1] == 0) {
+            last--;
+        }
+        nal_unit_t nal;
+        nal.data = start;
+        nal.size = last - start;
+        nal_classify(codec, nal);
+        nals.push_back(nal);
+        pos = next;
+    }
+    return nals;
+}
+
+static void dump(const uint8_t *data, size_t size) {
+    for(size_t i = 0; i < size && i < 256; i++) {
+        printf("%02x%s", data[i], (i % 32 == 31) ? "\n" : " ");
+    }
+    printf("\n");
+}
+
+// 检查一段数据, 返回是否一致
+static bool check_buffer(const uint8_t *data, size_t size) {
+    const uint8_t *end = data + size;
+    // 每个起点的查找结果
+    for(size_t i = 0; i <= size; i++) {
+        const uint8_t *expect = naive_find_start_code(data + i, end);
+        const uint8_t *got = nal_find_start_code(data + i, end);
+        if(got != expect) {
+            printf("FAIL start code from offset %zu of %zu: got %td, expect %td\n", i, size, got - data, expect - data);
+            return false;
+        }
+    }
+
+    const eNalCodec codecs[2] = {NAL_CODEC_H264, NAL_CODEC_H265};
+    for(eNalCodec codec : codecs) {
+        std::vector<nal_unit_t> expect = naive_split(codec, data, size);
+        NalIterator it(data, size, codec);
+        nal_unit_t nal;
+        size_t count = 0;
+        nal_packet_info_t info;
+        while(it.next(nal)) {
+            if(count >= expect.size()) {
+                printf("FAIL codec %d: extra NAL at %td\n", codec, nal.data - data);
+                return false;
+            }
+            const nal_unit_t& e = expect[count];
+            if(nal.data != e.data || nal.size != e.size || nal.type != e.type || nal.is_vcl != e.is_vcl ||
+               nal.is_keyframe != e.is_keyframe || nal.is_reference != e.is_reference ||
+               nal.is_first_slice != e.is_first_slice || nal.temporal_id != e.temporal_id) {
+                printf("FAIL codec %d: NAL %zu at %td size %zu type %d, expect at %td size %zu type %d\n", codec,
+                       count, nal.data - data, nal.size, nal.type, e.data - data, e.size, e.type);
+                return false;
+            }
+            if(e.is_vcl) {
+                if(!info.has_vcl) {
+                    info.temporal_id = e.temporal_id;
+                }
+                info.has_vcl = true;
+                info.is_keyframe |= e.is_keyframe;
+                info.is_reference |= e.is_reference;
+            }
+            count++;
+        }
+        if(count != expect.size()) {
+            printf("FAIL codec %d: %zu NALs, expect %zu\n", codec, count, expect.size());
+            return false;
+        }
+        nal_packet_info_t got = nal_inspect_packet(codec, data, size);
+        if(got.has_vcl != info.has_vcl || got.is_keyframe != info.is_keyframe ||
+           got.is_reference != info.is_reference || got.temporal_id != info.temporal_id) {
+            printf("FAIL codec %d: packet info mismatch\n", codec);
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef NAL_PARSER_LIBFUZZER
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    // 拷贝到精确长度的缓冲, 越界读能被 ASan 发现
+    std::vector<uint8_t> buf(data, data + size);
+    if(!check_buffer(buf.data(), buf.size())) {
+        dump(buf.data(), buf.size());
+        abort();
+    }
+    return 0;
+}
+#else
+// 生成偏向 0/1 的随机数据, 起始码(3/4字节)、连续的0和长段非0数据(走向量化跳过)都会出现
+static void make_buffer(std::mt19937& rng, std::vector<uint8_t>& buf) {
+    size_t size = rng() % 512;
+    buf.clear();
+    while(buf.size() < size) {
+        switch(rng() % 8) {
+        case 0:
+            buf.insert(buf.end(), {0, 0, 1});
+            break;
+        case 1:
+            buf.insert(buf.end(), {0, 0, 0, 1});
+            break;
+        case 2:
+            buf.push_back(0);
+            break;
+        case 3:
+            buf.push_back(rng() % 4);
+            break;
+        case 4: {
+            // 不含0的长段
+            size_t run = rng() % 64;
+            for(size_t i = 0; i < run; i++) {
+                buf.push_back(1 + rng() % 255);
+            }
+            break;
+        }
+        default:
+            buf.push_back(rng() & 0xff);
+            break;
+        }
+    }
+    buf.resize(size);
+}
+
+int main(int argc, char **argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 20000;
+    unsigned seed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> buf;
+    for(int i = 0; i < rounds; i++) {
+        make_buffer(rng, buf);
+        // 末尾不留余量, 向量化路径读到缓冲外时 ASan 能发现
+        std::vector<uint8_t> exact(buf);
+        if(!check_buffer(exact.data(), exact.size())) {
+            printf("nal_parser_fuzz: round %d (seed %u) failed, %zu bytes:\n", i, seed, exact.size());
+            dump(exact.data(), exact.size());
+            return 1;
+        }
+    }
+    printf("nal_parser_fuzz: %d rounds ok (seed %u)\n", rounds, seed);
+    return 0;
+}
+#endif